@@ -0,0 +1,198 @@
+/* Authors: John Little (jlittl04) & Aryan Pandey (apande04)
+ * Date: November 2019
+ * The Universal Machine
+ * File: um2c.c - ahead of time translator from .um images to C
+ *
+ * um2c writes a C file holding the image and one function running its 
+ * segment 0: a switch on the program pointer with a case per word, where
+ * each case is that instruction as C and falls through to the next one.
+ * LOADP into segment 0 sets the pointer and goes back round the switch, 
+ * which the host compiler turns into a jump table. compiled and linked 
+ * with aot/umrt.c and the machine's modules (all but um.c), it runs like
+ * ./um on that image.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "instructions.h"
+#include "loader.h"
+#include "memory.h"
+
+/* Name: spill
+   Purpose: emits code copying every register local into the runtime
+   Arguments: output stream
+   Return: void
+*/
+static void spill(FILE * fp){
+    fprintf(fp, "            ");
+    for (int r = 0; r < REG_COUNT; r++){
+        fprintf(fp, "m->registers[%d] = r%d; ", r, r);
+    }
+    fprintf(fp, "\n");
+}
+
+/* Name: handOver
+   Purpose: emits code handing the machine to the interpreter at a pc
+   Arguments: output stream, C expression for the pc
+   Return: void
+*/
+static void handOver(FILE * fp, const char * pc){
+    fprintf(fp, "            {\n");
+    spill(fp);
+    fprintf(fp, "            m->pc = %s;\n            return 0;\n"
+                "            }\n", pc);
+}
+
+/* Name: emitInstruct
+   Purpose: emits the C for one instruction. registers live in locals r0 to
+            r7; helpers from instructions.c get the ones they use through 
+            m->registers.
+   Arguments: output stream, its pc, the instruction
+   Return: void
+*/
+static void emitInstruct(FILE * fp, uint32_t pc, umInstruction input){
+    opCode code = getOpCode(input);
+    regID a = getRegA(input), b = getRegB(input), c = getRegC(input);
+    char here[16];
+    snprintf(here, sizeof(here), "%" PRIu32, pc);
+
+    fprintf(fp, "        case %" PRIu32 ":\n", pc);
+    switch (code){
+    case CMOV:
+        fprintf(fp, "            if (r%d != 0) r%d = r%d;\n", c, a, b);
+        break;
+    case SLOAD:
+        fprintf(fp, "            r%d = getWordat(r%d, r%d, m->memory);\n",
+                a, b, c);
+        break;
+    case SSTORE:
+        fprintf(fp, "            if (umrtStore(m, r%d, r%d, r%d))\n", 
+                a, b, c);
+        snprintf(here, sizeof(here), "%" PRIu32, pc + 1);
+        handOver(fp, here);
+        break;
+    case ADD:
+        fprintf(fp, "            r%d = r%d + r%d;\n", a, b, c);
+        break;
+    case MUL:
+        fprintf(fp, "            r%d = r%d * r%d;\n", a, b, c);
+        break;
+    case DIV:
+        fprintf(fp, "            r%d = r%d / r%d;\n", a, b, c);
+        break;
+    case NAND:
+        fprintf(fp, "            r%d = ~(r%d & r%d);\n", a, b, c);
+        break;
+    case HALT:
+        fprintf(fp, "            return 1;\n");
+        break;
+    case MAP:
+        fprintf(fp, "            m->registers[%d] = r%d;\n"
+                    "            mapSeg(m->registers, %d, %d, m->memory);\n"
+                    "            r%d = m->registers[%d];\n", 
+                c, c, c, b, b, b);
+        break;
+    case UNMAP:
+        fprintf(fp, "            m->registers[%d] = r%d;\n"
+                    "            unmapSeg(m->registers, %d, m->memory);\n", 
+                c, c, c);
+        break;
+    case OUT:
+        fprintf(fp, "            m->registers[%d] = r%d;\n"
+                    "            out(m->io, m->registers, %d);\n", c, c, c);
+        break;
+    case IN:
+        fprintf(fp, "            in(m->io, m->registers, %d);\n"
+                    "            r%d = m->registers[%d];\n", c, c, c);
+        break;
+    case LOADP:
+        /* the interpreter runs a LOADP of another segment itself */
+        fprintf(fp, "            if (r%d != 0)\n", b);
+        handOver(fp, here);
+        fprintf(fp, "            pc = r%d;\n            continue;\n", c);
+        break;
+    case LV:
+        fprintf(fp, "            r%d = %" PRIu32 "u;\n", getRegAprime(input),
+                getValue(input));
+        break;
+    default:
+        /* not an instruction: the interpreter halts on it */
+        handOver(fp, here);
+        return;
+    }
+    if (code != HALT && code != LOADP){
+        fprintf(fp, "            /* fall through */\n");
+    }
+}
+
+/* Name: translate
+   Purpose: writes the C translation of a program
+   Arguments: output stream, image path (for the comment), segment 0
+   Return: void
+*/
+static void translate(FILE * fp, const char * path, Segment program){
+    uint32_t length = segLength(program);
+    fprintf(fp, "/* generated by um2c from %s -- do not edit */\n\n"
+                "#include \"umrt.h\"\n\n", path);
+
+    fprintf(fp, "static const word image[%" PRIu32 "] = {", 
+            length > 0 ? length : 1);
+    for (uint32_t i = 0; i < length; i++){
+        fprintf(fp, "%s0x%08" PRIx32 ",", i % 6 == 0 ? "\n    " : " ", 
+                program[i]);
+    }
+    fprintf(fp, "\n};\n\n");
+
+    fprintf(fp, "static int run(umrt * m, uint32_t pc)\n{\n    word ");
+    for (int r = 0; r < REG_COUNT; r++){
+        fprintf(fp, "r%d = m->registers[%d]%s", r, r, 
+                r + 1 < REG_COUNT ? ", " : ";\n");
+    }
+    fprintf(fp, "    for (;;){\n        switch (pc){\n");
+    for (uint32_t pc = 0; pc < length; pc++){
+        emitInstruct(fp, pc, program[pc]);
+    }
+
+    /* running off the end stops there; a jump out of segment 0 hands the
+     * jump's target over
+     */
+    char end[16];
+    snprintf(end, sizeof(end), "%" PRIu32 "u", length);
+    fprintf(fp, "        case %s:\n", end);
+    handOver(fp, end);
+    fprintf(fp, "        default:\n");
+    handOver(fp, "pc");
+    fprintf(fp, "        }\n    }\n}\n\n");
+
+    fprintf(fp, "int main(int argc, char * argv[])\n{\n"
+                "    return umrtMain(argc, argv, image, %" PRIu32 "u, run);"
+                "\n}\n", length);
+}
+
+int main(int argc, char * argv[]){
+    if (argc != 3){
+        fprintf(stderr, "USAGE ERROR | Proper Usage: ./um2c "
+                        "[UMBinaryFile].um (- for stdin) "
+                        "[output].c (- for stdout)\n");
+        return EXIT_FAILURE;
+    }
+
+    Segment program = loadImage(argv[1]);
+    FILE * fp = strcmp(argv[2], "-") == 0 ? stdout : fopen(argv[2], "w");
+    if (fp == NULL){
+        fprintf(stderr, "um2c: cannot write %s: %s\n", argv[2], 
+                strerror(errno));
+        return EXIT_FAILURE;
+    }
+    translate(fp, argv[1], program);
+    if (fp != stdout && fclose(fp) != 0){
+        fprintf(stderr, "um2c: cannot write %s: %s\n", argv[2], 
+                strerror(errno));
+        return EXIT_FAILURE;
+    }
+    deallocate(program);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,69 @@
+/* Authors: John Little (jlittl04) & Aryan Pandey (apande04)
+ * Date: November 2019
+ * The Universal Machine
+ * File: umrt.c - implementation for the runtime of translated UM programs
+ *
+ * the translated code runs against the memory and registers of a libum 
+ * machine, which interprets from wherever the translated code hands over,
+ * so the runtime links against every module but um.c.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "umrt.h"
+#include "machine.h"
+
+/* Name: umrtStore
+   Purpose: stores a word for translated code
+   Arguments: runtime, segment ID, offset, new word
+   Return: int -- 1 if segment 0 no longer matches the translated code
+*/
+int umrtStore(umrt * m, word seg, word offset, word value){
+    editWord(m->memory, seg, offset, value);
+    return seg == 0 && value != m->image[offset];
+}
+
+/* Name: umrtMain
+   Purpose: runs a translated program on stdin and stdout, from its first
+            instruction until it halts, finishing in the interpreter if 
+            the translated code hands over
+   Arguments: argc, argv (--threaded-io is the only option), segment 0 as
+              translated, its length, the translated code
+   Return: int -- exit status, as ./um's (FAULT_EXIT after a fault)
+*/
+int umrtMain(int argc, char * argv[], const word * image, uint32_t length,
+             umTranslated run){
+    int threadedIO = 0;
+    for (int i = 1; i < argc; i++){
+        if (strcmp(argv[i], "--threaded-io") != 0){
+            fprintf(stderr, "USAGE ERROR | Proper Usage: %s "
+                            "[--threaded-io]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+        threadedIO = 1;
+    }
+
+    umMachine * machine = umNew(0);
+    Segment zero = rawSegment(length);
+    memcpy(zero, image, (size_t)length * sizeof(word));
+    umLoadSegment(machine, zero);
+    umIO * io = newIO(STDIN_FILENO, STDOUT_FILENO, threadedIO);
+    umSetIO(machine, io);
+
+    umrt m = { machine->memory, machine->registers, io, image, length, 0 };
+    umStatus status = UM_HALTED;
+    if (!run(&m, 0)){
+        machine->pc = m.pc;
+        status = umRun(machine, 0);
+    }
+    if (status == UM_FAULT){
+        umFaultReport(machine, stderr);
+    }
+    umFree(machine);
+    releaseArena();
+    freeIO(io);
+    return status == UM_FAULT ? FAULT_EXIT : EXIT_SUCCESS;
+}
@@ -0,0 +1,41 @@
+/* Authors: John Little (jlittl04) & Aryan Pandey (apande04)
+ * Date: November 2019
+ * The Universal Machine
+ * File: umrt.h - header file for the runtime of translated UM programs
+ */
+
+#ifndef UMRT_H
+#define UMRT_H
+
+#include <stdlib.h>
+#include <inttypes.h>
+#include "instructions.h"
+#include "memory.h"
+#include "umio.h"
+
+/* a program translated by um2c runs its segment 0 as C code against a 
+ * umrt. the translated code keeps the registers in locals and copies them
+ * into registers only around calls that need them. it hands the machine 
+ * over to the interpreter (setting pc and registers) when it can't go on:
+ * a LOADP of a non-zero segment, a store that changes segment 0, a jump
+ * outside segment 0 or an invalid instruction.
+ */
+typedef struct umrt {
+        segTable * memory;
+        word * registers;       /* the machine's own */
+        umIO * io;
+        const word * image;     /* segment 0 as translated */
+        uint32_t length;
+        uint32_t pc;
+} umrt;
+
+/* runs translated code from a pc: 1 once the machine halts, 0 when the
+ * interpreter should carry on from m->pc 
+ */
+typedef int (*umTranslated)(umrt * m, uint32_t pc);
+
+int umrtMain(int argc, char * argv[], const word * image, uint32_t length,
+             umTranslated run);
+int umrtStore(umrt * m, word seg, word offset, word value);
+
+#endif
@@ -0,0 +1,358 @@
+/* Authors: John Little (jlittl04) & Aryan Pandey (apande04)
+ * Date: November 2019
+ * The Universal Machine
+ * File: batch.c - implementation for the batch runner
+ *
+ * the images are loaded and decoded on the calling thread before any job
+ * starts, so the workers only ever read them. every job runs as a session
+ * on the scheduler (see sched.h); the calling thread starts jobs, reads
+ * their input and ends them. a session that runs out of input parks and
+ * tells the calling thread through a pipe, which then waits (in poll) for
+ * more input on that job's file alongside every other parked job's, so 
+ * no thread is ever stuck in read() for one job while others could run.
+ * at most BATCH_LIVE jobs are in flight at a time.
+ */
+
+#include "batch.h"
+#include "decode.h"
+#include "loader.h"
+#include "machine.h"
+#include "sched.h"
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BATCH_LIVE 256u         /* jobs running (and holding files) at once */
+#define BATCH_CHUNK (64u << 10) /* bytes of input read at a time */
+
+typedef struct batchImage {
+        const char * path;
+        Segment program;        /* decoded, never run */
+} batchImage;
+
+typedef struct batchJob {
+        const char * input;
+        const char * output;
+        uint32_t image;
+        int line;
+        int failed;
+        int inFd;
+        int outFd;
+        umSession * session;
+        int wake;               /* the batch's pipe, to poke it */
+        int hungry;             /* parked for input (set by a worker) */
+        int finished;           /* set by a worker */
+        umStatus status;
+} batchJob;
+
+typedef struct batch {
+        const char * manifest;
+        batchJob * jobs;
+        uint32_t jobCount;
+        batchImage * images;
+        uint32_t imageCount;
+        unsigned flags;         /* libum.h flags for every machine */
+        int wake[2];            /* workers poke the calling thread here */
+} batch;
+
+/* Name: findImage
+   Purpose: finds an image in the batch's list, loading and decoding it 
+            the first time it is named
+   Arguments: batch, path
+   Return: uint32_t -- index of the image
+*/
+static uint32_t findImage(batch * b, const char * path){
+    for (uint32_t i = 0; i < b->imageCount; i++){
+        if (strcmp(b->images[i].path, path) == 0){
+            return i;
+        }
+    }
+    b->images = realloc(b->images, (b->imageCount + 1) * sizeof(*b->images));
+    assert(b->images != NULL);
+    b->images[b->imageCount].path = strdup(path);
+    b->images[b->imageCount].program = loadImage(path);
+    getDecoded(b->images[b->imageCount].program);
+    return b->imageCount++;
+}
+
+/* Name: readManifest
+   Purpose: reads the jobs of a manifest, loading each image it names
+   Arguments: batch
+   Return: void
+*/
+static void readManifest(batch * b){
+    FILE * fp = fopen(b->manifest, "r");
+    if (fp == NULL){
+        fprintf(stderr, "um: cannot read %s: %s\n", b->manifest, 
+                strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    size_t length = 0;
+    char * line = NULL;
+    for (int lineNo = 1; getline(&line, &length, fp) >= 0; lineNo++){
+        char * save = NULL;
+        char * fields[4] = { NULL, NULL, NULL, NULL };
+        char * at = line;
+        int count = 0;
+        while (count < 4 && 
+               (fields[count] = strtok_r(at, " \t\r\n", &save)) != NULL){
+            at = NULL;
+            count++;
+        }
+        if (count == 0 || fields[0][0] == '#'){
+            continue;
+        }
+        if (count != 3){
+            fprintf(stderr, "um: %s:%d: expected image, input and output\n",
+                    b->manifest, lineNo);
+            exit(EXIT_FAILURE);
+        }
+        b->jobs = realloc(b->jobs, (b->jobCount + 1) * sizeof(*b->jobs));
+        assert(b->jobs != NULL);
+        batchJob * job = &b->jobs[b->jobCount++];
+        job->image = findImage(b, fields[0]);
+        job->input = strdup(fields[1]);
+        job->output = strdup(fields[2]);
+        job->line = lineNo;
+        job->failed = 0;
+        job->hungry = 0;
+        job->finished = 0;
+    }
+    free(line);
+    fclose(fp);
+}
+
+/* Name: poke
+   Purpose: wakes the calling thread out of poll
+   Arguments: the job it should look at
+   Return: void
+*/
+static void poke(batchJob * job){
+    unsigned char byte = 0;
+    while (write(job->wake, &byte, 1) < 0 && errno == EINTR){
+        continue;
+    }
+}
+
+/* Name: jobWrite
+   Purpose: the write hook of a job: writes its output to the output file
+   Arguments: job, bytes, byte count
+   Return: void
+*/
+static void jobWrite(void * cl, const unsigned char * buf, size_t count){
+    batchJob * job = cl;
+    while (count > 0){
+        ssize_t done = write(job->outFd, buf, count);
+        if (done < 0 && errno == EINTR){
+            continue;
+        }
+        if (done <= 0){
+            return;
+        }
+        buf += done;
+        count -= (size_t)done;
+    }
+}
+
+/* Name: jobParked
+   Purpose: the parked hook of a job: asks for more of its input
+   Arguments: job
+   Return: void
+*/
+static void jobParked(void * cl){
+    batchJob * job = cl;
+    __atomic_store_n(&job->hungry, 1, __ATOMIC_SEQ_CST);
+    poke(job);
+}
+
+/* Name: jobFinished
+   Purpose: the finished hook of a job: hands it back to be ended
+   Arguments: job, how its machine stopped
+   Return: void
+*/
+static void jobFinished(void * cl, umStatus status){
+    batchJob * job = cl;
+    job->status = status;
+    __atomic_store_n(&job->finished, 1, __ATOMIC_SEQ_CST);
+    poke(job);
+}
+
+/* Name: startJob
+   Purpose: opens a job's files and spawns its machine as a session
+   Arguments: batch, scheduler, job
+   Return: int -- 1 if it started, 0 if its files couldn't be opened
+*/
+static int startJob(batch * b, umSched * sched, batchJob * job){
+    job->inFd = open(job->input, O_RDONLY);
+    job->outFd = job->inFd < 0 ? -1 : 
+                 open(job->output, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (job->inFd < 0 || job->outFd < 0){
+        fprintf(stderr, "um: %s:%d: cannot open %s: %s\n", b->manifest,
+                job->line, job->inFd < 0 ? job->input : job->output, 
+                strerror(errno));
+        if (job->inFd >= 0){
+            close(job->inFd);
+        }
+        job->failed = 1;
+        return 0;
+    }
+
+    umMachine * machine = umNew(b->flags);
+    Segment program = b->images[job->image].program;
+    Segment zero = copySegment(program);
+    shareDecoded(zero, SEG_HEADER(program)->code);
+    umLoadSegment(machine, zero);
+
+    job->wake = b->wake[1];
+    umSessionHooks hooks = { jobWrite, jobParked, jobFinished, job };
+    job->session = schedSpawn(sched, machine, hooks);
+    return 1;
+}
+
+/* Name: feedJob
+   Purpose: reads what input a parked job has waiting and feeds it, or 
+            closes its input at the end of the file
+   Arguments: job
+   Return: void
+*/
+static void feedJob(batchJob * job){
+    static unsigned char chunk[BATCH_CHUNK];
+    ssize_t got = read(job->inFd, chunk, sizeof(chunk));
+    if (got > 0){
+        sessionFeed(job->session, chunk, (size_t)got);
+    }
+    else if (got < 0 && (errno == EINTR || errno == EAGAIN)){
+        __atomic_store_n(&job->hungry, 1, __ATOMIC_SEQ_CST);
+    }
+    else {
+        sessionClose(job->session);
+    }
+}
+
+/* Name: endJob
+   Purpose: reports a job whose machine faulted, frees its session and 
+            closes its files
+   Arguments: batch, job
+   Return: void
+*/
+static void endJob(batch * b, batchJob * job){
+    if (job->status == UM_FAULT){
+        fprintf(stderr, "um: %s:%d: %s faulted\n", b->manifest, job->line,
+                b->images[job->image].path);
+        umFaultReport(sessionMachine(job->session), stderr);
+        job->failed = 1;
+    }
+    freeSession(job->session);
+    close(job->inFd);
+    close(job->outFd);
+}
+
+/* Name: runJobs
+   Purpose: runs every job on a scheduler: starts jobs while there is room,
+            feeds the parked ones as their input arrives and ends the 
+            finished ones, until none are left
+   Arguments: batch, scheduler
+   Return: void
+*/
+static void runJobs(batch * b, umSched * sched){
+    batchJob * live[BATCH_LIVE];
+    batchJob * polled[BATCH_LIVE + 1];
+    struct pollfd fds[BATCH_LIVE + 1];
+    uint32_t liveCount = 0;
+    uint32_t next = 0;
+    for (;;){
+        while (next < b->jobCount && liveCount < BATCH_LIVE){
+            batchJob * job = &b->jobs[next++];
+            if (startJob(b, sched, job)){
+                live[liveCount++] = job;
+            }
+        }
+
+        nfds_t count = 0;
+        fds[count++] = (struct pollfd){ b->wake[0], POLLIN, 0 };
+        for (uint32_t i = 0; i < liveCount; i++){
+            batchJob * job = live[i];
+            if (__atomic_load_n(&job->finished, __ATOMIC_SEQ_CST)){
+                endJob(b, job);
+                live[i--] = live[--liveCount];
+            }
+            else if (__atomic_load_n(&job->hungry, __ATOMIC_SEQ_CST)){
+                polled[count] = job;
+                fds[count++] = (struct pollfd){ job->inFd, POLLIN, 0 };
+            }
+        }
+        if (liveCount == 0 && next == b->jobCount){
+            return;
+        }
+        if (liveCount < BATCH_LIVE && next < b->jobCount){
+            continue;   /* a job ended: start the next one first */
+        }
+
+        if (poll(fds, count, -1) < 0){
+            continue;
+        }
+        if (fds[0].revents){
+            unsigned char drain[256];
+            while (read(b->wake[0], drain, sizeof(drain)) > 0){
+                continue;
+            }
+        }
+        for (nfds_t i = 1; i < count; i++){
+            if (fds[i].revents){
+                __atomic_store_n(&polled[i]->hungry, 0, __ATOMIC_SEQ_CST);
+                feedJob(polled[i]);
+            }
+        }
+    }
+}
+
+/* Name: runBatch
+   Purpose: runs every job in a manifest across a pool of threads
+   Arguments: manifest path, thread count (0 for one per core), libum.h 
+              flags for the machines
+   Return: int -- number of jobs that failed
+*/
+int runBatch(const char * manifest, int threads, unsigned flags){
+    assert(manifest != NULL);
+    batch b = { .manifest = manifest, .flags = flags };
+    readManifest(&b);
+
+    if (threads <= 0){
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cores > 0 ? (int)cores : 1;
+    }
+    if ((uint32_t)threads > b.jobCount){
+        threads = b.jobCount > 0 ? (int)b.jobCount : 1;
+    }
+    int failed = pipe(b.wake);
+    assert(!failed);
+    (void)failed;
+    fcntl(b.wake[0], F_SETFL, O_NONBLOCK);
+    fcntl(b.wake[1], F_SETFL, O_NONBLOCK);
+    umSched * sched = newSched(threads, 0);
+    runJobs(&b, sched);
+    freeSched(sched);
+    close(b.wake[0]);
+    close(b.wake[1]);
+
+    int failures = 0;
+    for (uint32_t i = 0; i < b.jobCount; i++){
+        failures += b.jobs[i].failed;
+        free((char *)b.jobs[i].input);
+        free((char *)b.jobs[i].output);
+    }
+    fprintf(stderr, "um: %s: %" PRIu32 " jobs on %d thread%s, %d failed\n",
+            manifest, b.jobCount, threads, threads == 1 ? "" : "s", 
+            failures);
+    for (uint32_t i = 0; i < b.imageCount; i++){
+        deallocate(b.images[i].program);
+        free((char *)b.images[i].path);
+    }
+    free(b.images);
+    free(b.jobs);
+    return failures;
+}
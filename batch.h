@@ -0,0 +1,26 @@
+/* Authors: John Little (jlittl04) & Aryan Pandey (apande04)
+ * Date: November 2019
+ * The Universal Machine
+ * File: batch.h - header file for the batch runner
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdlib.h>
+#include <inttypes.h>
+#include "memory.h"
+#include "umio.h"
+
+/* the batch runner reads a manifest of jobs, one per line:
+ *     image input output
+ * (blank lines and lines starting with # are skipped) and runs every job
+ * as its own machine, a session on a scheduler with a pool of threads 
+ * (see sched.h). each distinct image is loaded and decoded once; every 
+ * machine running it starts from a private copy of its words that borrows
+ * the decoded records until it is written.
+ */
+
+int runBatch(const char * manifest, int threads, unsigned flags);
+
+#endif
@@ -0,0 +1,192 @@
+/* Authors: John Little (jlittl04) & Aryan Pandey (apande04)
+ * Date: November 2019
+ * The Universal Machine
+ * File: umasm.c - implementation for the UM assembler used by the benchmarks
+ */
+
+#include "umasm.h"
+#include <assert.h>
+#include <stdio.h>
+
+#define UNBOUND UINT32_MAX
+
+struct umAsm {
+        word * code;
+        uint32_t length;
+        uint32_t capacity;
+        uint32_t * labels;
+        int labelCount;
+        uint32_t * fixups;      /* pcs of LVs waiting on a label */
+        int * fixupLabels;
+        int fixupCount;
+};
+
+/* Name: newAsm
+   Purpose: starts a new, empty program
+   Arguments: none
+   Return: umAsm pointer
+*/
+umAsm * newAsm(void){
+    umAsm * prog = calloc(1, sizeof(*prog));
+    assert(prog != NULL);
+    return prog;
+}
+
+/* Name: freeAsm
+   Purpose: frees a program
+   Arguments: umAsm pointer
+   Return: void
+*/
+void freeAsm(umAsm * prog){
+    if (prog == NULL){
+        return;
+    }
+    free(prog->code);
+    free(prog->labels);
+    free(prog->fixups);
+    free(prog->fixupLabels);
+    free(prog);
+}
+
+/* Name: asmWord
+   Purpose: appends a raw word to the program
+   Arguments: umAsm pointer, the word
+   Return: void
+*/
+void asmWord(umAsm * prog, word value){
+    assert(prog != NULL);
+    if (prog->length == prog->capacity){
+        prog->capacity = prog->capacity ? prog->capacity * 2 : 256;
+        prog->code = realloc(prog->code, 
+                             prog->capacity * sizeof(*prog->code));
+        assert(prog->code != NULL);
+    }
+    prog->code[prog->length++] = value;
+}
+
+/* Name: asmOp
+   Purpose: appends a three register instruction (unused registers are 0)
+   Arguments: umAsm pointer, opcode, registers A, B and C
+   Return: void
+*/
+void asmOp(umAsm * prog, opCode code, regID a, regID b, regID c){
+    assert(code != LV);
+    asmWord(prog, ((word)code << OP_CODE_LSB) | ((word)a << REGA_LSB) |
+                  ((word)b << REGB_LSB) | ((word)c << REGC_LSB));
+}
+
+/* Name: asmLoadVal
+   Purpose: appends a LOAD VALUE of a 25 bit value
+   Arguments: umAsm pointer, register A', the value
+   Return: void
+*/
+void asmLoadVal(umAsm * prog, regID a, word value){
+    assert(value < (UINT32_C(1) << VAL_WIDTH));
+    asmWord(prog, ((word)LV << OP_CODE_LSB) | 
+                  ((word)a << REGAprime_LSB) | value);
+}
+
+/* Name: asmConst
+   Purpose: appends code loading any 32 bit value (LV, LV, MUL, LV, ADD)
+   Arguments: umAsm pointer, target register, the value, scratch register
+   Return: void
+*/
+void asmConst(umAsm * prog, regID a, word value, regID scratch){
+    assert(a != scratch);
+    asmLoadVal(prog, a, value >> 16);
+    asmLoadVal(prog, scratch, 1u << 16);
+    asmOp(prog, MUL, a, a, scratch);
+    asmLoadVal(prog, scratch, value & 0xFFFF);
+    asmOp(prog, ADD, a, a, scratch);
+}
+
+/* Name: asmNewLabel
+   Purpose: makes a new, unbound label
+   Arguments: umAsm pointer
+   Return: int -- the label
+*/
+int asmNewLabel(umAsm * prog){
+    prog->labels = realloc(prog->labels, 
+                           (prog->labelCount + 1) * sizeof(*prog->labels));
+    assert(prog->labels != NULL);
+    prog->labels[prog->labelCount] = UNBOUND;
+    return prog->labelCount++;
+}
+
+/* Name: asmBind
+   Purpose: binds a label to the next instruction and patches every LV 
+            that was waiting on it
+   Arguments: umAsm pointer, label
+   Return: void
+*/
+void asmBind(umAsm * prog, int label){
+    assert(label >= 0 && label < prog->labelCount);
+    assert(prog->labels[label] == UNBOUND);
+    prog->labels[label] = prog->length;
+    for (int i = 0; i < prog->fixupCount; i++){
+        if (prog->fixupLabels[i] == label){
+            prog->code[prog->fixups[i]] |= prog->length;
+        }
+    }
+}
+
+/* Name: asmLoadLabel
+   Purpose: appends an LV of the address a label is (or will be) bound to
+   Arguments: umAsm pointer, register A', label
+   Return: void
+*/
+void asmLoadLabel(umAsm * prog, regID a, int label){
+    assert(label >= 0 && label < prog->labelCount);
+    if (prog->labels[label] != UNBOUND){
+        asmLoadVal(prog, a, prog->labels[label]);
+        return;
+    }
+    prog->fixups = realloc(prog->fixups, 
+                           (prog->fixupCount + 1) * sizeof(*prog->fixups));
+    prog->fixupLabels = realloc(prog->fixupLabels, (prog->fixupCount + 1) *
+                                sizeof(*prog->fixupLabels));
+    assert(prog->fixups != NULL && prog->fixupLabels != NULL);
+    prog->fixups[prog->fixupCount] = prog->length;
+    prog->fixupLabels[prog->fixupCount++] = label;
+    asmLoadVal(prog, a, 0);
+}
+
+/* Name: asmHere
+   Purpose: address of the next instruction
+   Arguments: umAsm pointer
+   Return: uint32_t
+*/
+uint32_t asmHere(umAsm * prog){
+    return prog->length;
+}
+
+/* Name: asmWords
+   Purpose: the program so far, one word per instruction
+   Arguments: umAsm pointer
+   Return: word array (owned by the umAsm)
+*/
+const word * asmWords(umAsm * prog){
+    return prog->code;
+}
+
+/* Name: asmWrite
+   Purpose: writes the program out as a .um image (big-endian words). 
+            every label used must be bound by now.
+   Arguments: umAsm pointer, path
+   Return: int -- 0 on success, -1 if the file couldn't be written
+*/
+int asmWrite(umAsm * prog, const char * path){
+    for (int i = 0; i < prog->fixupCount; i++){
+        assert(prog->labels[prog->fixupLabels[i]] != UNBOUND);
+    }
+    FILE * fp = fopen(path, "wb");
+    if (fp == NULL){
+        return -1;
+    }
+    for (uint32_t i = 0; i < prog->length; i++){
+        word w = prog->code[i];
+        unsigned char bytes[4] = { w >> 24, w >> 16, w >> 8, w };
+        fwrite(bytes, 1, sizeof(bytes), fp);
+    }
+    return fclose(fp) == 0 ? 0 : -1;
+}
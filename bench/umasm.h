@@ -0,0 +1,40 @@
+/* Authors: John Little (jlittl04) & Aryan Pandey (apande04)
+ * Date: November 2019
+ * The Universal Machine
+ * File: umasm.h - header file for the UM assembler used by the benchmarks
+ */
+
+#ifndef UMASM_H
+#define UMASM_H
+
+#include <stdlib.h>
+#include <inttypes.h>
+#include "instructions.h"
+
+/* an umAsm collects instructions for a new program. labels are small 
+ * integers handed out by asmNewLabel; asmLoadLabel may refer to a label
+ * before it is bound and is patched when the label is bound.
+ */
+typedef struct umAsm umAsm;
+
+/* creating and freeing */
+umAsm * newAsm(void);
+void freeAsm(umAsm * prog);
+
+/* emitting instructions */
+void asmOp(umAsm * prog, opCode code, regID a, regID b, regID c);
+void asmLoadVal(umAsm * prog, regID a, word value);
+void asmConst(umAsm * prog, regID a, word value, regID scratch);
+void asmWord(umAsm * prog, word value);
+
+/* labels */
+int asmNewLabel(umAsm * prog);
+void asmBind(umAsm * prog, int label);
+void asmLoadLabel(umAsm * prog, regID a, int label);
+uint32_t asmHere(umAsm * prog);
+
+/* finished programs */
+const word * asmWords(umAsm * prog);
+int asmWrite(umAsm * prog, const char * path);
+
+#endif
@@ -0,0 +1,505 @@
+/* Authors: John Little (jlittl04) & Aryan Pandey (apande04)
+ * Date: November 2019
+ * The Universal Machine
+ * File: umbench.c - benchmark driver for the UM
+ *
+ * umbench writes a synthetic program for each class of instruction the
+ * machine has (arithmetic, segment loads and stores, map/unmap churn, 
+ * load program trampolines and output floods), runs the um binary on each
+ * one, and prints a line of JSON per run with the instruction count, wall
+ * time, instructions per second and the child's peak resident set size.
+ * any other .um images named on the command line are run the same way.
+ * the output of one run can be saved and handed back as a baseline; runs
+ * slower than the baseline by more than the tolerance are flagged and make
+ * umbench exit with status 1.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "umasm.h"
+
+#define MAX_UM_ARGS 16
+#define MAX_BASELINE 64
+
+typedef struct result {
+        char name[64];
+        double instructions;    /* 0 when unknown */
+        double seconds;
+        double ips;
+        long maxRSS;            /* KB */
+        int status;
+} result;
+
+typedef struct benchmark {
+        const char * name;
+        uint64_t (*generate)(umAsm * prog, uint32_t iterations);
+        uint32_t iterations;
+} benchmark;
+
+/*--------------------------------------------------------------------------*/
+/*                              the programs                                */
+/*--------------------------------------------------------------------------*/
+
+/* every generator returns the exact number of instructions its program 
+ * executes, worked out from the addresses of its loops. each loop counts
+ * r1 down to 0 with loopBack, which is 7 instructions.
+ */
+
+static void decrement(umAsm * prog, regID r, regID scratch){
+    asmLoadVal(prog, scratch, 0);
+    asmOp(prog, NAND, scratch, scratch, scratch);
+    asmOp(prog, ADD, r, r, scratch);
+}
+
+/* Name: loopBack
+   Purpose: decrements r1 and goes to top unless it reached 0, in which 
+            case it goes to out. clobbers r5, r6 and r7.
+   Arguments: umAsm pointer, top label, out label
+   Return: void
+*/
+static void loopBack(umAsm * prog, int top, int out){
+    decrement(prog, 1, 5);
+    asmLoadLabel(prog, 6, out);
+    asmLoadLabel(prog, 7, top);
+    asmOp(prog, CMOV, 6, 7, 1);
+    asmOp(prog, LOADP, 0, 0, 6);
+}
+
+/* straight line prologue, loop executed iterations times, one HALT */
+static uint64_t loopCount(uint32_t top, uint32_t out, uint32_t iterations){
+    return top + (uint64_t)iterations * (out - top) + 1;
+}
+
+/* arithmetic: ADD, MUL, NAND, DIV and CMOV on a few live registers */
+static uint64_t genALU(umAsm * prog, uint32_t iterations){
+    int top = asmNewLabel(prog), out = asmNewLabel(prog);
+    asmLoadVal(prog, 0, 0);
+    asmConst(prog, 1, iterations, 7);
+    asmLoadVal(prog, 2, 12345);
+    asmLoadVal(prog, 3, 678);
+    asmBind(prog, top);
+    uint32_t start = asmHere(prog);
+    asmLoadVal(prog, 6, 7);
+    asmOp(prog, ADD, 2, 2, 3);
+    asmOp(prog, MUL, 3, 3, 2);
+    asmOp(prog, NAND, 4, 2, 3);
+    asmOp(prog, DIV, 5, 4, 6);
+    asmOp(prog, CMOV, 2, 5, 4);
+    asmOp(prog, ADD, 3, 3, 5);
+    asmOp(prog, NAND, 2, 2, 2);
+    asmOp(prog, ADD, 2, 2, 6);
+    loopBack(prog, top, out);
+    asmBind(prog, out);
+    asmOp(prog, HALT, 0, 0, 0);
+    return loopCount(start, asmHere(prog) - 1, iterations);
+}
+
+/* segment loads and stores spread over a 64K word segment */
+static uint64_t genMemory(umAsm * prog, uint32_t iterations){
+    int top = asmNewLabel(prog), out = asmNewLabel(prog);
+    asmLoadVal(prog, 0, 0);
+    asmConst(prog, 1, iterations, 7);
+    asmLoadVal(prog, 3, 0xFFFF);
+    asmLoadVal(prog, 6, 0x10000);
+    asmOp(prog, MAP, 0, 2, 6);
+    asmBind(prog, top);
+    uint32_t start = asmHere(prog);
+    asmOp(prog, NAND, 4, 1, 3);
+    asmOp(prog, NAND, 4, 4, 4);
+    asmOp(prog, SSTORE, 2, 4, 1);
+    asmOp(prog, SLOAD, 5, 2, 4);
+    asmOp(prog, ADD, 5, 5, 1);
+    asmOp(prog, SSTORE, 2, 4, 5);
+    asmOp(prog, SLOAD, 6, 2, 4);
+    asmOp(prog, SLOAD, 5, 2, 0);
+    asmOp(prog, SSTORE, 2, 0, 6);
+    loopBack(prog, top, out);
+    asmBind(prog, out);
+    asmOp(prog, HALT, 0, 0, 0);
+    return loopCount(start, asmHere(prog) - 1, iterations);
+}
+
+/* MAP/UNMAP churn: two segments of 1 to 256 words live at a time */
+static uint64_t genMap(umAsm * prog, uint32_t iterations){
+    int top = asmNewLabel(prog), out = asmNewLabel(prog);
+    asmLoadVal(prog, 0, 0);
+    asmConst(prog, 1, iterations, 7);
+    asmLoadVal(prog, 3, 0xFF);
+    asmBind(prog, top);
+    uint32_t start = asmHere(prog);
+    asmOp(prog, NAND, 4, 1, 3);
+    asmOp(prog, NAND, 4, 4, 4);
+    asmLoadVal(prog, 6, 1);
+    asmOp(prog, ADD, 4, 4, 6);
+    asmOp(prog, MAP, 0, 2, 4);
+    asmOp(prog, SSTORE, 2, 0, 1);
+    asmOp(prog, MAP, 0, 5, 4);
+    asmOp(prog, UNMAP, 0, 0, 2);
+    asmOp(prog, UNMAP, 0, 0, 5);
+    loopBack(prog, top, out);
+    asmBind(prog, out);
+    asmOp(prog, HALT, 0, 0, 0);
+    return loopCount(start, asmHere(prog) - 1, iterations);
+}
+
+/* LOADP trampolines: the program copies itself into a segment, then
+ * bounces between that copy and a one word stub that loads it back, so 
+ * every trip around the loop replaces segment 0 twice. 
+ */
+static uint64_t genLoadp(umAsm * prog, uint32_t iterations){
+    int copy = asmNewLabel(prog), copied = asmNewLabel(prog);
+    int top = asmNewLabel(prog), out = asmNewLabel(prog);
+    int bounce = asmNewLabel(prog), end = asmNewLabel(prog);
+    word stub = ((word)LOADP << OP_CODE_LSB) | (3 << REGB_LSB) | 2;
+
+    /* r3 := copy of the whole program */
+    asmLoadVal(prog, 0, 0);
+    asmConst(prog, 1, iterations, 7);
+    asmLoadLabel(prog, 2, end);
+    asmOp(prog, MAP, 0, 3, 2);
+    asmLoadVal(prog, 4, 0);
+    asmBind(prog, copy);
+    uint32_t copyStart = asmHere(prog);
+    asmOp(prog, SLOAD, 5, 0, 4);
+    asmOp(prog, SSTORE, 3, 4, 5);
+    asmLoadVal(prog, 5, 1);
+    asmOp(prog, ADD, 4, 4, 5);
+    asmLoadLabel(prog, 5, end);     /* r5 := r4 - length */
+    asmOp(prog, NAND, 5, 5, 5);
+    asmLoadVal(prog, 6, 1);
+    asmOp(prog, ADD, 5, 5, 6);
+    asmOp(prog, ADD, 5, 4, 5);
+    asmLoadLabel(prog, 6, copied);
+    asmLoadLabel(prog, 7, copy);
+    asmOp(prog, CMOV, 6, 7, 5);
+    asmOp(prog, LOADP, 0, 0, 6);
+    asmBind(prog, copied);
+    uint32_t copyEnd = asmHere(prog);
+
+    /* r4 := the stub, LOADP r3 r2 with r2 = top */
+    asmLoadVal(prog, 2, 1);
+    asmOp(prog, MAP, 0, 4, 2);
+    asmConst(prog, 5, stub, 6);
+    asmOp(prog, SSTORE, 4, 0, 5);
+    asmLoadLabel(prog, 2, top);
+    asmOp(prog, LOADP, 0, 3, 2);
+    asmBind(prog, top);
+    uint32_t loopStart = asmHere(prog);
+    loopBack(prog, bounce, out);
+    asmBind(prog, bounce);
+    uint32_t loopEnd = asmHere(prog);
+    asmLoadVal(prog, 5, 0);
+    asmOp(prog, LOADP, 0, 4, 5);
+    asmBind(prog, out);
+    asmOp(prog, HALT, 0, 0, 0);
+    asmBind(prog, end);
+
+    /* each trip is the loop, the two instructions at bounce and the 
+     * stub, except the last, which goes straight to out
+     */
+    uint32_t length = asmHere(prog);
+    uint32_t trip = (loopEnd - loopStart) + 2 + 1;
+    return copyStart + (uint64_t)length * (copyEnd - copyStart) +
+           (loopStart - copyEnd) + (uint64_t)iterations * trip - 3 + 1;
+}
+
+/* OUT floods: four bytes of output a trip */
+static uint64_t genOutput(umAsm * prog, uint32_t iterations){
+    int top = asmNewLabel(prog), out = asmNewLabel(prog);
+    asmLoadVal(prog, 0, 0);
+    asmConst(prog, 1, iterations, 7);
+    asmLoadVal(prog, 2, 'u');
+    asmLoadVal(prog, 3, 'm');
+    asmLoadVal(prog, 4, '\n');
+    asmBind(prog, top);
+    uint32_t start = asmHere(prog);
+    asmOp(prog, OUT, 0, 0, 2);
+    asmOp(prog, OUT, 0, 0, 3);
+    asmOp(prog, OUT, 0, 0, 3);
+    asmOp(prog, OUT, 0, 0, 4);
+    loopBack(prog, top, out);
+    asmBind(prog, out);
+    asmOp(prog, HALT, 0, 0, 0);
+    return loopCount(start, asmHere(prog) - 1, iterations);
+}
+
+static const benchmark benchmarks[] = {
+    { "alu",    genALU,    4000000 },
+    { "memory", genMemory, 3000000 },
+    { "map",    genMap,    2000000 },
+    { "loadp",  genLoadp,  3000000 },
+    { "output", genOutput, 4000000 },
+};
+
+#define BENCHMARK_COUNT (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+/*--------------------------------------------------------------------------*/
+/*                               running them                               */
+/*--------------------------------------------------------------------------*/
+
+static double now(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Name: runImage
+   Purpose: runs the um on an image with input and output on /dev/null,
+            timing it and collecting its peak resident set size
+   Arguments: um command line (the image is filled in last), image path,
+              where to put the result
+   Return: void
+*/
+static void runImage(char ** umArgv, int umArgc, const char * image, 
+                     result * r){
+    umArgv[umArgc] = (char *)image;
+    umArgv[umArgc + 1] = NULL;
+    double start = now();
+    pid_t pid = fork();
+    if (pid < 0){
+        perror("umbench: fork");
+        exit(EXIT_FAILURE);
+    }
+    if (pid == 0){
+        int null = open("/dev/null", O_RDWR);
+        if (null >= 0){
+            dup2(null, STDIN_FILENO);
+            dup2(null, STDOUT_FILENO);
+        }
+        execv(umArgv[0], umArgv);
+        fprintf(stderr, "umbench: cannot run %s: %s\n", umArgv[0], 
+                strerror(errno));
+        _exit(127);
+    }
+
+    int status;
+    struct rusage usage;
+    while (wait4(pid, &status, 0, &usage) < 0){
+        if (errno != EINTR){
+            perror("umbench: wait4");
+            exit(EXIT_FAILURE);
+        }
+    }
+    r->seconds = now() - start;
+    r->maxRSS = usage.ru_maxrss;
+    r->status = WIFEXITED(status) ? WEXITSTATUS(status) 
+                                  : 128 + WTERMSIG(status);
+    r->ips = r->instructions > 0 ? r->instructions / r->seconds : 0;
+}
+
+/* Name: printResult
+   Purpose: prints one result as a line of JSON
+   Arguments: stream, result
+   Return: void
+*/
+static void printResult(FILE * fp, result * r){
+    fprintf(fp, "{\"name\": \"%s\", \"instructions\": %.0f, "
+                "\"seconds\": %.6f, \"ips\": %.0f, \"max_rss_kb\": %ld, "
+                "\"exit\": %d}\n", r->name, r->instructions, r->seconds,
+                r->ips, r->maxRSS, r->status);
+}
+
+/* Name: readBaseline
+   Purpose: reads results saved by an earlier run (only name, seconds and
+            ips are used)
+   Arguments: path, array to fill, its size
+   Return: int -- how many were read
+*/
+static int readBaseline(const char * path, result * base, int max){
+    FILE * fp = fopen(path, "r");
+    if (fp == NULL){
+        fprintf(stderr, "umbench: cannot read %s: %s\n", path, 
+                strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    char line[512];
+    int count = 0;
+    while (count < max && fgets(line, sizeof(line), fp) != NULL){
+        result * r = &base[count];
+        char * name = strstr(line, "\"name\": \"");
+        char * seconds = strstr(line, "\"seconds\": ");
+        char * ips = strstr(line, "\"ips\": ");
+        if (name == NULL || seconds == NULL || ips == NULL ||
+            sscanf(name, "\"name\": \"%63[^\"]\"", r->name) != 1){
+            continue;
+        }
+        r->seconds = strtod(seconds + strlen("\"seconds\": "), NULL);
+        r->ips = strtod(ips + strlen("\"ips\": "), NULL);
+        count++;
+    }
+    fclose(fp);
+    return count;
+}
+
+/* Name: compare
+   Purpose: reports a result against its baseline. throughput is compared
+            where the instruction count is known, wall time otherwise.
+   Arguments: result, baseline results, their count, tolerance (fraction)
+   Return: int -- 1 if this is a regression, else 0
+*/
+static int compare(result * r, result * base, int baseCount, 
+                   double tolerance){
+    for (int i = 0; i < baseCount; i++){
+        if (strcmp(base[i].name, r->name) != 0){
+            continue;
+        }
+        double ratio = (r->ips > 0 && base[i].ips > 0) 
+                       ? r->ips / base[i].ips 
+                       : base[i].seconds / r->seconds;
+        int slower = ratio < 1 - tolerance;
+        fprintf(stderr, "%-24s %6.2fx baseline%s\n", r->name, ratio, 
+                slower ? "  REGRESSION" : "");
+        return slower;
+    }
+    fprintf(stderr, "%-24s no baseline\n", r->name);
+    return 0;
+}
+
+static void usage(void){
+    fprintf(stderr, "usage: umbench [--um path] [--um-arg arg]... "
+                    "[--scale n] [--only name]\n"
+                    "               [--baseline file] [--tolerance pct] "
+                    "[--keep dir] [image.um[:instructions]]...\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char * argv[]){
+    char * umArgv[MAX_UM_ARGS + 3] = { "./um" };
+    int umArgc = 1;
+    double scale = 1, tolerance = 0.10;
+    const char * only = NULL;
+    const char * baselinePath = NULL;
+    const char * keep = NULL;
+    int i;
+
+    for (i = 1; i < argc && strncmp(argv[i], "--", 2) == 0; i++){
+        if (strcmp(argv[i], "--") == 0){
+            i++;
+            break;
+        }
+        if (i + 1 == argc){
+            usage();
+        }
+        if (strcmp(argv[i], "--um") == 0){
+            umArgv[0] = argv[++i];
+        }
+        else if (strcmp(argv[i], "--um-arg") == 0 && umArgc <= MAX_UM_ARGS){
+            umArgv[umArgc++] = argv[++i];
+        }
+        else if (strcmp(argv[i], "--scale") == 0){
+            scale = strtod(argv[++i], NULL);
+        }
+        else if (strcmp(argv[i], "--only") == 0){
+            only = argv[++i];
+        }
+        else if (strcmp(argv[i], "--baseline") == 0){
+            baselinePath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--tolerance") == 0){
+            tolerance = strtod(argv[++i], NULL) / 100;
+        }
+        else if (strcmp(argv[i], "--keep") == 0){
+            keep = argv[++i];
+        }
+        else {
+            usage();
+        }
+    }
+    if (scale <= 0){
+        usage();
+    }
+
+    result base[MAX_BASELINE];
+    int baseCount = 0;
+    if (baselinePath != NULL){
+        baseCount = readBaseline(baselinePath, base, MAX_BASELINE);
+    }
+
+    char dir[] = "/tmp/umbench.XXXXXX";
+    if (keep != NULL && mkdir(keep, 0777) != 0 && errno != EEXIST){
+        fprintf(stderr, "umbench: cannot make %s: %s\n", keep, 
+                strerror(errno));
+        return EXIT_FAILURE;
+    }
+    if (keep == NULL && mkdtemp(dir) == NULL){
+        perror("umbench: mkdtemp");
+        return EXIT_FAILURE;
+    }
+    const char * outDir = keep != NULL ? keep : dir;
+    int regressions = 0, failures = 0;
+
+    for (size_t b = 0; b < BENCHMARK_COUNT; b++){
+        if (only != NULL && strcmp(only, benchmarks[b].name) != 0){
+            continue;
+        }
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s.um", outDir, benchmarks[b].name);
+        umAsm * prog = newAsm();
+        result r = { .instructions = benchmarks[b].generate(prog, 
+                         (uint32_t)(benchmarks[b].iterations * scale)) };
+        snprintf(r.name, sizeof(r.name), "%s", benchmarks[b].name);
+        if (asmWrite(prog, path) != 0){
+            fprintf(stderr, "umbench: cannot write %s: %s\n", path, 
+                    strerror(errno));
+            return EXIT_FAILURE;
+        }
+        freeAsm(prog);
+
+        runImage(umArgv, umArgc, path, &r);
+        printResult(stdout, &r);
+        failures += (r.status != 0);
+        if (baselinePath != NULL){
+            regressions += compare(&r, base, baseCount, tolerance);
+        }
+        if (keep == NULL){
+            unlink(path);
+        }
+    }
+    if (keep == NULL){
+        rmdir(dir);
+    }
+
+    /* other images: image.um or image.um:instructions */
+    for (; i < argc; i++){
+        char path[4096];
+        result r = { 0 };
+        snprintf(path, sizeof(path), "%s", argv[i]);
+        char * colon = strrchr(path, ':');
+        char * end = NULL;
+        if (colon != NULL){
+            r.instructions = strtod(colon + 1, &end);
+        }
+        if (end != NULL && end != colon + 1 && *end == '\0'){
+            *colon = '\0';
+        }
+        else {
+            r.instructions = 0;
+        }
+        const char * file = strrchr(path, '/');
+        snprintf(r.name, sizeof(r.name), "%.63s", file ? file + 1 : path);
+        if (only != NULL && strcmp(only, r.name) != 0){
+            continue;
+        }
+        runImage(umArgv, umArgc, path, &r);
+        printResult(stdout, &r);
+        failures += (r.status != 0);
+        if (baselinePath != NULL){
+            regressions += compare(&r, base, baseCount, tolerance);
+        }
+    }
+
+    fflush(stdout);
+    if (failures > 0){
+        fprintf(stderr, "umbench: %d run(s) exited with a failure\n", 
+                failures);
+    }
+    return (regressions > 0 || failures > 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,181 @@
+/* Authors: John Little (jlittl04) & Aryan Pandey (apande04)
+ * Date: November 2019
+ * The Universal Machine
+ * File: decode.c - implementation for the decode package
+ */
+
+#include "decode.h"
+#include <assert.h>
+#include <string.h>
+
+/* Name: decodeInstruct
+   Purpose: unpacks every field of a UM instruction into a decoded record.
+            opcodes 14 and 15 are not instructions and decode to OP_INVALID
+   Arguments: a UM instruction, the record to fill in
+   Return: void
+*/
+void decodeInstruct(umInstruction input, umDecoded * trgt){
+    assert(trgt != NULL);
+
+    uint8_t code = UM_OPCODE(input);
+    trgt->op = (code < OP_INVALID) ? code : OP_INVALID;
+    trgt->value = 0;
+    if (code == LV){
+        trgt->a = UM_REGAprime(input);
+        trgt->b = 0;
+        trgt->c = 0;
+        trgt->value = UM_VALUE(input);
+    }
+    else {
+        trgt->a = UM_REGA(input);
+        trgt->b = UM_REGB(input);
+        trgt->c = UM_REGC(input);
+    }
+}
+
+/* Name: decodeProgram
+   Purpose: translates a whole program segment into an array of decoded 
+            records, one per word. one extra OP_INVALID record sits past the
+            end so running off the end of the program halts the machine.
+   Arguments: the program segment
+   Return: umDecoded array (free with freeDecoded)
+*/
+umDecoded * decodeProgram(Segment program){
+    assert(program != NULL);
+
+    uint32_t len = segLength(program);
+    umDecoded * code = malloc(((size_t)len + 1) * sizeof(*code));
+    assert(code != NULL);
+    for (uint32_t i = 0; i < len; i++){
+        decodeInstruct(program[i], &code[i]);
+    }
+    decodeInstruct((umInstruction)OP_INVALID << OP_CODE_LSB, &code[len]);
+    fuseProgram(code, len);
+
+    return code;
+}
+
+/* Name: fuseIdiom
+   Purpose: finds the fused opcode for the idiom starting at a record
+   Arguments: decoded records from the one to check on, how many there are
+   Return: uint8_t -- the fused opcode, or the record's own if it starts
+           no idiom
+*/
+static uint8_t fuseIdiom(const umDecoded * r, uint32_t left){
+    if (r[0].op == NAND){
+        if (left >= 3 && r[0].b == r[0].c && r[1].op == NAND && 
+            r[1].b == r[1].c && r[2].op == NAND && r[2].b == r[0].a && 
+            r[2].c == r[1].a){
+            return OP_OR;
+        }
+        if (left >= 2 && r[1].op == NAND && r[1].b == r[0].a && 
+            r[1].c == r[0].a){
+            return OP_AND;
+        }
+        if (r[0].b == r[0].c){
+            return OP_NOT;
+        }
+    }
+    if (r[0].op == LV && left >= 4 && r[1].op == LV && r[0].a != r[1].a){
+        if (left >= 5 && r[2].op == MUL && r[2].a == r[0].a && 
+            r[2].b == r[0].a && r[2].c == r[1].a && r[3].op == LV && 
+            r[3].a == r[1].a && r[4].op == ADD && r[4].a == r[0].a && 
+            r[4].b == r[0].a && r[4].c == r[1].a){
+            return OP_CONST;
+        }
+        if (r[2].op == CMOV && r[2].a == r[0].a && r[2].b == r[1].a &&
+            r[3].op == LOADP && r[3].c == r[0].a){
+            return OP_BRANCH;
+        }
+    }
+    return r[0].op;
+}
+
+/* Name: fuseProgram
+   Purpose: replaces the first record of each common idiom in a decoded 
+            program by a fused record running the whole idiom in one 
+            dispatch. idioms don't overlap; the records they cover keep 
+            their own opcodes.
+   Arguments: decoded records, how many there are (not counting the end
+              record)
+   Return: void
+*/
+void fuseProgram(umDecoded * code, uint32_t length){
+    assert(code != NULL);
+    uint32_t i = 0;
+    while (i < length){
+        uint8_t op = fuseIdiom(&code[i], length - i);
+        code[i].op = op;
+        i += fusedSpan(op);
+    }
+}
+
+/* Name: getDecoded
+   Purpose: hands back the decoded records of a program segment. they are
+            kept with the segment, so a segment loaded as a program more 
+            than once is only decoded the first time.
+   Arguments: the program segment
+   Return: umDecoded array (freed along with the segment)
+*/
+umDecoded * getDecoded(Segment program){
+    assert(program != NULL);
+
+    segHeader * header = SEG_HEADER(program);
+    if (header->code == NULL){
+        header->code = decodeProgram(program);
+    }
+    return header->code;
+}
+
+/* Name: shareDecoded
+   Purpose: gives a copy of a program the decoded records of the original 
+            instead of decoding it again. the records are only read until
+            the copy is written, when it takes records of its own.
+   Arguments: the program segment (a copy of the one code was decoded 
+              from), decoded records
+   Return: void
+*/
+void shareDecoded(Segment program, umDecoded * code){
+    assert(program != NULL && code != NULL);
+    segHeader * header = SEG_HEADER(program);
+    assert(header->code == NULL);
+    header->code = code;
+    header->flags |= SEG_SHARED_CODE;
+}
+
+/* Name: invalidateDecoded
+   Purpose: marks the record for a word that was overwritten as stale, 
+            along with a fused record covering it. a stale record is 
+            decoded again (unfused) from the segment only if it ever runs.
+            shared records are copied first.
+   Arguments: the program segment, offset of the overwritten word
+   Return: void
+*/
+void invalidateDecoded(Segment program, uint32_t offset){
+    segHeader * header = SEG_HEADER(program);
+    assert(header->code != NULL);
+    if (header->flags & SEG_SHARED_CODE){
+        size_t bytes = ((size_t)header->length + 1) * sizeof(umDecoded);
+        umDecoded * own = malloc(bytes);
+        assert(own != NULL);
+        memcpy(own, header->code, bytes);
+        header->code = own;
+        header->flags &= ~SEG_SHARED_CODE;
+    }
+    umDecoded * code = header->code;
+    code[offset].op = OP_STALE;
+    for (uint32_t back = 1; back < MAX_FUSED && back <= offset; back++){
+        if (fusedSpan(code[offset - back].op) > back){
+            code[offset - back].op = OP_STALE;
+        }
+    }
+}
+
+/* Name: freeDecoded
+   Purpose: frees a decoded program
+   Arguments: decoded program
+   Return: void
+*/
+void freeDecoded(umDecoded * code){
+    free(code);
+}
@@ -0,0 +1,76 @@
+/* Authors: John Little (jlittl04) & Aryan Pandey (apande04)
+ * Date: November 2019
+ * The Universal Machine
+ * File: decode.h - header file for the decode package
+ */
+
+#ifndef DECODE_H
+#define DECODE_H
+
+#include <stdlib.h>
+#include <inttypes.h>
+#include "instructions.h"
+#include "memory.h"
+
+//pseudo opcodes that only ever appear in a decoded record
+#define OP_INVALID 14
+#define OP_STALE 15
+
+/* fused opcodes: the first record of a common idiom runs the whole idiom
+ * (see fuseProgram). the records after it are left as they were, so a 
+ * jump into the middle of an idiom still works.
+ */
+#define OP_NOT 16       /* NAND a b b */
+#define OP_AND 17       /* NAND t x y; NAND d t t */
+#define OP_OR 18        /* NAND t x x; NAND u y y; NAND d t u */
+#define OP_CONST 19     /* LV a x; LV t y; MUL a a t; LV t z; ADD a a t */
+#define OP_BRANCH 20    /* LV a x; LV t y; CMOV a t c; LOADP s a */
+#define FIRST_FUSED OP_NOT
+#define MAX_FUSED 5     /* most words covered by one fused record */
+#define DECODED_OPS 21
+#define DECODE_VERSION 1        /* bump when records or fusing change */
+
+/* one predecoded instruction. op picks the handler in the dispatch loop 
+ * (an opCode or one of the pseudo opcodes above), a, b and c are the 
+ * register IDs (a is A' for LOAD VALUE) and value is its immediate.
+ */
+typedef struct umDecoded {
+        uint8_t op;
+        regID a;
+        regID b;
+        regID c;
+        word value;
+} umDecoded;
+
+/* decoding a single word and a whole program segment */
+void decodeInstruct(umInstruction input, umDecoded * trgt);
+umDecoded * decodeProgram(Segment program);
+void fuseProgram(umDecoded * code, uint32_t length);
+umDecoded * getDecoded(Segment program);
+void shareDecoded(Segment program, umDecoded * code);
+void invalidateDecoded(Segment program, uint32_t offset);
+void freeDecoded(umDecoded * code);
+
+/* Name: fusedSpan
+   Purpose: number of words a decoded record runs (1 unless fused)
+   Arguments: decoded opcode
+   Return: uint32_t
+*/
+static inline uint32_t fusedSpan(uint8_t op){
+    static const uint8_t spans[DECODED_OPS - FIRST_FUSED] = { 1, 2, 3, 5, 4 };
+    return op < FIRST_FUSED ? 1 : spans[op - FIRST_FUSED];
+}
+
+/* Name: baseOp
+   Purpose: the opcode of the first instruction a decoded record runs
+   Arguments: decoded opcode
+   Return: uint8_t
+*/
+static inline uint8_t baseOp(uint8_t op){
+    static const uint8_t bases[DECODED_OPS - FIRST_FUSED] = { 
+        NAND, NAND, NAND, LV, LV 
+    };
+    return op < FIRST_FUSED ? op : bases[op - FIRST_FUSED];
+}
+
+#endif
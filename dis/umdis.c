@@ -0,0 +1,609 @@
+/* Authors: John Little (jlittl04) & Aryan Pandey (apande04)
+ * Date: November 2019
+ * The Universal Machine
+ * File: umdis.c - disassembler and hot loop finder for UM images
+ *
+ * umdis prints a segment -- segment 0 of a .um image, or any segment of a
+ * snapshot (see snapshot.h) -- as assembly, split into basic blocks. the
+ * blocks come from the LOADP targets it can work out: within a block it
+ * follows the registers LV loads and arithmetic on them, so the usual
+ * LV/LOADP jump and the LV/LV/CMOV/LOADP branch give up their one or two
+ * targets. given the counts ./um --profile-out writes, it adds how often
+ * every instruction ran, what each block cost, the LOADP edges the run
+ * took, and a ranking of the loops (backward jumps) by the instructions
+ * run inside them. words the decode module would fuse are marked with the
+ * superinstruction they become.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "instructions.h"
+#include "decode.h"
+#include "loader.h"
+#include "memory.h"
+#include "snapshot.h"
+
+#define DEFAULT_TOP 10
+#define MAX_PASSES 16           /* block splitting passes, at most */
+
+static const char * const opNames[DECODED_OPS] = {
+    "CMOV", "SLOAD", "SSTORE", "ADD", "MUL", "DIV", "NAND", "HALT",
+    "MAP", "UNMAP", "OUT", "IN", "LOADP", "LV", NULL, NULL,
+    "NOT", "AND", "OR", "CONST", "BRANCH"
+};
+
+/* what a block knows of a register: nothing, or one of up to two values */
+typedef struct regValue {
+        int known;              /* how many values: 0, 1 or 2 */
+        word values[2];
+} regValue;
+
+/* what is known of one LOADP */
+typedef struct jump {
+        int kind;               /* JUMP_* */
+        int targets;
+        uint32_t target[2];
+        uint64_t taken;         /* profiled edges into this segment */
+} jump;
+
+#define JUMP_UNKNOWN 0          /* segment or target not worked out */
+#define JUMP_LOCAL 1            /* into this segment, targets known */
+#define JUMP_LOAD 2             /* loads another segment as the program */
+
+typedef struct disasm {
+        Segment seg;
+        uint32_t length;
+        umSegmentID id;
+        uint8_t * leader;       /* 1 if a block starts at the pc */
+        uint8_t * fused;        /* fused opcode starting at the pc, or 0 */
+        jump * jumps;           /* per pc, for LOADPs */
+        uint64_t * counts;      /* per pc, or NULL without a profile */
+        uint64_t total;
+        uint32_t entry;         /* pc the machine starts (or stopped) at */
+        word initial[REG_COUNT];        /* registers at the entry */
+        regValue fixed[REG_COUNT];      /* what every block may assume */
+} disasm;
+
+/* Name: usage
+   Purpose: prints the proper usage of umdis and exits
+   Arguments: none
+   Return: does not return
+*/
+static void usage(void){
+    fprintf(stderr, "USAGE ERROR | Proper Usage: ./umdis [--counts file] "
+                    "[--top n] [--hot]\n       image.um | --snapshot file "
+                    "[--segment id]\n");
+    exit(EXIT_FAILURE);
+}
+
+/* Name: endsBlock
+   Purpose: tells whether an opcode runs off the end of its block
+   Arguments: opcode
+   Return: int -- 1 if it ends a block, else 0
+*/
+static int endsBlock(opCode code){
+    return code == LOADP || code == HALT || code > LV;
+}
+
+/* Name: setValue
+   Purpose: records a single known value for a register
+   Arguments: register state, value
+   Return: void
+*/
+static void setValue(regValue * r, word value){
+    r->known = 1;
+    r->values[0] = value;
+}
+
+/* Name: step
+   Purpose: follows what one instruction does to the known registers
+   Arguments: registers, instruction
+   Return: void
+*/
+static void step(regValue regs[], umInstruction input){
+    opCode code = getOpCode(input);
+    regID a = getRegA(input), b = getRegB(input), c = getRegC(input);
+    regValue * ra = &regs[a];
+    int both = regs[b].known == 1 && regs[c].known == 1;
+    word x = regs[b].values[0], y = regs[c].values[0];
+    switch (code){
+        case LV:
+            setValue(&regs[getRegAprime(input)], getValue(input));
+            break;
+        case ADD:
+            both ? setValue(ra, x + y) : (void)(ra->known = 0);
+            break;
+        case MUL:
+            both ? setValue(ra, x * y) : (void)(ra->known = 0);
+            break;
+        case DIV:
+            both && y != 0 ? setValue(ra, x / y) : (void)(ra->known = 0);
+            break;
+        case NAND:
+            both ? setValue(ra, ~(x & y)) : (void)(ra->known = 0);
+            break;
+        case CMOV:
+            if (regs[c].known == 1){
+                if (y != 0){
+                    *ra = regs[b];
+                }
+            }
+            else if (ra->known == 1 && regs[b].known == 1){
+                ra->values[1] = x;
+                ra->known = 2;
+            }
+            else {
+                ra->known = 0;
+            }
+            break;
+        case SLOAD:
+            ra->known = 0;
+            break;
+        case MAP:
+            regs[b].known = 0;
+            break;
+        case IN:
+            regs[c].known = 0;
+            break;
+        default:
+            break;
+    }
+}
+
+/* Name: written
+   Purpose: finds the register an instruction writes
+   Arguments: instruction
+   Return: int -- the register, or -1 if it writes none
+*/
+static int written(umInstruction input){
+    switch (getOpCode(input)){
+        case CMOV: case SLOAD: case ADD: case MUL: case DIV: case NAND:
+            return getRegA(input);
+        case LV:
+            return getRegAprime(input);
+        case MAP:
+            return getRegB(input);
+        case IN:
+            return getRegC(input);
+        default:
+            return -1;
+    }
+}
+
+/* Name: findFixed
+   Purpose: finds the registers every block may take as known: those the
+            segment never writes, which keep their entry value, and those
+            it only ever loads one value into with LV, such as the zero
+            most programs keep for LOADP's segment
+   Arguments: disassembly
+   Return: void
+*/
+static void findFixed(disasm * d){
+    int loaded[REG_COUNT] = { 0 };
+    for (int r = 0; r < REG_COUNT; r++){
+        setValue(&d->fixed[r], d->initial[r]);
+    }
+    for (uint32_t pc = 0; pc < d->length; pc++){
+        umInstruction input = d->seg[pc];
+        int r = written(input);
+        if (r < 0){
+            continue;
+        }
+        if (getOpCode(input) == LV &&
+            (!loaded[r] || d->fixed[r].values[0] == getValue(input))){
+            setValue(&d->fixed[r], getValue(input));
+            loaded[r] = 1;
+        }
+        else {
+            d->fixed[r].known = 0;
+            loaded[r] = 1;
+        }
+    }
+}
+
+/* Name: findJump
+   Purpose: works out where a LOADP goes from what its block knows
+   Arguments: disassembly, registers at the LOADP, the LOADP
+   Return: jump
+*/
+static jump findJump(disasm * d, regValue regs[], umInstruction input){
+    jump j = { JUMP_UNKNOWN, 0, { 0, 0 }, 0 };
+    regValue * seg = &regs[getRegB(input)];
+    regValue * pc = &regs[getRegC(input)];
+    if (seg->known != 1){
+        return j;
+    }
+    if (seg->values[0] != d->id){
+        j.kind = JUMP_LOAD;
+        return j;
+    }
+    j.kind = JUMP_LOCAL;
+    for (int i = 0; i < pc->known; i++){
+        if (pc->values[i] < d->length &&
+            (j.targets == 0 || j.target[0] != pc->values[i])){
+            j.target[j.targets++] = pc->values[i];
+        }
+    }
+    if (j.targets == 0){
+        j.kind = JUMP_UNKNOWN;
+    }
+    return j;
+}
+
+/* Name: findBlocks
+   Purpose: finds the block leaders: the first word, the word after each
+            block-ending instruction and every LOADP target worked out. a
+            block starts from the fixed registers (the entry block from the
+            entry registers). a new target can split a block and with it
+            what the block knew, so it goes round until no new leader
+            turns up.
+   Arguments: disassembly
+   Return: void
+*/
+static void findBlocks(disasm * d){
+    d->leader[0] = 1;
+    if (d->entry < d->length){
+        d->leader[d->entry] = 1;
+    }
+    for (int pass = 0, changed = 1; changed && pass < MAX_PASSES; pass++){
+        changed = 0;
+        regValue regs[REG_COUNT];
+        for (uint32_t pc = 0; pc < d->length; pc++){
+            if (pc == d->entry){
+                for (int r = 0; r < REG_COUNT; r++){
+                    setValue(&regs[r], d->initial[r]);
+                }
+            }
+            else if (d->leader[pc]){
+                memcpy(regs, d->fixed, sizeof(regs));
+            }
+            umInstruction input = d->seg[pc];
+            opCode code = getOpCode(input);
+            if (code == LOADP){
+                jump j = findJump(d, regs, input);
+                j.taken = d->jumps[pc].taken;
+                d->jumps[pc] = j;
+                for (int i = 0; i < j.targets; i++){
+                    changed |= !d->leader[j.target[i]];
+                    d->leader[j.target[i]] = 1;
+                }
+            }
+            else if (code <= LV){
+                step(regs, input);
+            }
+            if (endsBlock(code) && pc + 1 < d->length){
+                d->leader[pc + 1] = 1;
+            }
+        }
+    }
+}
+
+/* Name: readCounts
+   Purpose: reads the per-pc counts and LOADP edges of a profile dump
+            (./um --profile-out), marking the edges' targets as leaders
+   Arguments: disassembly, path of the dump
+   Return: void
+*/
+static void readCounts(disasm * d, const char * path){
+    FILE * fp = fopen(path, "r");
+    if (fp == NULL){
+        fprintf(stderr, "umdis: cannot read %s: %s\n", path,
+                strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    d->counts = calloc(d->length + 1, sizeof(*d->counts));
+    assert(d->counts != NULL);
+    char line[128];
+    while (fgets(line, sizeof(line), fp) != NULL){
+        uint32_t pc, seg, to;
+        uint64_t count;
+        if (sscanf(line, "pc %" SCNu32 " %" SCNu64, &pc, &count) == 2){
+            if (pc < d->length){
+                d->counts[pc] = count;
+                d->total += count;
+            }
+        }
+        else if (sscanf(line, "edge %" SCNu32 " %" SCNu32 " %" SCNu32 " %"
+                        SCNu64, &pc, &seg, &to, &count) == 4){
+            if (pc < d->length && seg == d->id && to < d->length){
+                d->jumps[pc].taken += count;
+                d->leader[to] = 1;
+            }
+        }
+    }
+    fclose(fp);
+}
+
+/* Name: printInstruct
+   Purpose: prints one instruction as assembly
+   Arguments: stream, instruction
+   Return: int -- characters printed
+*/
+static int printInstruct(FILE * fp, umInstruction input){
+    opCode code = getOpCode(input);
+    regID a = getRegA(input), b = getRegB(input), c = getRegC(input);
+    switch (code){
+        case HALT:
+            return fprintf(fp, "HALT");
+        case MAP:
+            return fprintf(fp, "%-6s r%d, r%d", opNames[code], b, c);
+        case UNMAP: case OUT: case IN:
+            return fprintf(fp, "%-6s r%d", opNames[code], c);
+        case LOADP:
+            return fprintf(fp, "%-6s r%d, r%d", opNames[code], b, c);
+        case LV:
+            return fprintf(fp, "%-6s r%d, %" PRIu32, opNames[code],
+                           getRegAprime(input), getValue(input));
+        default:
+            if (code > LV){
+                return fprintf(fp, ".word  0x%08" PRIx32, input);
+            }
+            return fprintf(fp, "%-6s r%d, r%d, r%d", opNames[code], a, b, c);
+    }
+}
+
+/* Name: blockEnd
+   Purpose: finds the last word of the block starting at a pc
+   Arguments: disassembly, leader pc
+   Return: uint32_t
+*/
+static uint32_t blockEnd(disasm * d, uint32_t start){
+    uint32_t end = start;
+    while (end + 1 < d->length && !d->leader[end + 1]){
+        end++;
+    }
+    return end;
+}
+
+/* Name: rangeCost
+   Purpose: adds up the instructions run over a range of pcs
+   Arguments: disassembly, first pc, last pc
+   Return: uint64_t
+*/
+static uint64_t rangeCost(disasm * d, uint32_t first, uint32_t last){
+    uint64_t cost = 0;
+    for (uint32_t pc = first; pc <= last; pc++){
+        cost += d->counts[pc];
+    }
+    return cost;
+}
+
+static double percent(uint64_t part, uint64_t whole){
+    return whole ? 100.0 * part / whole : 0.0;
+}
+
+typedef struct loop {
+        uint32_t head;          /* target of the backward jump */
+        uint32_t tail;          /* last word of the jumping block */
+        uint64_t cost;
+        uint64_t iterations;
+} loop;
+
+static int byCost(const void * a, const void * b){
+    uint64_t x = ((const loop *)a)->cost, y = ((const loop *)b)->cost;
+    return (x < y) - (x > y);
+}
+
+/* Name: printLoops
+   Purpose: lists the loops -- ranges from a LOADP target back to a block
+            jumping there -- hottest first if there are counts
+   Arguments: disassembly, stream, how many to list
+   Return: void
+*/
+static void printLoops(disasm * d, FILE * fp, uint32_t top){
+    loop * loops = NULL;
+    uint32_t count = 0;
+    for (uint32_t pc = 0; pc < d->length; pc++){
+        jump * j = &d->jumps[pc];
+        for (int i = 0; i < j->targets; i++){
+            if (j->target[i] > pc){
+                continue;
+            }
+            loops = realloc(loops, (count + 1) * sizeof(*loops));
+            assert(loops != NULL);
+            loop * l = &loops[count++];
+            l->head = j->target[i];
+            l->tail = pc;
+            l->cost = d->counts ? rangeCost(d, l->head, l->tail) : 0;
+            l->iterations = d->counts ? d->counts[l->head] : 0;
+        }
+    }
+    if (d->counts != NULL){
+        qsort(loops, count, sizeof(*loops), byCost);
+    }
+    fprintf(fp, "; %" PRIu32 " loop%s", count, count == 1 ? "" : "s");
+    fprintf(fp, d->counts ? ", hottest first:\n" : ":\n");
+    for (uint32_t i = 0; i < count && i < top; i++){
+        loop * l = &loops[i];
+        fprintf(fp, ";   pc %6" PRIu32 " - %-6" PRIu32 " %6" PRIu32
+                " words", l->head, l->tail, l->tail - l->head + 1);
+        if (d->counts != NULL){
+            fprintf(fp, "  %14" PRIu64 " run %6.2f%%  %12" PRIu64
+                    " iterations  %8.1f each", l->cost,
+                    percent(l->cost, d->total), l->iterations,
+                    l->iterations ? (double)l->cost / l->iterations : 0.0);
+        }
+        fprintf(fp, "\n");
+    }
+    free(loops);
+}
+
+/* Name: printBlocks
+   Purpose: prints every block (or only those that ran, if asked) with its
+            instructions, their counts, what each LOADP was found to do and
+            the fused records
+   Arguments: disassembly, stream, 1 to print only blocks that ran
+   Return: void
+*/
+static void printBlocks(disasm * d, FILE * fp, int hotOnly){
+    for (uint32_t start = 0; start < d->length; ){
+        uint32_t end = blockEnd(d, start);
+        uint64_t cost = d->counts ? rangeCost(d, start, end) : 0;
+        if (hotOnly && cost == 0){
+            start = end + 1;
+            continue;
+        }
+        fprintf(fp, "\nblock %" PRIu32 "-%" PRIu32, start, end);
+        if (start == d->entry){
+            fprintf(fp, "  ; %s", d->entry == 0 ? "entry" : "snapshot pc");
+        }
+        if (d->counts != NULL){
+            fprintf(fp, "  ; %" PRIu64 " runs, %" PRIu64 " instructions "
+                    "(%.2f%%)", d->counts[start], cost,
+                    percent(cost, d->total));
+        }
+        fprintf(fp, "\n");
+
+        for (uint32_t pc = start; pc <= end; pc++){
+            umInstruction input = d->seg[pc];
+            fprintf(fp, "  %8" PRIu32 "  %08" PRIx32 "  ", pc, input);
+            int width = printInstruct(fp, input);
+            if (d->counts != NULL || d->fused[pc] ||
+                getOpCode(input) == LOADP){
+                fprintf(fp, "%*s", width < 24 ? 24 - width : 1, "");
+            }
+            if (d->counts != NULL){
+                fprintf(fp, " %14" PRIu64, d->counts[pc]);
+            }
+            jump * j = &d->jumps[pc];
+            if (getOpCode(input) == LOADP){
+                if (j->kind == JUMP_LOCAL){
+                    fprintf(fp, "  ; -> %" PRIu32, j->target[0]);
+                    if (j->targets == 2){
+                        fprintf(fp, ", %" PRIu32, j->target[1]);
+                    }
+                }
+                else {
+                    fprintf(fp, j->kind == JUMP_LOAD ? "  ; loads a segment"
+                                                     : "  ; -> ?");
+                }
+                if (j->taken){
+                    fprintf(fp, " (taken %" PRIu64 ")", j->taken);
+                }
+            }
+            if (d->fused[pc]){
+                fprintf(fp, "  ; fused %s (%" PRIu32 " word%s)",
+                        opNames[d->fused[pc]], fusedSpan(d->fused[pc]),
+                        fusedSpan(d->fused[pc]) == 1 ? "" : "s");
+            }
+            fprintf(fp, "\n");
+        }
+        start = end + 1;
+    }
+}
+
+/* Name: loadSnapshotSegment
+   Purpose: gets a segment out of the newest checkpoint in a snapshot
+   Arguments: disassembly to fill in, snapshot path, segment ID
+   Return: void
+*/
+static void loadSnapshotSegment(disasm * d, const char * path,
+                                umSegmentID id){
+    segTable * memory = newTable();
+    uint64_t end;
+    uint32_t pc = restoreSnapshot(path, memory, d->initial, 1, &end);
+    if (id >= memory->count || memory->slots[id].sgmnt == NULL){
+        fprintf(stderr, "umdis: segment %" PRIu32 " is not mapped in %s\n",
+                id, path);
+        exit(EXIT_FAILURE);
+    }
+    d->seg = copySegment(getSegment(memory, id));
+    d->entry = id == 0 ? pc : UINT32_MAX;
+    halt(memory);
+}
+
+int main(int argc, char * argv[]){
+    const char * image = NULL;
+    const char * snapshot = NULL;
+    const char * counts = NULL;
+    umSegmentID id = 0;
+    uint32_t top = DEFAULT_TOP;
+    int hotOnly = 0;
+    for (int i = 1; i < argc; i++){
+        if (strcmp(argv[i], "--counts") == 0 && i + 1 < argc){
+            counts = argv[++i];
+        }
+        else if (strcmp(argv[i], "--top") == 0 && i + 1 < argc){
+            top = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--hot") == 0){
+            hotOnly = 1;
+        }
+        else if (strcmp(argv[i], "--snapshot") == 0 && i + 1 < argc){
+            snapshot = argv[++i];
+        }
+        else if (strcmp(argv[i], "--segment") == 0 && i + 1 < argc){
+            id = (umSegmentID)strtoul(argv[++i], NULL, 10);
+        }
+        else if (image == NULL && (argv[i][0] != '-' || argv[i][1] == '\0')){
+            image = argv[i];
+        }
+        else {
+            usage();
+        }
+    }
+    if ((image == NULL) == (snapshot == NULL) || (image && id != 0) ||
+        (hotOnly && counts == NULL)){
+        usage();
+    }
+    if (counts != NULL && id != 0){
+        fprintf(stderr, "umdis: profile counts are for segment 0 only\n");
+        return EXIT_FAILURE;
+    }
+
+    disasm d = { 0 };
+    d.id = id;
+    if (snapshot != NULL){
+        loadSnapshotSegment(&d, snapshot, id);
+    }
+    else {
+        d.seg = loadImage(image);
+        d.entry = 0;
+    }
+    d.length = segLength(d.seg);
+    d.leader = calloc(d.length + 1, 1);
+    d.fused = calloc(d.length + 1, 1);
+    d.jumps = calloc(d.length + 1, sizeof(*d.jumps));
+    assert(d.leader != NULL && d.fused != NULL && d.jumps != NULL);
+
+    /* the decode module's records say which words it would fuse */
+    umDecoded * code = decodeProgram(d.seg);
+    for (uint32_t pc = 0; pc < d.length; pc++){
+        d.fused[pc] = code[pc].op >= FIRST_FUSED ? code[pc].op : 0;
+    }
+    freeDecoded(code);
+
+    if (counts != NULL){
+        readCounts(&d, counts);
+    }
+    findFixed(&d);
+    findBlocks(&d);
+
+    uint32_t blocks = 0, known = 0, loadps = 0;
+    for (uint32_t pc = 0; pc < d.length; pc++){
+        blocks += d.leader[pc];
+        if (getOpCode(d.seg[pc]) == LOADP){
+            loadps++;
+            known += d.jumps[pc].kind != JUMP_UNKNOWN;
+        }
+    }
+    printf("; %s, segment %" PRIu32 ": %" PRIu32 " words, %" PRIu32
+           " blocks, %" PRIu32 " of %" PRIu32 " LOADPs worked out\n",
+           image ? image : snapshot, id, d.length, blocks, known, loadps);
+    if (counts != NULL){
+        printf("; %" PRIu64 " instructions counted in %s\n", d.total,
+               counts);
+    }
+    printLoops(&d, stdout, top);
+    printBlocks(&d, stdout, hotOnly);
+
+    deallocate(d.seg);
+    free(d.leader);
+    free(d.fused);
+    free(d.jumps);
+    free(d.counts);
+    return EXIT_SUCCESS;
+}
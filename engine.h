@@ -0,0 +1,401 @@
+/* Authors: John Little (jlittl04) & Aryan Pandey (apande04)
+ * Date: November 2019
+ * The Universal Machine
+ * File: engine.h - the UM's dispatch loop, as a template
+ *
+ * libum.c includes this file once per engine it builds, defining 
+ * ENGINE_NAME (the function to define), ENGINE_PROFILE, ENGINE_CHECKED,
+ * ENGINE_COUNT and ENGINE_BUDGET first. the plain engine (all 0) has no 
+ * instrumentation, no checks and no instruction budget at all, and is the
+ * only one to use the JIT; the budgeted engine (ENGINE_BUDGET 1) stops once
+ * it has run the instructions it was given; the counting engine 
+ * (ENGINE_COUNT 1) also counts instructions by opcode for telemetry (see 
+ * telemetry.h); the profiling engine (ENGINE_PROFILE 1) counts every step
+ * and LOADP into a umProfile instead; the checked engine 
+ * (ENGINE_CHECKED 1) also looks for every way a UM program can fail before
+ * each instruction that could (see fault.h), where the others only catch
+ * invalid loads and stores, through the guard page. engines that count run
+ * fused records one instruction at a time, so their counts are exact.
+ * there is deliberately no include guard.
+ */
+
+#if !defined(ENGINE_NAME) || !defined(ENGINE_PROFILE) || \
+    !defined(ENGINE_CHECKED) || !defined(ENGINE_COUNT) || \
+    !defined(ENGINE_BUDGET)
+#error "define ENGINE_NAME, ENGINE_PROFILE, ENGINE_CHECKED, ENGINE_COUNT \
+and ENGINE_BUDGET"
+#endif
+#if (ENGINE_PROFILE || ENGINE_CHECKED || ENGINE_COUNT) && !ENGINE_BUDGET
+#error "the profiling, checked and counting engines count a budget"
+#endif
+#define ENGINE_UNFUSED ENGINE_BUDGET
+
+/* the dispatch loop is threaded (a computed goto through a table of labels, 
+ * one per opcode) wherever the compiler supports labels as values. building
+ * with -DUM_SWITCH_DISPATCH selects the portable switch loop instead.
+ */
+#if defined(__GNUC__) && !defined(UM_SWITCH_DISPATCH)
+#define UM_THREADED 1
+#else
+#define UM_THREADED 0
+#endif
+
+#if ENGINE_PROFILE
+#define PROFILE_STEP() profileStep(m->prof, baseOp(ins->op), prgmPtr - 1)
+#define PROFILE_REDECODE() do {                          \
+        m->prof->ops[ins->op]++;                         \
+        m->prof->pcOps[prgmPtr - 1] = ins->op;           \
+    } while (0)
+#define PROFILE_EDGE() profileEdge(m->prof, prgmPtr - 1,                  \
+                                   registers[ins->b], registers[ins->c])
+#else
+#define PROFILE_STEP() ((void)0)
+#define PROFILE_REDECODE() ((void)0)
+#define PROFILE_EDGE() ((void)0)
+#endif
+
+/* counts are by decoded opcode: the telemetry folds fused ones into their
+ * first instruction's when it publishes them. an IN that may have to wait
+ * for input publishes first, so a monitor sees the machine waiting rather
+ * than stalled.
+ */
+#if ENGINE_COUNT
+#define COUNT_STEP() (opCounts[ins->op]++)
+#define COUNT_REDECODE() (opCounts[OP_STALE]--, opCounts[ins->op]++)
+#define COUNT_REFUND() (opCounts[IN]--)
+#define COUNT_WAIT() do {                                \
+        if (!ioReady(io)){                               \
+            telemetryPublish(m->tele, m, UM_BLOCKED);    \
+        }                                                \
+    } while (0)
+#else
+#define COUNT_STEP() ((void)0)
+#define COUNT_REDECODE() ((void)0)
+#define COUNT_REFUND() ((void)0)
+#define COUNT_WAIT() ((void)0)
+#endif
+
+/* leaving the engine: the machine keeps the pc to carry on from */
+#define LEAVE(status, at) do {                                           \
+        m->pc = (at);                                                    \
+        m->budget = budget;                                              \
+        return (status);                                                 \
+    } while (0)
+
+#if ENGINE_BUDGET
+#define BUDGET_STEP() do {                                               \
+        if (budget == 0){                                                \
+            LEAVE(UM_BUDGET, prgmPtr);                                   \
+        }                                                                \
+        budget--;                                                        \
+    } while (0)
+#define BUDGET_REFUND() (budget++)
+#define BUDGET_NOTE() (m->budget = budget)
+#else
+#define BUDGET_STEP() ((void)0)
+#define BUDGET_REFUND() ((void)0)
+#define BUDGET_NOTE() ((void)0)
+#endif
+
+#if ENGINE_CHECKED
+#define CHECK(ok, kind, seg, offset) do {                                \
+        if (!(ok)){                                                      \
+            umFaultInfo found = { kind, prgmPtr - 1, seg, offset };      \
+            m->fault = found;                                            \
+            LEAVE(UM_FAULT, prgmPtr - 1);                                \
+        }                                                                \
+    } while (0)
+#define CHECK_ACCESS(seg, offset) do {                                   \
+        CHECK(segMapped(memory, seg), FAULT_UNMAPPED, seg, offset);      \
+        CHECK((offset) < memory->slots[seg].length,                      \
+              FAULT_BOUNDS, seg, offset);                                \
+    } while (0)
+#else
+#define CHECK(ok, kind, seg, offset) ((void)0)
+#define CHECK_ACCESS(seg, offset) ((void)0)
+#endif
+
+/* the checked engine has checked a load or store by the time it makes it;
+ * the others note its pc (and what is left of the budget, which LEAVE 
+ * never gets to store if it traps) and go through the guard (see 
+ * fault.h). the signal fence keeps the compiler from moving the access, 
+ * or any register store, across the note.
+ */
+#if ENGINE_CHECKED
+#define GUARD_AT() ((void)0)
+#define GUARD_LOAD(seg, offset) getWordat(seg, offset, memory)
+#define GUARD_PROBE(seg, offset) ((void)0)
+#else
+#define GUARD_AT() do {                                                  \
+        m->trapPc = prgmPtr - 1;                                         \
+        BUDGET_NOTE();                                                   \
+        __atomic_signal_fence(__ATOMIC_SEQ_CST);                         \
+    } while (0)
+#define GUARD_LOAD(seg, offset) (*guardedWord(memory, seg, offset))
+#define GUARD_PROBE(seg, offset)                                         \
+        ((void)*(volatile word *)guardedWord(memory, seg, offset))
+#endif
+
+/* Name: ENGINE_NAME (umRun picks the engine)
+   Purpose: runs the program in Segment 0. the segment is decoded once into
+            an array of records (opcode and register IDs already unpacked),
+            and each step executes a record -- either by jumping straight 
+            to the handler for its opcode (threaded) or through a switch 
+            case (portable). stores into Segment 0 mark the record for that
+            word stale and loading a new program uses its records. If 
+            operation is invalid, halts. The program pointer lives in a 
+            local for the whole run. when the machine has a JIT, every 
+            LOADP into segment 0 hands over to it, and it runs compiled 
+            code for as long as it can. with a snapshot, a checkpoint is 
+            taken at the first IN and each time the machine is about to 
+            wait for input. the checked engine stops at the first fault 
+            (see fault.h).
+   Arguments: the machine (its pc, and budget for engines that count one)
+   Return: umStatus -- why the run ended. the machine's pc is left at the
+           instruction to run next (the HALT, IN or faulting instruction
+           itself for UM_HALTED, UM_BLOCKED and UM_FAULT)
+*/
+static umStatus ENGINE_NAME(umMachine * m){
+    assert(m != NULL && m->memory != NULL && m->io != NULL);
+    assert(!ENGINE_PROFILE || m->prof != NULL);
+    assert(!ENGINE_COUNT || m->tele != NULL);
+
+    /* declare basic variables */
+    segTable * memory = m->memory;
+    word * registers = m->registers;
+    umIO * io = m->io;
+    umSnapshot * snap = m->snap;
+    uint32_t prgmPtr = m->pc;
+    uint64_t budget = m->budget;
+    Segment zero = getSegment(memory, 0);
+    umDecoded * code = getDecoded(zero);
+    umDecoded * ins = NULL;
+    umJit * jit = ENGINE_BUDGET ? NULL : m->jit;
+    umJitContext ctx = { registers, memory, jit };
+#if ENGINE_COUNT
+    uint64_t * opCounts = m->tele->ops;
+#endif
+    (void)budget;
+
+#if UM_THREADED
+    static const void * const dispatch[DECODED_OPS] = {
+        &&op_CMOV, &&op_SLOAD, &&op_SSTORE, &&op_ADD, &&op_MUL, &&op_DIV,
+        &&op_NAND, &&op_HALT, &&op_MAP, &&op_UNMAP, &&op_OUT, &&op_IN,
+        &&op_LOADP, &&op_LV, &&op_OP_INVALID, &&op_OP_STALE,
+#if ENGINE_UNFUSED
+        /* fused records run one instruction at a time when counting */
+        &&op_NAND, &&op_NAND, &&op_NAND, &&op_LV, &&op_LV
+#else
+        &&op_OP_NOT, &&op_OP_AND, &&op_OP_OR, &&op_OP_CONST, &&op_OP_BRANCH
+#endif
+    };
+#define OPERATION(code) op_##code:
+#define REDISPATCH() goto *dispatch[ins->op]
+#define DISPATCH() do {                                  \
+        BUDGET_STEP();                                   \
+        ins = &code[prgmPtr++];                          \
+        PROFILE_STEP();                                  \
+        COUNT_STEP();                                    \
+        REDISPATCH();                                    \
+    } while (0)
+
+    DISPATCH();
+#else
+#define OPERATION(code) case code:
+#define REDISPATCH() goto redispatch
+#define DISPATCH() break
+
+    for (;;){
+        BUDGET_STEP();
+        ins = &code[prgmPtr++];
+        PROFILE_STEP();
+        COUNT_STEP();
+redispatch:
+        switch(ENGINE_UNFUSED ? baseOp(ins->op) : ins->op){
+#endif
+    OPERATION(CMOV)
+        if (registers[ins->c] != 0){
+            registers[ins->a] = registers[ins->b];
+        }
+        DISPATCH();
+
+    OPERATION(SLOAD)
+        CHECK_ACCESS(registers[ins->b], registers[ins->c]);
+        GUARD_AT();
+        registers[ins->a] = GUARD_LOAD(registers[ins->b], registers[ins->c]);
+        DISPATCH();
+
+    OPERATION(SSTORE)
+        CHECK_ACCESS(registers[ins->a], registers[ins->b]);
+        GUARD_AT();
+        GUARD_PROBE(registers[ins->a], registers[ins->b]);
+        editWord(memory, registers[ins->a], registers[ins->b],
+                 registers[ins->c]);
+        if (registers[ins->a] == 0){
+            /* segment 0 may have just taken records of its own */
+            code = SEG_HEADER(zero)->code;
+            jitWordChanged(jit, registers[ins->b]);
+        }
+        DISPATCH();
+
+    OPERATION(ADD)
+        registers[ins->a] = registers[ins->b] + registers[ins->c];
+        DISPATCH();
+
+    OPERATION(MUL)
+        registers[ins->a] = registers[ins->b] * registers[ins->c];
+        DISPATCH();
+
+    OPERATION(DIV)
+        CHECK(registers[ins->c] != 0, FAULT_DIV_ZERO, 0, 0);
+        registers[ins->a] = registers[ins->b] / registers[ins->c];
+        DISPATCH();
+
+    OPERATION(NAND)
+        registers[ins->a] = ~(registers[ins->b] & registers[ins->c]);
+        DISPATCH();
+
+    OPERATION(HALT)
+        LEAVE(UM_HALTED, prgmPtr - 1);
+
+    OPERATION(MAP)
+        mapSeg(registers, ins->c, ins->b, memory);
+        DISPATCH();
+
+    OPERATION(UNMAP)
+        CHECK(registers[ins->c] != 0, FAULT_UNMAP_ZERO, 0, 0);
+        CHECK(segMapped(memory, registers[ins->c]), FAULT_UNMAPPED, 
+              registers[ins->c], 0);
+        unmapSeg(registers, ins->c, memory); 
+        DISPATCH();
+
+    OPERATION(OUT)
+        CHECK(registers[ins->c] <= 255, FAULT_OUTPUT, 0, 0);
+        out(io, registers, ins->c);
+        DISPATCH();
+
+    OPERATION(IN)
+        /* resuming from here re-executes the IN */
+        if (snap != NULL && checkpointDue(snap, !ioReady(io))){
+            takeCheckpoint(snap, memory, registers, prgmPtr - 1);
+        }
+        COUNT_WAIT();
+        if (!in(io, registers, ins->c)){
+            BUDGET_REFUND();    /* it runs again once input arrives */
+            COUNT_REFUND();
+            LEAVE(UM_BLOCKED, prgmPtr - 1);
+        }
+        DISPATCH();
+
+    OPERATION(LOADP)
+        PROFILE_EDGE();
+        CHECK(segMapped(memory, registers[ins->b]), FAULT_UNMAPPED, 
+              registers[ins->b], 0);
+        CHECK(registers[ins->c] < memory->slots[registers[ins->b]].length,
+              FAULT_PC, registers[ins->b], registers[ins->c]);
+        /* segment 0 only changes when a different segment is loaded */
+        if (registers[ins->b] != 0){
+            loadProgram(registers, ins->b, ins->c, memory, &prgmPtr);
+            zero = getSegment(memory, 0);
+            code = getDecoded(zero);
+            jitReset(jit, segLength(zero));
+        }
+        else {
+            prgmPtr = registers[ins->c];
+            if (jit != NULL){
+                prgmPtr = jitRun(jit, &ctx, prgmPtr);
+                code = SEG_HEADER(zero)->code;
+            }
+        }
+        DISPATCH();
+
+    OPERATION(LV)
+        registers[ins->a] = ins->value;
+        DISPATCH();
+
+#if !ENGINE_UNFUSED
+    /* fused idioms (see decode.h). each runs its instructions in order 
+     * from the records it covers, then skips them
+     */
+    OPERATION(OP_NOT)
+        registers[ins->a] = ~registers[ins->b];
+        DISPATCH();
+
+    OPERATION(OP_AND)
+        registers[ins->a] = ~(registers[ins->b] & registers[ins->c]);
+        registers[ins[1].a] = ~registers[ins->a];
+        prgmPtr += 1;
+        DISPATCH();
+
+    OPERATION(OP_OR)
+        registers[ins->a] = ~registers[ins->b];
+        registers[ins[1].a] = ~registers[ins[1].b];
+        registers[ins[2].a] = ~(registers[ins[2].b] & registers[ins[2].c]);
+        prgmPtr += 2;
+        DISPATCH();
+
+    OPERATION(OP_CONST)
+        registers[ins[3].a] = ins[3].value;
+        registers[ins->a] = ins->value * ins[1].value + ins[3].value;
+        prgmPtr += 4;
+        DISPATCH();
+
+    OPERATION(OP_BRANCH)
+        registers[ins->a] = ins->value;
+        registers[ins[1].a] = ins[1].value;
+        if (registers[ins[2].c] != 0){
+            registers[ins->a] = ins[1].value;
+        }
+        /* the LOADP itself runs as usual */
+        ins += 3;
+        prgmPtr += 3;
+        REDISPATCH();
+#endif
+
+    OPERATION(OP_STALE)
+        /* the word was overwritten since it was decoded */
+        decodeInstruct(zero[prgmPtr - 1], ins);
+        PROFILE_REDECODE();
+        COUNT_REDECODE();
+        REDISPATCH();
+
+    OPERATION(OP_INVALID)
+        /* the end record past the program is where running off it lands */
+        CHECK(prgmPtr - 1 < segLength(zero), FAULT_PC, 0, prgmPtr - 1);
+        CHECK(0, FAULT_OPCODE, 0, 0);
+
+        /* if OP code is invalid, halt the machine */
+        LEAVE(UM_HALTED, prgmPtr - 1);
+#if !UM_THREADED
+        }
+    }
+#endif
+
+#undef OPERATION
+#undef REDISPATCH
+#undef DISPATCH
+}
+
+#undef LEAVE
+#undef BUDGET_STEP
+#undef BUDGET_REFUND
+#undef BUDGET_NOTE
+#undef PROFILE_STEP
+#undef PROFILE_REDECODE
+#undef PROFILE_EDGE
+#undef COUNT_STEP
+#undef COUNT_REDECODE
+#undef COUNT_REFUND
+#undef COUNT_WAIT
+#undef GUARD_AT
+#undef GUARD_LOAD
+#undef GUARD_PROBE
+#undef CHECK
+#undef CHECK_ACCESS
+#undef UM_THREADED
+#undef ENGINE_NAME
+#undef ENGINE_PROFILE
+#undef ENGINE_CHECKED
+#undef ENGINE_COUNT
+#undef ENGINE_BUDGET
+#undef ENGINE_UNFUSED
@@ -0,0 +1,182 @@
+/* Authors: John Little (jlittl04) & Aryan Pandey (apande04)
+ * Date: November 2019
+ * The Universal Machine
+ * File: fault.c - implementation for machine fault reports
+ */
+
+#include "fault.h"
+#include "instructions.h"
+#include <assert.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+static const char * const faultNames[] = {
+    "unmapped segment", "offset out of bounds", "division by zero",
+    "unmap of segment 0", "output value over 255", "invalid opcode",
+    "program pointer out of bounds"
+};
+
+static const char * const opNames[] = {
+    "CMOV", "SLOAD", "SSTORE", "ADD", "MUL", "DIV", "NAND", "HALT",
+    "MAP", "UNMAP", "OUT", "IN", "LOADP", "LV", "opcode 14", "opcode 15"
+};
+
+/* Name: segMapped
+   Purpose: tells whether a segment ID is mapped
+   Arguments: segment table, segment ID
+   Return: int -- 1 if so, else 0
+*/
+int segMapped(segTable * memory, umSegmentID id){
+    assert(memory != NULL);
+    return id < memory->count && memory->slots[id].sgmnt != NULL;
+}
+
+/* Name: faultReport
+   Purpose: reports a fault -- what went wrong, the pc and instruction, 
+            every register and the segment involved
+   Arguments: stream to write to, the fault, segment table, registers 
+              array (as they were before the faulting instruction ran)
+   Return: void
+*/
+void faultReport(FILE * fp, const umFaultInfo * fault, segTable * memory,
+                 const word registers[]){
+    assert(fp != NULL && fault != NULL && memory != NULL);
+    Segment zero = getSegment(memory, 0);
+    uint32_t pc = fault->pc;
+    umSegmentID seg = fault->seg;
+
+    fprintf(fp, "um: fault: %s at pc %" PRIu32 "\n", 
+            faultNames[fault->kind], pc);
+    if (pc < segLength(zero)){
+        umInstruction input = zero[pc];
+        fprintf(fp, "  instruction 0x%08" PRIx32 " (%s)\n", input,
+                opNames[UM_OPCODE(input)]);
+    }
+    for (int r = 0; r < REG_COUNT; r++){
+        fprintf(fp, "  r%d = 0x%08" PRIx32, r, registers[r]);
+        if (r % 4 == 3){
+            fprintf(fp, "\n");
+        }
+    }
+
+    if (fault->kind == FAULT_UNMAPPED || fault->kind == FAULT_UNMAP_ZERO){
+        fprintf(fp, "  segment %" PRIu32 "\n", seg);
+    }
+    else if (fault->kind == FAULT_BOUNDS){
+        fprintf(fp, "  segment %" PRIu32 " offset %" PRIu32 
+                " (length %" PRIu32 ")\n", seg, fault->offset, 
+                segLength(getSegment(memory, seg)));
+    }
+    else if (fault->kind == FAULT_PC){
+        fprintf(fp, "  next pc %" PRIu32 " (segment %" PRIu32 " has %"
+                PRIu32 " words)\n", fault->offset, seg, 
+                segLength(getSegment(memory, seg)));
+    }
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                the guard                                 */
+/*--------------------------------------------------------------------------*/
+
+static __thread umTrap * innermost = NULL;
+static const char * guardStart = NULL;
+static size_t guardBytes = 0;
+static struct sigaction previous;
+static pthread_once_t trapOnce = PTHREAD_ONCE_INIT;
+
+/* Name: onTrap
+   Purpose: the SIGSEGV handler: jumps back to the thread's innermost trap
+            if the guard page was touched, else hands the signal on to the
+            handler installed before it
+   Arguments: signal, its info, context
+   Return: void
+*/
+static void onTrap(int sig, siginfo_t * info, void * context){
+    const char * at = info->si_addr;
+    umTrap * trap = innermost;
+    if (trap != NULL && at >= guardStart && at < guardStart + guardBytes){
+        siglongjmp(trap->jump, 1);
+    }
+    /* not ours: a handler the program set up gets it, and this one stays
+     * for the next guard access. with no handler, the access runs again
+     * under the default action and the process dies of it as it would
+     * have without the guard.
+     */
+    if (previous.sa_flags & SA_SIGINFO){
+        previous.sa_sigaction(sig, info, context);
+    }
+    else if (previous.sa_handler != SIG_DFL &&
+             previous.sa_handler != SIG_IGN){
+        previous.sa_handler(sig);
+    }
+    else {
+        sigaction(SIGSEGV, &previous, NULL);
+    }
+}
+
+static void installTrap(void){
+    guardStart = (const char *)guardPage();
+    guardBytes = (size_t)sysconf(_SC_PAGESIZE);
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = onTrap;
+    /* no mask to restore after the jump: the jump keeps the thread's */
+    action.sa_flags = SA_SIGINFO | SA_NODEFER;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGSEGV, &action, &previous);
+}
+
+/* Name: trapEnter
+   Purpose: makes a trap the thread's innermost, installing the handler the
+            first time (the caller then sigsetjmps its jump, with 0 for the
+            mask)
+   Arguments: trap
+   Return: void
+*/
+void trapEnter(umTrap * trap){
+    assert(trap != NULL);
+    pthread_once(&trapOnce, installTrap);
+    trap->outer = innermost;
+    innermost = trap;
+}
+
+/* Name: trapLeave
+   Purpose: makes the trap entered before this one the innermost again
+   Arguments: trap (the innermost)
+   Return: void
+*/
+void trapLeave(umTrap * trap){
+    assert(trap != NULL && innermost == trap);
+    innermost = trap->outer;
+}
+
+/* Name: accessFault
+   Purpose: works out the fault of a load or store that touched the guard
+            page
+   Arguments: segment table, registers (as the instruction found them), pc
+              of the SLOAD or SSTORE
+   Return: umFaultInfo
+*/
+umFaultInfo accessFault(segTable * memory, const word registers[],
+                        uint32_t pc){
+    assert(memory != NULL && registers != NULL);
+    umInstruction input = getSegment(memory, 0)[pc];
+    umSegmentID seg;
+    uint32_t offset;
+    if (UM_OPCODE(input) == SSTORE){
+        seg = registers[UM_REGA(input)];
+        offset = registers[UM_REGB(input)];
+    }
+    else {
+        assert(UM_OPCODE(input) == SLOAD);
+        seg = registers[UM_REGB(input)];
+        offset = registers[UM_REGC(input)];
+    }
+    umFaultInfo fault = { segMapped(memory, seg) ? FAULT_BOUNDS 
+                                                 : FAULT_UNMAPPED,
+                          pc, seg, offset };
+    return fault;
+}
@@ -0,0 +1,69 @@
+/* Authors: John Little (jlittl04) & Aryan Pandey (apande04)
+ * Date: November 2019
+ * The Universal Machine
+ * File: fault.h - header file for machine fault reports
+ */
+
+#ifndef FAULT_H
+#define FAULT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <setjmp.h>
+#include "memory.h"
+
+/* the ways a UM program can fail. the checked engine (./um --checked)
+ * looks for every one before the instruction that would fail and stops at
+ * the first, noting it in a umFaultInfo, and ./um reports it on stderr 
+ * and exits FAULT_EXIT. the other engines only catch invalid loads and
+ * stores, through the guard page (below); what any other fault does there
+ * is undefined.
+ */
+typedef enum umFault {
+        FAULT_UNMAPPED = 0,     /* load, store or LOADP of an unmapped ID */
+        FAULT_BOUNDS,           /* load or store past the end of a segment */
+        FAULT_DIV_ZERO,         /* DIV by zero */
+        FAULT_UNMAP_ZERO,       /* UNMAP of segment 0 */
+        FAULT_OUTPUT,           /* OUT of a value over 255 */
+        FAULT_OPCODE,           /* opcode 14 or 15 */
+        FAULT_PC                /* program pointer off the end of segment 0 */
+} umFault;
+
+/* a fault: its kind, the pc of the faulting instruction and the segment
+ * ID and offset involved (unused where the fault has none; for FAULT_PC,
+ * the segment the program pointer went into and where)
+ */
+typedef struct umFaultInfo {
+        umFault kind;
+        uint32_t pc;
+        umSegmentID seg;
+        uint32_t offset;
+} umFaultInfo;
+
+#define FAULT_EXIT 3
+
+/* checking and reporting */
+int segMapped(segTable * memory, umSegmentID id);
+void faultReport(FILE * fp, const umFaultInfo * fault, segTable * memory,
+                 const word registers[]);
+
+/* the guard: an engine that doesn't check loads and stores notes the pc of
+ * each one and makes it through guardedWord (see memory.h), so an invalid
+ * one touches the guard page instead of the host's memory. the SIGSEGV 
+ * that raises jumps back to the umTrap the thread entered last, and 
+ * accessFault works the fault out from the instruction at the pc and the
+ * registers, which it left as they were. any other SIGSEGV goes to 
+ * whatever handled it before (by default, killing the process).
+ */
+typedef struct umTrap {
+        sigjmp_buf jump;        /* set by the caller after trapEnter */
+        struct umTrap * outer;
+} umTrap;
+
+void trapEnter(umTrap * trap);
+void trapLeave(umTrap * trap);
+umFaultInfo accessFault(segTable * memory, const word registers[],
+                        uint32_t pc);
+
+#endif
@@ -0,0 +1,368 @@
+/* Authors: John Little (jlittl04) & Aryan Pandey (apande04)
+ * Date: November 2019
+ * The Universal Machine
+ * File: forksrv.c - implementation for the fork server
+ *
+ * the server warms its machine up on a umIO of callbacks: input never
+ * arrives, so the first IN stops the machine, blocked, ready to run that
+ * IN again, and output collects in a buffer. a job connects to the socket
+ * and passes its three descriptors over it (SCM_RIGHTS); the server forks,
+ * and the child gives the machine a umIO on those descriptors and runs it
+ * to the end, as ./um would. the kernel shares the parent's pages with the
+ * children until one writes them -- segment 0's words and decoded
+ * records, the segment table and every segment the warmup mapped -- so a
+ * child costs the pages it dirties. the server never runs the machine
+ * again, so its own copy stays warm for the next job.
+ */
+
+#include "forksrv.h"
+#include "libum.h"
+#include "fault.h"
+#include "memory.h"
+#include <assert.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/* what the image wrote while warming up */
+typedef struct warmOutput {
+        unsigned char * bytes;
+        size_t length;
+        size_t size;
+} warmOutput;
+
+static volatile sig_atomic_t stopping = 0;
+
+static void stop(int sig){
+    (void)sig;
+    stopping = 1;
+}
+
+static long warmRead(void * cl, unsigned char * buf, size_t count){
+    (void)cl;
+    (void)buf;
+    (void)count;
+    return UMIO_AGAIN;
+}
+
+static void warmWrite(void * cl, const unsigned char * buf, size_t count){
+    warmOutput * output = cl;
+    if (output->length + count > output->size){
+        output->size = 2 * (output->length + count);
+        output->bytes = realloc(output->bytes, output->size);
+        assert(output->bytes != NULL);
+    }
+    memcpy(output->bytes + output->length, buf, count);
+    output->length += count;
+}
+
+/* Name: writeAll
+   Purpose: writes every byte, however many write() calls it takes
+   Arguments: file descriptor, bytes, count
+   Return: int -- 0, or -1 with errno set
+*/
+static int writeAll(int fd, const unsigned char * bytes, size_t count){
+    while (count > 0){
+        ssize_t done = write(fd, bytes, count);
+        if (done < 0 && errno == EINTR){
+            continue;
+        }
+        if (done <= 0){
+            return -1;
+        }
+        bytes += done;
+        count -= (size_t)done;
+    }
+    return 0;
+}
+
+/* Name: socketAddress
+   Purpose: fills in a unix socket address
+   Arguments: the address, the socket's path
+   Return: int -- 0, or -1 with errno set if the path is too long
+*/
+static int socketAddress(struct sockaddr_un * address, const char * path){
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address->sun_path)){
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(address->sun_path, path);
+    return 0;
+}
+
+/* Name: listenOn
+   Purpose: makes the server's socket, replacing any a server before it
+            left at the path
+   Arguments: path
+   Return: int -- the listening socket, or -1 with errno set
+*/
+static int listenOn(const char * path){
+    struct sockaddr_un address;
+    if (socketAddress(&address, path) != 0){
+        return -1;
+    }
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0){
+        return -1;
+    }
+    unlink(path);
+    if (bind(sock, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(sock, SOMAXCONN) != 0){
+        int saved = errno;
+        close(sock);
+        errno = saved;
+        return -1;
+    }
+    return sock;
+}
+
+/* Name: takeFds
+   Purpose: receives a job's stdin, stdout and stderr over its connection
+   Arguments: connection, where to put the three descriptors
+   Return: int -- 0, or -1 if the job didn't send exactly three
+*/
+static int takeFds(int conn, int fds[3]){
+    unsigned char byte;
+    struct iovec iov = { &byte, 1 };
+    union {
+        struct cmsghdr header;
+        char space[CMSG_SPACE(3 * sizeof(int))];
+    } control;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.space;
+    msg.msg_controllen = sizeof(control.space);
+
+    ssize_t got;
+    do {
+        got = recvmsg(conn, &msg, 0);
+    } while (got < 0 && errno == EINTR);
+    struct cmsghdr * cmsg = got == 1 ? CMSG_FIRSTHDR(&msg) : NULL;
+    if (cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET ||
+        cmsg->cmsg_type != SCM_RIGHTS){
+        return -1;
+    }
+    if (cmsg->cmsg_len != CMSG_LEN(3 * sizeof(int))){
+        /* close whatever did come */
+        size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < count; i++){
+            int fd;
+            memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+            close(fd);
+        }
+        return -1;
+    }
+    memcpy(fds, CMSG_DATA(cmsg), 3 * sizeof(int));
+    return 0;
+}
+
+/* Name: runChild
+   Purpose: runs a job in a forked child: replays the warmup's output,
+            runs the warmed machine on the job's descriptors to the end
+            and tells the job how it ended
+   Arguments: machine, warmup output, the job's connection and descriptors
+   Return: does not return
+*/
+static void runChild(umMachine * m, const warmOutput * output, int conn,
+                     const int fds[3]){
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGCHLD, SIG_DFL);
+    for (int i = 0; i < 3; i++){
+        dup2(fds[i], i);
+    }
+    for (int i = 0; i < 3; i++){
+        if (fds[i] > STDERR_FILENO){
+            close(fds[i]);
+        }
+    }
+
+    writeAll(STDOUT_FILENO, output->bytes, output->length);
+    umIO * io = newIO(STDIN_FILENO, STDOUT_FILENO, 0);
+    umSetIO(m, io);
+    umStatus status = umRun(m, 0);
+    assert(status == UM_HALTED || status == UM_FAULT);
+    if (status == UM_FAULT){
+        umFaultReport(m, stderr);
+    }
+    freeIO(io);
+    fflush(stderr);
+
+    unsigned char code = status == UM_FAULT ? FAULT_EXIT : EXIT_SUCCESS;
+    writeAll(conn, &code, 1);
+    _exit(code);
+}
+
+/* Name: runForkServer
+   Purpose: warms a machine up on an image, then forks a child to run
+            every job that connects, until told to stop
+   Arguments: socket path, image, instructions to warm up for at most (0
+              to run to the first IN), libum.h flags for the machine
+   Return: int -- 0 once stopped, or -1 if the image never warmed up or
+           the socket couldn't be made (having said why)
+*/
+int runForkServer(const char * socketPath, const char * image,
+                  uint64_t warm, unsigned flags){
+    assert(socketPath != NULL && image != NULL);
+    umMachine * m = umNew(flags);
+    umLoadImage(m, image);
+    warmOutput output = { NULL, 0, 0 };
+    umIO * io = newCallbackIO((umIOCallbacks){ warmRead, warmWrite,
+                                               &output });
+    umSetIO(m, io);
+    umStatus status = umRun(m, warm);
+    ioFlush(io);
+    if (status == UM_FAULT){
+        umFaultReport(m, stderr);
+    }
+    else if (status == UM_HALTED){
+        fprintf(stderr, "um: %s halted while warming up\n", image);
+    }
+    freeIO(io);
+    umSetIO(m, NULL);
+
+    int sock = -1;
+    if (status == UM_BLOCKED || status == UM_BUDGET){
+        sock = listenOn(socketPath);
+        if (sock < 0){
+            fprintf(stderr, "um: cannot listen on %s: %s\n", socketPath,
+                    strerror(errno));
+        }
+    }
+    if (sock < 0){
+        umFree(m);
+        releaseArena();
+        free(output.bytes);
+        return -1;
+    }
+
+    /* stopping interrupts accept(); children are reaped by the kernel */
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stop;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGCHLD, SIG_IGN);
+    if (status == UM_BLOCKED){
+        fprintf(stderr, "um: serving %s on %s from its first IN\n", image,
+                socketPath);
+    }
+    else {
+        fprintf(stderr, "um: serving %s on %s after %" PRIu64
+                " instructions\n", image, socketPath, warm);
+    }
+
+    uint64_t served = 0;
+    while (!stopping){
+        int conn = accept(sock, NULL, NULL);
+        if (conn < 0){
+            if (errno == EINTR || errno == ECONNABORTED){
+                continue;
+            }
+            fprintf(stderr, "um: cannot accept jobs on %s: %s\n",
+                    socketPath, strerror(errno));
+            break;
+        }
+        int fds[3];
+        if (takeFds(conn, fds) != 0){
+            close(conn);
+            continue;
+        }
+        fflush(NULL);
+        pid_t child = fork();
+        if (child == 0){
+            close(sock);
+            runChild(m, &output, conn, fds);
+        }
+        if (child < 0){
+            fprintf(stderr, "um: cannot fork a job: %s\n", strerror(errno));
+            unsigned char code = EXIT_FAILURE;
+            writeAll(conn, &code, 1);
+        }
+        else {
+            served++;
+        }
+        for (int i = 0; i < 3; i++){
+            close(fds[i]);
+        }
+        close(conn);
+    }
+
+    close(sock);
+    unlink(socketPath);
+    fprintf(stderr, "um: served %" PRIu64 " jobs on %s\n", served,
+            socketPath);
+    umFree(m);
+    releaseArena();
+    free(output.bytes);
+    return 0;
+}
+
+/* Name: runForkJob
+   Purpose: runs a job on a fork server with this process's stdin, stdout
+            and stderr, waiting for it to end
+   Arguments: socket path
+   Return: int -- the job's exit status
+*/
+int runForkJob(const char * socketPath){
+    assert(socketPath != NULL);
+    struct sockaddr_un address;
+    int sock = -1;
+    if (socketAddress(&address, socketPath) == 0){
+        sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    }
+    if (sock < 0 ||
+        connect(sock, (struct sockaddr *)&address, sizeof(address)) != 0){
+        fprintf(stderr, "um: cannot reach a fork server on %s: %s\n",
+                socketPath, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    int fds[3] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+    unsigned char byte = 0;
+    struct iovec iov = { &byte, 1 };
+    union {
+        struct cmsghdr header;
+        char space[CMSG_SPACE(sizeof(fds))];
+    } control;
+    memset(&control, 0, sizeof(control));
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.space;
+    msg.msg_controllen = sizeof(control.space);
+    struct cmsghdr * cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    ssize_t done;
+    do {
+        done = sendmsg(sock, &msg, 0);
+    } while (done < 0 && errno == EINTR);
+    unsigned char code = 0;
+    ssize_t got = 0;
+    if (done == 1){
+        do {
+            got = read(sock, &code, 1);
+        } while (got < 0 && errno == EINTR);
+    }
+    close(sock);
+    if (got != 1){
+        fprintf(stderr, "um: the job on %s ended without a status\n",
+                socketPath);
+        return EXIT_FAILURE;
+    }
+    return code;
+}
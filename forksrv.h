@@ -0,0 +1,30 @@
+/* Authors: John Little (jlittl04) & Aryan Pandey (apande04)
+ * Date: November 2019
+ * The Universal Machine
+ * File: forksrv.h - header file for the fork server
+ */
+
+#ifndef FORKSRV_H
+#define FORKSRV_H
+
+#include <stdlib.h>
+#include <inttypes.h>
+
+/* the fork server runs an image until it first asks for input (or for a
+ * given number of instructions, if that comes first) and then listens on
+ * a unix socket. every job that connects hands over its stdin, stdout and
+ * stderr, and the server forks a child that carries on from the warmed
+ * machine with them, so jobs skip the warmup and share every page of
+ * memory none of them writes. output the image wrote while warming up is
+ * written again by every child. the child tells the job how it ended
+ * (the exit status ./um would have had) over the socket.
+ */
+
+/* serving until SIGINT or SIGTERM; 0 or -1 if it couldn't start */
+int runForkServer(const char * socketPath, const char * image,
+                  uint64_t warm, unsigned flags);
+
+/* running one job on a server: the exit status for ./um */
+int runForkJob(const char * socketPath);
+
+#endif
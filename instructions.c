@@ -11,119 +11,40 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-/* Name: checkAllow
-   Purpose: check if a word value is acceptably read as a char
-   Arguments: word 
-   Return: uint8_t -- returns 0 if false, 1 if true
-*/
-uint8_t checkAllow(word letter){
-	if (letter > 255){
-		return 0;
-	}
-	else {
-		return 1;
-	}
-}
-
-/* Name: exConMove
-   Purpose: executes the conditional move operation
-   Arguments: array of words rep. registers and 3 register IDs
-   Return: Void
-*/
-void exConMove(word registers[], regID trgt, regID src, regID con){
-	assert(registers != NULL);
-	if (registers[con] != 0){
-		registers[trgt] = registers[src];
-	}
-}
-
-/* Name: exSegLoad
-   Purpose: executes the segment load operation
-   Arguments: array for registers, 3 register IDs, memory Sequence
-   Return: void
-*/
-void exSegLoad(word registers[], regID trgt, regID seg, regID word, 
-			   Seq_T memory){
-	assert(registers != NULL);
-	assert(memory != NULL);
-
-	uint32_t x = registers[seg]; 
-	uint32_t offset = registers[word]; 
-	registers[trgt] = getWordat(x, offset, memory);
-}
-
-/* Name: exAddition
-   Purpose: execute addition operation
-   Arguments: array for registers, 3 register IDs
-   Return: void
-*/
-void exAddition(word registers[], regID trgt, regID ra, regID rb){ 
-	assert(registers != NULL);
-	registers[trgt] = ((registers[ra] + registers[rb]) % 
-					   ((uint64_t)UINT_MAX + 1));
-}
-
-/* Name: exMultiply 
-   Purpose: execute multiply operation
-   Arguments: registers array, 3 register IDs
-   Return: void
-*/
-void exMultiply(word registers[], regID trgt, regID ra, regID rb){
-	assert(registers != NULL);
-	registers[trgt] = ((registers[ra] * registers[rb]) % 
-		               ((uint64_t)UINT_MAX + 1));
-}
-
-/* Name: exDivide
-   Purpose: execute divide operation
-   Arguments: registers array, 3 register IDs
-   Return: void
-*/
-void exDivide(word registers[], regID trgt, regID num, regID denom){
-	assert(registers != NULL);
-	registers[trgt] = ((registers[num] / registers[denom]));	
-}
-
-/* Name: exBitNAND
-   Purpose: execute bitwise NAND operation
-   Arguments: registers array, 3 register IDs
-   Return: void
-*/
-void exBitNAND(word registers[], regID trgt, regID ra, regID rb){
-	assert(registers != NULL);
-	registers[trgt] = ~(registers[ra] & registers[rb]);
-}
-
 /* Name: out
    Purpose: check if contents of a register are interpretable as a char and 
-   			print a char to standard out 
-   Arguments: registers array, 1 register ID
+   			output the char (see umio.c for how output is batched)
+   Arguments: the machine's I/O, registers array, 1 register ID
    Return: void
 */
-void out(word registers[], regID output){
+void out(umIO * io, word registers[], regID output){
 	assert(registers != NULL);
-	if (!checkAllow(registers[output])){
+	if (registers[output] > 255){
 		return;
 	}
-	printf("%c", registers[output]);
+	ioPut(io, (unsigned char)registers[output]);
 }
 
 /* Name: in
-   Purpose: wait for input from stdin... once arrived set register 
-            equal to input
-   Arguments: registers array, 1 register ID
-   Return: void
+   Purpose: wait for input... once arrived set register equal to input, or
+   			to all ones at the end of input. input through callbacks may 
+   			not have arrived yet, in which case the register is left alone
+   Arguments: the machine's I/O, registers array, 1 register ID
+   Return: int -- 0 if the input hasn't arrived yet, else 1
 */
-void in(word registers[], regID input){
+int in(umIO * io, word registers[], regID input){
 	assert(registers != NULL);
-	word in = 0;
-	in = getchar();
-	if (checkAllow(in)){
-		registers[input] = in;
+	int in = ioGet(io);
+	if (in == UMIO_AGAIN){
+		return 0;
+	}
+	if (in != UMIO_EOF){
+		registers[input] = (word)in;
 	}
 	else {
 		registers[input] = 0xFFFFFFFF;
 	}
+	return 1;
 }
 
 /*-------------------------------------------------*/
@@ -132,46 +53,32 @@ void in(word registers[], regID input){
 
 /* Name: mapSeg
    Purpose: executed the map segment operation 
-   Arguments: registers array, 2 register IDs, segment IDs sequence, memory
+   Arguments: registers array, 2 register IDs, segment table
    Return: void
 */
-void mapSeg(word registers[], regID words, regID other, Seq_T segIDs, 
-	        Seq_T memory){
+void mapSeg(word registers[], regID words, regID other, segTable * memory){
 	assert(registers != NULL);
-	assert(segIDs != NULL);
 	assert(memory != NULL);
 
 	/* generate new id for segment, then allocate a new block of memory */
 	uint32_t count = registers[words];
-	umSegmentID id = chooseID(segIDs, memory);
+	umSegmentID id = chooseID(memory);
 	allocate(count, id, memory);
 	registers[other] = id;
 }
 
 /* Name: unmapSeg 
    Purpose: execute the unmap segment operation
-   Arguments: registers array, 2 register IDs, segmnet IDs sequence, memory
+   Arguments: registers array, 1 register ID, segment table
    Return: void
 */
-void unmapSeg(word registers[], regID c, Seq_T segIDs, Seq_T memory){
+void unmapSeg(word registers[], regID c, segTable * memory){
 	assert(registers != NULL);
-	assert(segIDs != NULL);
 	assert(memory != NULL);
 
-	/* put segment ID into availabe sequence and deallocate segment */
-	pushSegID(segIDs, registers[c]);
-	deallocate((Segment)Seq_get(memory, registers[c]));
-	Seq_put(memory, registers[c], NULL);
-}
-
-/* Name: exLoadVal
-   Purpose: execture load value operation
-   Arguments: registers array, 1 register ID, a UM instruction
-   Return: void
-*/
-void exLoadVal(word registers[], regID trgt, umInstruction instruct){
-	assert(registers != NULL);
-	registers[trgt] = getValue(instruct);
+	/* deallocate segment and put segment ID on the free list */
+	deallocate(getSegment(memory, registers[c]));
+	pushSegID(memory, registers[c]);
 }
 
 /* Name: getOpCode
@@ -228,28 +135,13 @@ word getValue(umInstruction input){
 	return (word)Bitpack_getu(input, VAL_WIDTH, VAL_LSB);
 }
 
-/* Name: getNextInstruct
-   Purpose: returns the next instruction for machine to execute from segment 0.
-   Arguments: a segment, the program pointer
-   Return: umInstruction
-*/
-umInstruction getNextInstruct(Segment program, uint32_t * prgmPtr){
-	assert(program != NULL);
-	assert(prgmPtr != NULL);
-
-	umInstruction thing; 
-	thing = *(umInstruction *)Seq_get(program, *prgmPtr);
-	(*prgmPtr)++;
-	return thing;
-}
-
 /* Name: loadProgram
    Purpose: load a given segment into segment 0 and reset the program 
    			pointer to a given value.
-   Arguments: registers array, 2 register IDs, memory segment, program pointer
+   Arguments: registers array, 2 register IDs, segment table, program pointer
    Return: void 
 */
-void loadProgram(word registers[], regID b, regID c, Segment memory, 
+void loadProgram(word registers[], regID b, regID c, segTable * memory, 
 				 uint32_t * prgmPtr){
 	assert(registers != NULL);
 	assert(prgmPtr != NULL);
@@ -261,52 +153,20 @@ void loadProgram(word registers[], regID b, regID c, Segment memory,
 		return;
 	}
 
-	/* make a deep copy of the segment */
-	umSegmentID i = registers[b];
-	Segment src = Seq_get(memory, i);
-	int len = Seq_length(Seq_get(memory, i));
-	Segment copy = Seq_new(len);
-	for (int j = 0; j < len; j++){
-		word * thing = malloc(sizeof(*thing));
-		*thing = *(word *)Seq_get(src, j);
-		Seq_addhi(copy, thing);
-	}
-
-	/* put the deep copy into the segment 0 slot */
-	Segment old = Seq_get(memory, 0);
-	deallocate(old);
-	Seq_put(memory, 0, copy);
+	/* share the segment with the segment 0 slot -- it is only copied 
+	 * once one of the two is written */
+	shareSegment(memory, registers[b]);
 
 	*prgmPtr = registers[c];
 }
 
 /* Name: halt
    Purpose: stop the machine and clean up memory
-   Arguments: memory sequence, segIDs sequence, and program pointer
+   Arguments: segment table
    Return: void 
 */
-void halt(Seq_T memory, Seq_T segIDs, uint32_t * prgmPtr){
+void halt(segTable * memory){
 	assert(memory != NULL);
-	assert(segIDs != NULL);
-	assert(prgmPtr != NULL);
-
-	completeFree(memory, segIDs);
-	free(prgmPtr);
-}
-
-/* Name: exSegStore
-   Purpose: execute segment store operation
-   Arguments: registers array, 3 register IDs, memory sequence
-   Return: void
-*/
-void exSegStore(word registers[], regID src, regID seg, regID wordC, 
-	            Seq_T memory){
-	assert(registers != NULL);
-	assert(memory != NULL);
-
-	umSegmentID id = registers[seg];
-	word offset = registers[wordC];
-	word addie = registers[src];
-	editWord(memory, id, offset, addie);
 
+	completeFree(memory);
 }
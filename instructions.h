@@ -11,6 +11,7 @@
 #include <inttypes.h>
 #include "bitpack.h"
 #include "memory.h"
+#include "umio.h"
 
 //Define the various widths and LSBs of the parts of an instruction
 #define VAL_WIDTH 25
@@ -23,6 +24,17 @@
 #define OP_CODE_LSB 28 
 #define VAL_LSB 0
 
+/* the same fields, unpacked with a shift and a mask so the dispatch loop 
+ * can decode operands inline instead of calling the getters below */
+#define UM_FIELD(input, width, lsb) \
+        (((input) >> (lsb)) & ((UINT32_C(1) << (width)) - 1))
+#define UM_OPCODE(input) ((input) >> OP_CODE_LSB)
+#define UM_REGA(input) UM_FIELD(input, REG_WIDTH, REGA_LSB)
+#define UM_REGB(input) UM_FIELD(input, REG_WIDTH, REGB_LSB)
+#define UM_REGC(input) UM_FIELD(input, REG_WIDTH, REGC_LSB)
+#define UM_REGAprime(input) UM_FIELD(input, REG_WIDTH, REGAprime_LSB)
+#define UM_VALUE(input) UM_FIELD(input, VAL_WIDTH, VAL_LSB)
+
 //Also important type definitions
 typedef uint32_t umInstruction; 
 typedef enum opCode {
@@ -32,33 +44,20 @@ typedef enum opCode {
 typedef uint8_t regID; 
 
 /* extracting bits for opcodes, instructions, and registers */
-umInstruction getNextInstruct(Segment program, uint32_t * prgmPtr); 
 opCode getOpCode(umInstruction input); 
 regID getRegA(umInstruction input); 
 regID getRegB(umInstruction input); 
 regID getRegC(umInstruction input); 
 regID getRegAprime(umInstruction input); 
 word getValue(umInstruction input); 
-uint8_t checkAllow(word letter); 
 
 /* executing operations */
-void exConMove(word registers[], regID trgt, regID src, regID con); 
-void exSegLoad(word registers[], regID trgt, regID seg, regID word, 
-	           Seq_T memory); 
-void exSegStore(word registers[], regID src, regID seg, regID wordC, 
-	            Seq_T memory);
-void exAddition(word registers[], regID trgt, regID ra, regID rb); 
-void exMultiply(word registers[], regID trgt, regID ra, regID rb); 
-void exDivide(word registers[], regID trgt, regID num, regID denom); 
-void exBitNAND(word registers[], regID trgt, regID ra, regID rb); 
-void exLoadVal(word registers[], regID trgt, umInstruction instruct); 
-void halt(Seq_T memory, Seq_T segIDs, uint32_t * prgmPtr);
-void mapSeg(word registers[], regID words, regID other, Seq_T segIDs,
-            Seq_T memory); 
-void unmapSeg(word registers[], regID c, Seq_T segIDs, Seq_T memory); 
-void out(word registers[], regID output); 
-void in(word registers[], regID input); 
-void loadProgram(word registers[], regID b, regID c, Segment memory, 
+void halt(segTable * memory);
+void mapSeg(word registers[], regID words, regID other, segTable * memory); 
+void unmapSeg(word registers[], regID c, segTable * memory); 
+void out(umIO * io, word registers[], regID output); 
+int in(umIO * io, word registers[], regID input); 
+void loadProgram(word registers[], regID b, regID c, segTable * memory, 
 	             uint32_t * prgmPtr); 
 
 #endif
@@ -0,0 +1,720 @@
+/* Authors: John Little (jlittl04) & Aryan Pandey (apande04)
+ * Date: November 2019
+ * The Universal Machine
+ * File: jit.c - implementation for the x86-64 JIT package
+ *
+ * the JIT compiles hot basic blocks of segment 0 into native x86-64. since
+ * the only jump on the UM is LOAD PROGRAM, blocks start wherever a LOADP
+ * into segment 0 lands and end at the next LOADP, or just before a HALT,
+ * IN, OUT or invalid instruction (which are left to the interpreter).
+ *
+ * inside a block the eight UM registers are pinned to host registers:
+ *     r0 ebx    r1 ebp    r2 r12d    r3 r13d
+ *     r4 r14d   r5 r15d   r6 r8d     r7 r9d
+ * eax, ecx, edx, esi and edi are scratch. each block is laid out as
+ * [shared exit][prologue][body]; every exit loads rax with its result
+ * (next program pointer in the low half, exit status in the high half) and
+ * jumps back to the shared exit, which writes the registers back to the
+ * registers array. a LOADP into segment 0 jumps straight into the body of
+ * the target block when that block is already compiled.
+ */
+
+#include "jit.h"
+#include "instructions.h"
+#include <assert.h>
+#include <string.h>
+
+#if UM_JIT
+
+#include <sys/mman.h>
+
+//Tuning for the JIT
+#define JIT_HOT 64                      /* landings before a block compiles */
+#define JIT_CODE_SIZE (16u << 20)       /* bytes of executable memory */
+#define JIT_MAX_BLOCK 256               /* instructions per block */
+#define JIT_MAX_INSTRUCT_BYTES 128      /* worst case bytes per instruction */
+#define JIT_BLOCK_ROOM (JIT_MAX_BLOCK * JIT_MAX_INSTRUCT_BYTES + 256)
+#define JIT_MAX_FLUSHES 64              /* flushes before giving up */
+#define JIT_NEVER UINT32_MAX            /* count for a pc that can't compile */
+
+//Exit statuses, found in the high half of a block's result
+#define JIT_CONTINUE 0   /* keep running compiled code from the pointer */
+#define JIT_EXIT 1       /* let the interpreter run the next instruction */
+#define JIT_FLUSH 2      /* compiled code was overwritten, throw it away */
+
+//What the load and store helpers return when the access would fault
+#define JIT_LOAD_FAULT ((uint64_t)1 << 32)
+#define JIT_STORE_FAULT 2
+
+//Host register numbers
+#define RAX 0
+#define RCX 1
+#define RDX 2
+#define RSI 6
+#define RDI 7
+
+typedef uint64_t (*jitBlock)(umJitContext * ctx);
+
+struct umJit {
+        uint8_t * base;
+        size_t used;
+        size_t prologueSize;
+        uint32_t length;
+        uint32_t capacity;
+        uint8_t ** entries;
+        uint32_t * counts;
+        uint8_t * covered;
+        uint32_t * landed;
+        uint32_t landings;
+        unsigned flushes;
+        int disabled;
+};
+
+static const uint8_t pinned[REG_COUNT] = { 3, 5, 12, 13, 14, 15, 8, 9 };
+
+/*--------------------------------------------------------------------------*/
+/*                               the emitter                                */
+/*--------------------------------------------------------------------------*/
+
+static inline void emit8(uint8_t ** p, uint8_t b){
+    *(*p)++ = b;
+}
+
+static inline void emit32(uint8_t ** p, uint32_t v){
+    memcpy(*p, &v, sizeof(v));
+    *p += sizeof(v);
+}
+
+static inline void emit64(uint8_t ** p, uint64_t v){
+    memcpy(*p, &v, sizeof(v));
+    *p += sizeof(v);
+}
+
+/* Name: emitRegReg
+   Purpose: emits a one byte opcode over two 32 bit registers (ModRM with
+            mod 11), adding a REX prefix when either is r8 to r15
+   Arguments: code pointer, opcode, r/m register, reg register
+   Return: void
+*/
+static void emitRegReg(uint8_t ** p, uint8_t opcode, unsigned rm,
+                       unsigned reg){
+    if (rm >= 8 || reg >= 8){
+        emit8(p, 0x40 | ((reg >> 3) << 2) | (rm >> 3));
+    }
+    emit8(p, opcode);
+    emit8(p, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+/* Name: emitRegReg2
+   Purpose: same as emitRegReg for a two byte (0F xx) opcode
+   Arguments: code pointer, second opcode byte, r/m register, reg register
+   Return: void
+*/
+static void emitRegReg2(uint8_t ** p, uint8_t opcode, unsigned rm,
+                        unsigned reg){
+    if (rm >= 8 || reg >= 8){
+        emit8(p, 0x40 | ((reg >> 3) << 2) | (rm >> 3));
+    }
+    emit8(p, 0x0F);
+    emit8(p, opcode);
+    emit8(p, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+/* Name: emitUnary
+   Purpose: emits a group 3 (F7 /ext) operation on one 32 bit register
+   Arguments: code pointer, opcode extension, register
+   Return: void
+*/
+static void emitUnary(uint8_t ** p, unsigned ext, unsigned rm){
+    if (rm >= 8){
+        emit8(p, 0x41);
+    }
+    emit8(p, 0xF7);
+    emit8(p, 0xC0 | (ext << 3) | (rm & 7));
+}
+
+/* Name: emitMovImm
+   Purpose: emits mov r32, imm32
+   Arguments: code pointer, register, immediate
+   Return: void
+*/
+static void emitMovImm(uint8_t ** p, unsigned reg, uint32_t imm){
+    if (reg >= 8){
+        emit8(p, 0x41);
+    }
+    emit8(p, 0xB8 + (reg & 7));
+    emit32(p, imm);
+}
+
+/* Name: emitRcxAccess
+   Purpose: emits a 32 bit move between a register and [rcx + disp8]
+   Arguments: code pointer, opcode (8B load or 89 store), register, disp
+   Return: void
+*/
+static void emitRcxAccess(uint8_t ** p, uint8_t opcode, unsigned reg,
+                          uint8_t disp){
+    if (reg >= 8){
+        emit8(p, 0x44);
+    }
+    emit8(p, opcode);
+    emit8(p, 0x40 | ((reg & 7) << 3) | RCX);
+    emit8(p, disp);
+}
+
+/* Name: emitRegistersAddress
+   Purpose: emits code leaving the address of the registers array in rcx.
+            the context pointer sits at [rsp + depth] and the array pointer
+            is its first member.
+   Arguments: code pointer, stack depth of the context pointer
+   Return: void
+*/
+static void emitRegistersAddress(uint8_t ** p, uint8_t depth){
+    emit8(p, 0x48); emit8(p, 0x8B); emit8(p, 0x4C); emit8(p, 0x24);
+    emit8(p, depth);                                /* mov rcx,[rsp+d] */
+    emit8(p, 0x48); emit8(p, 0x8B); emit8(p, 0x09); /* mov rcx,[rcx] */
+}
+
+/* Name: emitSpill
+   Purpose: writes every pinned register back into the registers array
+   Arguments: code pointer
+   Return: void
+*/
+static void emitSpill(uint8_t ** p){
+    emitRegistersAddress(p, 0);
+    for (int i = 0; i < REG_COUNT; i++){
+        emitRcxAccess(p, 0x89, pinned[i], (uint8_t)(i * sizeof(word)));
+    }
+}
+
+/* Name: emitReload
+   Purpose: loads every pinned register from the registers array
+   Arguments: code pointer
+   Return: void
+*/
+static void emitReload(uint8_t ** p){
+    emitRegistersAddress(p, 0);
+    for (int i = 0; i < REG_COUNT; i++){
+        emitRcxAccess(p, 0x8B, pinned[i], (uint8_t)(i * sizeof(word)));
+    }
+}
+
+/* Name: emitCall
+   Purpose: emits an absolute call to a C helper
+   Arguments: code pointer, helper address
+   Return: void
+*/
+static void emitCall(uint8_t ** p, void * helper){
+    emit8(p, 0x48); emit8(p, 0xB8);                 /* mov rax, imm64 */
+    emit64(p, (uint64_t)(uintptr_t)helper);
+    emit8(p, 0xFF); emit8(p, 0xD0);                 /* call rax */
+}
+
+/* Name: emitJump
+   Purpose: emits a 32 bit relative jump, or conditional jump when cond is
+            a 0F 8x condition byte (0 for an unconditional jump)
+   Arguments: code pointer, condition, target
+   Return: void
+*/
+static void emitJump(uint8_t ** p, uint8_t cond, uint8_t * target){
+    if (cond == 0){
+        emit8(p, 0xE9);
+    }
+    else {
+        emit8(p, 0x0F);
+        emit8(p, cond);
+    }
+    emit32(p, (uint32_t)(target - (*p + 4)));
+}
+
+/* Name: emitExit
+   Purpose: emits a fixed size (15 byte) exit from the block with a known
+            status and program pointer
+   Arguments: code pointer, shared exit, status, program pointer
+   Return: void
+*/
+static void emitExit(uint8_t ** p, uint8_t * epilogue, uint32_t status,
+                     uint32_t prgmPtr){
+    emit8(p, 0x48); emit8(p, 0xB8);                 /* mov rax, imm64 */
+    emit64(p, ((uint64_t)status << 32) | prgmPtr);
+    emitJump(p, 0, epilogue);
+}
+
+/* Name: emitEpilogue
+   Purpose: emits the shared exit of a block: writes the registers back,
+            restores the host's callee saved registers and returns rax
+   Arguments: code pointer
+   Return: void
+*/
+static void emitEpilogue(uint8_t ** p){
+    emitSpill(p);
+    emit8(p, 0x48); emit8(p, 0x83); emit8(p, 0xC4); emit8(p, 0x08);
+    emit8(p, 0x41); emit8(p, 0x5F);                 /* pop r15 */
+    emit8(p, 0x41); emit8(p, 0x5E);                 /* pop r14 */
+    emit8(p, 0x41); emit8(p, 0x5D);                 /* pop r13 */
+    emit8(p, 0x41); emit8(p, 0x5C);                 /* pop r12 */
+    emit8(p, 0x5D);                                 /* pop rbp */
+    emit8(p, 0x5B);                                 /* pop rbx */
+    emit8(p, 0xC3);                                 /* ret */
+}
+
+/* Name: emitPrologue
+   Purpose: emits the entry of a block: saves the host's callee saved
+            registers and the context pointer, then loads the UM registers.
+            the stack is 16 byte aligned afterwards.
+   Arguments: code pointer
+   Return: void
+*/
+static void emitPrologue(uint8_t ** p){
+    emit8(p, 0x53);                                 /* push rbx */
+    emit8(p, 0x55);                                 /* push rbp */
+    emit8(p, 0x41); emit8(p, 0x54);                 /* push r12 */
+    emit8(p, 0x41); emit8(p, 0x55);                 /* push r13 */
+    emit8(p, 0x41); emit8(p, 0x56);                 /* push r14 */
+    emit8(p, 0x41); emit8(p, 0x57);                 /* push r15 */
+    emit8(p, 0x57);                                 /* push rdi */
+    emitReload(p);
+}
+
+/*--------------------------------------------------------------------------*/
+/*                  helpers compiled code calls back into                   */
+/*--------------------------------------------------------------------------*/
+
+/* an access that would fault is left undone: the block exits at it, and
+ * the interpreter runs it again through the guard, with the registers 
+ * written back for the fault report
+ */
+static uint64_t jitSegLoad(umJitContext * ctx, word seg, word offset){
+    word * at = guardedWord(ctx->memory, seg, offset);
+    if (at == ctx->memory->guard){
+        return JIT_LOAD_FAULT;
+    }
+    return *at;
+}
+
+/* returns nonzero when the store overwrote a word of compiled code */
+static word jitSegStore(umJitContext * ctx, word seg, word offset, word value){
+    if (guardedWord(ctx->memory, seg, offset) == ctx->memory->guard){
+        return JIT_STORE_FAULT;
+    }
+    editWord(ctx->memory, seg, offset, value);
+    if (seg != 0){
+        return 0;
+    }
+    return ctx->jit->covered[offset];
+}
+
+static void jitMapSeg(umJitContext * ctx, regID b, regID c){
+    mapSeg(ctx->registers, c, b, ctx->memory);
+}
+
+static void jitUnmapSeg(umJitContext * ctx, regID b, regID c){
+    (void)b;
+    unmapSeg(ctx->registers, c, ctx->memory);
+}
+
+/*--------------------------------------------------------------------------*/
+/*                               the compiler                               */
+/*--------------------------------------------------------------------------*/
+
+/* Name: emitHelperCall
+   Purpose: emits a call to jitSegLoad or jitSegStore. r8 and r9 are saved
+            around the call; the other pinned registers are callee saved.
+   Arguments: code pointer, helper, number of register arguments, their
+              UM register IDs
+   Return: void
+*/
+static void emitHelperCall(uint8_t ** p, void * helper, int argc,
+                           const regID args[]){
+    static const uint8_t argRegs[3] = { RSI, RDX, RCX };
+    emit8(p, 0x41); emit8(p, 0x50);                 /* push r8 */
+    emit8(p, 0x41); emit8(p, 0x51);                 /* push r9 */
+    emit8(p, 0x48); emit8(p, 0x8B); emit8(p, 0x7C); emit8(p, 0x24);
+    emit8(p, 0x10);                                 /* mov rdi,[rsp+16] */
+    for (int i = 0; i < argc; i++){
+        emitRegReg(p, 0x89, argRegs[i], pinned[args[i]]);
+    }
+    emitCall(p, helper);
+    emit8(p, 0x41); emit8(p, 0x59);                 /* pop r9 */
+    emit8(p, 0x41); emit8(p, 0x58);                 /* pop r8 */
+}
+
+/* Name: emitSpilledCall
+   Purpose: emits a call to jitMapSeg or jitUnmapSeg, which work on the
+            registers array, so every pinned register is written back
+            before the call and loaded again after it
+   Arguments: code pointer, helper, register B, register C
+   Return: void
+*/
+static void emitSpilledCall(uint8_t ** p, void * helper, regID b, regID c){
+    emitSpill(p);
+    emit8(p, 0x48); emit8(p, 0x8B); emit8(p, 0x3C); emit8(p, 0x24);
+    emitMovImm(p, RSI, b);
+    emitMovImm(p, RDX, c);
+    emitCall(p, helper);
+    emitReload(p);
+}
+
+/* Name: emitLoadProgram
+   Purpose: emits LOADP. loading a non-zero segment leaves the block at the
+            LOADP for the interpreter. a jump within segment 0 goes straight
+            into the target's compiled body if there is one, and otherwise
+            back to jitRun with the target as the program pointer.
+   Arguments: jit, code pointer, shared exit, pc of the LOADP, registers
+   Return: void
+*/
+static void emitLoadProgram(umJit * jit, uint8_t ** p, uint8_t * epilogue,
+                            uint32_t prgmPtr, regID b, regID c){
+    emitRegReg(p, 0x85, pinned[b], pinned[b]);      /* test rb, rb */
+    emit8(p, 0x74); emit8(p, 15);                   /* jz over the exit */
+    emitExit(p, epilogue, JIT_EXIT, prgmPtr);
+    emitRegReg(p, 0x89, RAX, pinned[c]);            /* mov eax, rc */
+    emit8(p, 0x3D); emit32(p, jit->length);         /* cmp eax, length */
+    emitJump(p, 0x83, epilogue);                    /* jae exit */
+    emit8(p, 0x48); emit8(p, 0xB9);                 /* mov rcx, entries */
+    emit64(p, (uint64_t)(uintptr_t)jit->entries);
+    emit8(p, 0x48); emit8(p, 0x8B); emit8(p, 0x0C);
+    emit8(p, 0xC1);                                 /* mov rcx,[rcx+rax*8]*/
+    emit8(p, 0x48); emit8(p, 0x85); emit8(p, 0xC9); /* test rcx, rcx */
+    emitJump(p, 0x84, epilogue);                    /* jz exit */
+    emit8(p, 0x48); emit8(p, 0x83); emit8(p, 0xC1);
+    emit8(p, (uint8_t)jit->prologueSize);           /* add rcx, prologue */
+    emit8(p, 0xFF); emit8(p, 0xE1);                 /* jmp rcx */
+}
+
+/* Name: emitInstruct
+   Purpose: emits native code for one instruction that stays in the block
+   Arguments: code pointer, shared exit, pc of the instruction, the word
+   Return: void
+*/
+static void emitInstruct(uint8_t ** p, uint8_t * epilogue, uint32_t prgmPtr,
+                         umInstruction next){
+    regID a = UM_REGA(next);
+    regID b = UM_REGB(next);
+    regID c = UM_REGC(next);
+    regID args[3] = { a, b, c };
+
+    switch(UM_OPCODE(next)){
+        case CMOV:
+            emitRegReg(p, 0x85, pinned[c], pinned[c]);  /* test rc, rc */
+            emitRegReg2(p, 0x45, pinned[b], pinned[a]); /* cmovne ra, rb */
+            break;
+
+        case SLOAD:
+            emitHelperCall(p, (void *)jitSegLoad, 2, args + 1);
+            emit8(p, 0x48); emit8(p, 0x0F); emit8(p, 0xBA);
+            emit8(p, 0xE0); emit8(p, 32);              /* bt rax, 32 */
+            emit8(p, 0x73); emit8(p, 15);              /* jnc over the exit */
+            emitExit(p, epilogue, JIT_EXIT, prgmPtr);
+            emitRegReg(p, 0x89, pinned[a], RAX);
+            break;
+
+        case SSTORE:
+            emitHelperCall(p, (void *)jitSegStore, 3, args);
+            emit8(p, 0x83); emit8(p, 0xF8);
+            emit8(p, JIT_STORE_FAULT);                 /* cmp eax, fault */
+            emit8(p, 0x75); emit8(p, 15);              /* jne over the exit */
+            emitExit(p, epilogue, JIT_EXIT, prgmPtr);
+            emit8(p, 0x85); emit8(p, 0xC0);            /* test eax, eax */
+            emit8(p, 0x74); emit8(p, 15);              /* jz over the exit */
+            emitExit(p, epilogue, JIT_FLUSH, prgmPtr + 1);
+            break;
+
+        case ADD:
+            emitRegReg(p, 0x89, RAX, pinned[b]);
+            emitRegReg(p, 0x01, RAX, pinned[c]);
+            emitRegReg(p, 0x89, pinned[a], RAX);
+            break;
+
+        case MUL:
+            emitRegReg(p, 0x89, RAX, pinned[b]);
+            emitRegReg2(p, 0xAF, pinned[c], RAX);
+            emitRegReg(p, 0x89, pinned[a], RAX);
+            break;
+
+        case DIV:
+            emitRegReg(p, 0x89, RAX, pinned[b]);
+            emitRegReg(p, 0x31, RDX, RDX);
+            emitUnary(p, 6, pinned[c]);
+            emitRegReg(p, 0x89, pinned[a], RAX);
+            break;
+
+        case NAND:
+            emitRegReg(p, 0x89, RAX, pinned[b]);
+            emitRegReg(p, 0x21, RAX, pinned[c]);
+            emitUnary(p, 2, RAX);
+            emitRegReg(p, 0x89, pinned[a], RAX);
+            break;
+
+        case MAP:
+            emitSpilledCall(p, (void *)jitMapSeg, b, c);
+            break;
+
+        case UNMAP:
+            emitSpilledCall(p, (void *)jitUnmapSeg, b, c);
+            break;
+
+        case LV:
+            emitMovImm(p, pinned[UM_REGAprime(next)], UM_VALUE(next));
+            break;
+
+        default:
+            assert(0);
+    }
+}
+
+/* Name: compilable
+   Purpose: check if an instruction can stay inside a compiled block
+   Arguments: a UM instruction
+   Return: int -- 1 if it can, 0 if the block has to end before it
+*/
+static inline int compilable(umInstruction next){
+    switch(UM_OPCODE(next)){
+        case HALT: case OUT: case IN: return 0;
+        default: return UM_OPCODE(next) <= LV;
+    }
+}
+
+/* Name: flushCode
+   Purpose: throws away every compiled block. only the pcs a LOADP landed
+            on have counts or blocks, and a block covers a run of words
+            from its start, so clearing them clears everything.
+   Arguments: jit
+   Return: void
+*/
+static void flushCode(umJit * jit){
+    jit->used = 0;
+    for (uint32_t i = 0; i < jit->landings; i++){
+        uint32_t pc = jit->landed[i];
+        jit->entries[pc] = NULL;
+        jit->counts[pc] = 0;
+        while (pc < jit->length && jit->covered[pc]){
+            jit->covered[pc++] = 0;
+        }
+    }
+    jit->landings = 0;
+}
+
+/* Name: selfModified
+   Purpose: flushes every compiled block after the program overwrote one of
+            them. a program that keeps doing so is left to the interpreter.
+   Arguments: jit
+   Return: void
+*/
+static void selfModified(umJit * jit){
+    flushCode(jit);
+    if (++jit->flushes == JIT_MAX_FLUSHES){
+        jit->disabled = 1;
+    }
+}
+
+/* Name: compileBlock
+   Purpose: compiles the basic block starting at a given pc of segment 0
+   Arguments: jit, segment 0, pc of the first instruction
+   Return: entry point of the block, NULL if it can't be compiled
+*/
+static uint8_t * compileBlock(umJit * jit, Segment zero, uint32_t start){
+    if (JIT_CODE_SIZE - jit->used < JIT_BLOCK_ROOM){
+        flushCode(jit);
+    }
+    if (!compilable(zero[start])){
+        jit->counts[start] = JIT_NEVER;
+        return NULL;
+    }
+
+    uint8_t * p = jit->base + jit->used;
+    uint8_t * epilogue = p;
+    emitEpilogue(&p);
+    uint8_t * entry = p;
+    emitPrologue(&p);
+    assert((size_t)(p - entry) == jit->prologueSize);
+
+    uint32_t pc = start;
+    for (int n = 0; ; n++, pc++){
+        if (pc >= jit->length || !compilable(zero[pc])){
+            emitExit(&p, epilogue, JIT_EXIT, pc);
+            break;
+        }
+        if (n == JIT_MAX_BLOCK){
+            emitExit(&p, epilogue, JIT_CONTINUE, pc);
+            break;
+        }
+        jit->covered[pc] = 1;
+        if (UM_OPCODE(zero[pc]) == LOADP){
+            emitLoadProgram(jit, &p, epilogue, pc, UM_REGB(zero[pc]),
+                            UM_REGC(zero[pc]));
+            break;
+        }
+        emitInstruct(&p, epilogue, pc, zero[pc]);
+    }
+
+    jit->used = p - jit->base;
+    jit->entries[start] = entry;
+    return entry;
+}
+
+/*--------------------------------------------------------------------------*/
+/*                              the interface                               */
+/*--------------------------------------------------------------------------*/
+
+/* Name: newJit
+   Purpose: sets up the JIT for a program of a given length. the JIT is
+            optional, so failing to get executable memory is not an error.
+   Arguments: length of segment 0
+   Return: umJit pointer, NULL if the host can't run compiled code
+*/
+umJit * newJit(uint32_t programLength){
+    umJit * jit = calloc(1, sizeof(*jit));
+    assert(jit != NULL);
+    jit->base = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (jit->base == MAP_FAILED){
+        free(jit);
+        return NULL;
+    }
+
+    uint8_t scratch[64];
+    uint8_t * p = scratch;
+    emitPrologue(&p);
+    jit->prologueSize = p - scratch;
+
+    jitReset(jit, programLength);
+    return jit;
+}
+
+/* Name: jitReset
+   Purpose: forgets all compiled code when a new program is loaded. the
+            tables are kept if the program fits them. a JIT that gave up
+            on a self-modifying program stays given up.
+   Arguments: jit, length of the new segment 0
+   Return: void
+*/
+void jitReset(umJit * jit, uint32_t programLength){
+    if (jit == NULL){
+        return;
+    }
+    if (jit->entries != NULL && programLength <= jit->capacity){
+        flushCode(jit);
+        jit->length = programLength;
+        return;
+    }
+    free(jit->entries);
+    free(jit->counts);
+    free(jit->covered);
+    free(jit->landed);
+    jit->length = programLength;
+    jit->capacity = programLength;
+    jit->entries = calloc((size_t)programLength + 1, sizeof(*jit->entries));
+    jit->counts = calloc((size_t)programLength + 1, sizeof(*jit->counts));
+    jit->covered = calloc((size_t)programLength + 1, 1);
+    jit->landed = malloc(((size_t)programLength + 1) * sizeof(*jit->landed));
+    assert(jit->entries != NULL && jit->counts != NULL &&
+           jit->covered != NULL && jit->landed != NULL);
+    jit->landings = 0;
+    jit->used = 0;
+}
+
+/* Name: freeJit
+   Purpose: frees the JIT and its executable memory
+   Arguments: jit
+   Return: void
+*/
+void freeJit(umJit * jit){
+    if (jit == NULL){
+        return;
+    }
+    munmap(jit->base, JIT_CODE_SIZE);
+    free(jit->entries);
+    free(jit->counts);
+    free(jit->covered);
+    free(jit->landed);
+    free(jit);
+}
+
+/* Name: jitWordChanged
+   Purpose: called when a word of segment 0 is overwritten. if the word was
+            compiled, all compiled code is flushed.
+   Arguments: jit, offset of the word
+   Return: void
+*/
+void jitWordChanged(umJit * jit, uint32_t offset){
+    if (jit == NULL || jit->disabled || !jit->covered[offset]){
+        return;
+    }
+    selfModified(jit);
+}
+
+/* Name: jitRun
+   Purpose: runs compiled code from a pc that a LOADP landed on, compiling
+            the block there once it is hot. returns once it reaches code
+            the interpreter has to run.
+   Arguments: jit, context, program pointer
+   Return: program pointer the interpreter carries on from
+*/
+uint32_t jitRun(umJit * jit, umJitContext * ctx, uint32_t prgmPtr){
+    if (jit == NULL || jit->disabled){
+        return prgmPtr;
+    }
+    assert(ctx != NULL);
+    ctx->jit = jit;
+
+    for (;;){
+        if (prgmPtr >= jit->length){
+            return prgmPtr;
+        }
+        uint8_t * entry = jit->entries[prgmPtr];
+        if (entry == NULL){
+            if (jit->counts[prgmPtr] == 0){
+                jit->landed[jit->landings++] = prgmPtr;
+            }
+            if (jit->counts[prgmPtr] == JIT_NEVER ||
+                ++jit->counts[prgmPtr] < JIT_HOT){
+                return prgmPtr;
+            }
+            entry = compileBlock(jit, getSegment(ctx->memory, 0), prgmPtr);
+            if (entry == NULL){
+                return prgmPtr;
+            }
+        }
+
+        uint64_t result = ((jitBlock)(void *)entry)(ctx);
+        prgmPtr = (uint32_t)result;
+        switch(result >> 32){
+            case JIT_CONTINUE:
+                break;
+            case JIT_FLUSH:
+                selfModified(jit);
+                return prgmPtr;
+            default:
+                return prgmPtr;
+        }
+    }
+}
+
+#else
+
+umJit * newJit(uint32_t programLength){
+    (void)programLength;
+    return NULL;
+}
+
+void jitReset(umJit * jit, uint32_t programLength){
+    (void)jit;
+    (void)programLength;
+}
+
+void freeJit(umJit * jit){
+    (void)jit;
+}
+
+void jitWordChanged(umJit * jit, uint32_t offset){
+    (void)jit;
+    (void)offset;
+}
+
+uint32_t jitRun(umJit * jit, umJitContext * ctx, uint32_t prgmPtr){
+    (void)jit;
+    (void)ctx;
+    return prgmPtr;
+}
+
+#endif
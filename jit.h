@@ -0,0 +1,44 @@
+/* Authors: John Little (jlittl04) & Aryan Pandey (apande04)
+ * Date: November 2019
+ * The Universal Machine
+ * File: jit.h - header file for the x86-64 JIT package
+ */
+
+#ifndef JIT_H
+#define JIT_H
+
+#include <stdlib.h>
+#include <inttypes.h>
+#include "memory.h"
+
+/* the JIT is only built for x86-64 hosts. -DUM_NO_JIT leaves it out, in 
+ * which case newJit always hands back NULL and the interpreter runs alone.
+ */
+#if defined(__x86_64__) && !defined(UM_NO_JIT)
+#define UM_JIT 1
+#else
+#define UM_JIT 0
+#endif
+
+typedef struct umJit umJit;
+
+/* everything compiled code and the helpers it calls back into need. the 
+ * registers pointer must stay the first member: compiled blocks load the 
+ * UM registers through it.
+ */
+typedef struct umJitContext {
+        word * registers;
+        segTable * memory;
+        umJit * jit;
+} umJitContext;
+
+/* creating, resetting and freeing the JIT */
+umJit * newJit(uint32_t programLength);
+void jitReset(umJit * jit, uint32_t programLength);
+void freeJit(umJit * jit);
+
+/* running compiled blocks and keeping them in line with segment 0 */
+uint32_t jitRun(umJit * jit, umJitContext * ctx, uint32_t prgmPtr);
+void jitWordChanged(umJit * jit, uint32_t offset);
+
+#endif
@@ -0,0 +1,246 @@
+/* Authors: John Little (jlittl04) & Aryan Pandey (apande04)
+ * Date: November 2019
+ * The Universal Machine
+ * File: libum.c - implementation for the UM library
+ *
+ * the library builds every engine from engine.h and picks one for each 
+ * run: the profiling engine when the machine has a profile, the checked
+ * engine when it was made with UM_CHECKED, the budgeted engine for runs
+ * with a budget and the plain engine (with the JIT, if asked for) for 
+ * runs without one. only the plain engine keeps the JIT's compiled code in
+ * line with segment 0, so running on any other engine flushes it first.
+ */
+
+#include <assert.h>
+#include <string.h>
+
+#include "machine.h"
+#include "instructions.h"
+#include "decode.h"
+#include "loader.h"
+
+#define ENGINE_NAME runPlain
+#define ENGINE_PROFILE 0
+#define ENGINE_CHECKED 0
+#define ENGINE_COUNT 0
+#define ENGINE_BUDGET 0
+#include "engine.h"
+
+#define ENGINE_NAME runBudgeted
+#define ENGINE_PROFILE 0
+#define ENGINE_CHECKED 0
+#define ENGINE_COUNT 0
+#define ENGINE_BUDGET 1
+#include "engine.h"
+
+#define ENGINE_NAME runCounted
+#define ENGINE_PROFILE 0
+#define ENGINE_CHECKED 0
+#define ENGINE_COUNT 1
+#define ENGINE_BUDGET 1
+#include "engine.h"
+
+#define ENGINE_NAME runProfiled
+#define ENGINE_PROFILE 1
+#define ENGINE_CHECKED 0
+#define ENGINE_COUNT 0
+#define ENGINE_BUDGET 1
+#include "engine.h"
+
+#define ENGINE_NAME runChecked
+#define ENGINE_PROFILE 0
+#define ENGINE_CHECKED 1
+#define ENGINE_COUNT 0
+#define ENGINE_BUDGET 1
+#include "engine.h"
+
+/* Name: umNew
+   Purpose: creates a machine with no program yet
+   Arguments: flags (UM_USE_JIT, UM_CHECKED)
+   Return: umMachine pointer (free with umFree)
+*/
+umMachine * umNew(unsigned flags){
+    umMachine * m = calloc(1, sizeof(*m));
+    assert(m != NULL);
+    m->memory = newTable();
+    m->flags = flags;
+    return m;
+}
+
+/* Name: umLoadSegment
+   Purpose: makes a segment the machine's program, to run from its first
+            word. the machine must not have one yet.
+   Arguments: machine, program segment (the machine takes it over)
+   Return: void
+*/
+void umLoadSegment(umMachine * m, Segment program){
+    assert(m != NULL && program != NULL);
+    assert(m->memory->count == 0);
+    putSegment(m->memory, chooseID(m->memory), program);
+    m->pc = 0;
+}
+
+/* Name: umLoadImage
+   Purpose: loads a .um image as the machine's program (see loader.h; 
+            like ./um, this exits if the image can't be read)
+   Arguments: machine, image path (- for stdin)
+   Return: void
+*/
+void umLoadImage(umMachine * m, const char * path){
+    umLoadSegment(m, loadImage(path));
+}
+
+/* Name: umLoadBytes
+   Purpose: loads a program from an image already in memory
+   Arguments: machine, image bytes (big-endian words, as in a .um file),
+              byte count
+   Return: int -- 0, or -1 if the byte count isn't a whole number of words
+*/
+int umLoadBytes(umMachine * m, const unsigned char * bytes, size_t length){
+    if (length % sizeof(word) != 0 || length / sizeof(word) > UINT32_MAX){
+        return -1;
+    }
+    uint32_t count = (uint32_t)(length / sizeof(word));
+    Segment program = rawSegment(count);
+    swapWords(program, bytes, count);
+    umLoadSegment(m, program);
+    return 0;
+}
+
+/* Name: umRestore
+   Purpose: loads the machine from the newest checkpoint in a snapshot 
+            file (see restoreSnapshot), exiting if it can't
+   Arguments: machine, path, whether restored segments count as already
+              checkpointed, where to put the size of the complete 
+              checkpoints
+   Return: void
+*/
+void umRestore(umMachine * m, const char * path, int keepClean, 
+               uint64_t * end){
+    assert(m != NULL && m->memory->count == 0);
+    m->pc = restoreSnapshot(path, m->memory, m->registers, keepClean, end);
+}
+
+/* Name: umSetIO
+   Purpose: gives the machine the umIO its IN and OUT go through
+   Arguments: machine, umIO (still owned by the caller)
+   Return: void
+*/
+void umSetIO(umMachine * m, umIO * io){
+    assert(m != NULL);
+    m->io = io;
+}
+
+/* Name: umSetSnapshot
+   Purpose: has the machine write checkpoints (see snapshot.h)
+   Arguments: machine, snapshot or NULL (still owned by the caller)
+   Return: void
+*/
+void umSetSnapshot(umMachine * m, umSnapshot * snap){
+    assert(m != NULL);
+    m->snap = snap;
+}
+
+/* Name: umSetProfile
+   Purpose: has the machine run on the profiling engine (see profile.h)
+   Arguments: machine, profile or NULL (still owned by the caller)
+   Return: void
+*/
+void umSetProfile(umMachine * m, umProfile * prof){
+    assert(m != NULL);
+    m->prof = prof;
+}
+
+/* Name: umSetTelemetry
+   Purpose: has the machine run on the counting engine and publish its 
+            counters each time a run ends (see telemetry.h); a profile or
+            the checked engine takes precedence
+   Arguments: machine, telemetry or NULL (still owned by the caller)
+   Return: void
+*/
+void umSetTelemetry(umMachine * m, umTelemetry * tele){
+    assert(m != NULL);
+    m->tele = tele;
+}
+
+/* Name: umRun
+   Purpose: runs the machine from where it last stopped. a machine that 
+            has halted stays halted; one that blocked re-runs the IN.
+   Arguments: machine (loaded, with a umIO), most instructions to run (0
+              for no limit; an IN that blocks doesn't count)
+   Return: umStatus -- why it stopped
+*/
+umStatus umRun(umMachine * m, uint64_t budget){
+    assert(m != NULL && m->io != NULL && m->memory->count > 0);
+    if (m->halted){
+        return UM_HALTED;
+    }
+
+    int counting = m->prof != NULL || (m->flags & UM_CHECKED) || 
+                   m->tele != NULL || budget;
+    m->budget = budget ? budget : UINT64_MAX;
+    if (!counting && (m->flags & UM_USE_JIT) && m->jit == NULL){
+        m->jit = newJit(segLength(getSegment(m->memory, 0)));
+    }
+
+    /* an invalid load or store in an unchecked engine comes back here */
+    umStatus status;
+    umTrap trap;
+    trapEnter(&trap);
+    if (sigsetjmp(trap.jump, 0) != 0){
+        m->fault = accessFault(m->memory, m->registers, m->trapPc);
+        m->pc = m->trapPc;
+        status = UM_FAULT;
+    }
+    else if (m->prof != NULL){
+        status = runProfiled(m);
+    }
+    else if (m->flags & UM_CHECKED){
+        status = runChecked(m);
+    }
+    else if (m->tele != NULL){
+        status = runCounted(m);
+    }
+    else if (budget != 0){
+        status = runBudgeted(m);
+    }
+    else {
+        status = runPlain(m);
+    }
+    trapLeave(&trap);
+    if (counting){
+        /* segment 0 may have changed under compiled code */
+        jitReset(m->jit, segLength(getSegment(m->memory, 0)));
+    }
+    m->halted = (status == UM_HALTED || status == UM_FAULT);
+    if (m->tele != NULL){
+        telemetryPublish(m->tele, m, status);
+    }
+    return status;
+}
+
+/* Name: umFaultReport
+   Purpose: writes the machine's pending output, then reports the fault it
+            stopped at (see faultReport)
+   Arguments: machine (whose last run returned UM_FAULT), stream
+   Return: void
+*/
+void umFaultReport(umMachine * m, FILE * fp){
+    assert(m != NULL && m->halted);
+    ioFlush(m->io);
+    faultReport(fp, &m->fault, m->memory, m->registers);
+}
+
+/* Name: umFree
+   Purpose: frees the machine, its memory and its JIT
+   Arguments: machine
+   Return: void
+*/
+void umFree(umMachine * m){
+    if (m == NULL){
+        return;
+    }
+    freeJit(m->jit);
+    halt(m->memory);
+    free(m);
+}
@@ -0,0 +1,58 @@
+/* Authors: John Little (jlittl04) & Aryan Pandey (apande04)
+ * Date: November 2019
+ * The Universal Machine
+ * File: libum.h - header file for the UM library
+ */
+
+#ifndef LIBUM_H
+#define LIBUM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include "umio.h"
+
+/* see profile.h, snapshot.h and telemetry.h */
+struct umProfile;
+struct umSnapshot;
+struct umTelemetry;
+
+/* the machine as a library: a host creates as many machines as it likes,
+ * loads each one, gives it a umIO (file descriptors or callbacks, see 
+ * umio.h) and runs it for as many instructions at a time as it wants. 
+ * ./um is one such host. a machine is only ever run by one thread at a 
+ * time, but may move between threads from one run to the next.
+ */
+typedef struct umMachine umMachine;
+
+/* why umRun came back */
+typedef enum umStatus {
+        UM_HALTED = 0,  /* ran HALT, or (unchecked) an invalid instruction */
+        UM_BLOCKED,     /* at an IN whose input hasn't arrived yet */
+        UM_BUDGET,      /* ran every instruction it was given */
+        UM_FAULT        /* see umFaultReport (and fault.h) */
+} umStatus;
+
+/* flags for umNew */
+#define UM_USE_JIT 1u   /* compile hot code (runs without a budget only) */
+#define UM_CHECKED 2u   /* look for faults (see fault.h) */
+
+/* creating, loading and freeing (umFree leaves the umIO to its owner) */
+umMachine * umNew(unsigned flags);
+void umLoadImage(umMachine * m, const char * path);
+int umLoadBytes(umMachine * m, const unsigned char * bytes, size_t length);
+void umRestore(umMachine * m, const char * path, int keepClean, 
+               uint64_t * end);
+void umFree(umMachine * m);
+
+/* wiring up */
+void umSetIO(umMachine * m, umIO * io);
+void umSetSnapshot(umMachine * m, struct umSnapshot * snap);
+void umSetProfile(umMachine * m, struct umProfile * prof);
+void umSetTelemetry(umMachine * m, struct umTelemetry * tele);
+
+/* running */
+umStatus umRun(umMachine * m, uint64_t budget);
+void umFaultReport(umMachine * m, FILE * fp);
+
+#endif
@@ -0,0 +1,238 @@
+/* Authors: John Little (jlittl04) & Aryan Pandey (apande04)
+ * Date: November 2019
+ * The Universal Machine
+ * File: loader.c - implementation for the program loader package
+ *
+ * regular files are mmap'd and converted from big-endian to host order in
+ * one pass, straight into the new segment. anything else (stdin, pipes,
+ * character devices) is read in large chunks first. "-" names stdin.
+ * either may be a cached image instead (see umx.h), which is unpacked
+ * rather than converted; and an image with an up to date cache beside it
+ * is loaded from the cache.
+ */
+
+#include "loader.h"
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "umx.h"
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define READ_CHUNK (1u << 20)
+
+/* Name: loadFailed
+   Purpose: reports why an image couldn't be loaded and exits
+   Arguments: path of the image, reason
+   Return: does not return
+*/
+static void loadFailed(const char * path, const char * why){
+    fprintf(stderr, "um: cannot load %s: %s\n", path, why);
+    exit(EXIT_FAILURE);
+}
+
+/* Name: swapWords
+   Purpose: converts big-endian words to host order, 16 bytes at a time 
+            where the host has SIMD byte shuffles
+   Arguments: destination words, source bytes, number of words
+   Return: void
+*/
+void swapWords(word * trgt, const unsigned char * src, size_t count){
+    size_t i = 0;
+#if defined(__SSSE3__)
+    const __m128i order = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4,
+                                        11, 10, 9, 8, 15, 14, 13, 12);
+    for (; i + 4 <= count; i += 4){
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i * 4));
+        _mm_storeu_si128((__m128i *)(trgt + i), _mm_shuffle_epi8(v, order));
+    }
+#elif defined(__SSE2__)
+    for (; i + 4 <= count; i += 4){
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i * 4));
+        /* swap the bytes of each half word, then the halves of each word */
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        v = _mm_shufflelo_epi16(v, 0xB1);
+        v = _mm_shufflehi_epi16(v, 0xB1);
+        _mm_storeu_si128((__m128i *)(trgt + i), v);
+    }
+#endif
+    for (; i < count; i++){
+        const unsigned char * b = src + i * 4;
+        trgt[i] = ((word)b[0] << 24) | ((word)b[1] << 16) | 
+                  ((word)b[2] << 8) | (word)b[3];
+    }
+}
+
+/* Name: wordCount
+   Purpose: checks that an image is a whole number of 32 bit words that 
+            fits in a segment
+   Arguments: path of the image, its size in bytes
+   Return: uint32_t -- number of words
+*/
+static uint32_t wordCount(const char * path, size_t length){
+    if (length % sizeof(word) != 0){
+        loadFailed(path, "size is not a whole number of instructions");
+    }
+    if (length / sizeof(word) > UINT32_MAX){
+        loadFailed(path, "too large for a segment");
+    }
+    return (uint32_t)(length / sizeof(word));
+}
+
+/* Name: fromBytes
+   Purpose: makes segment 0 from the bytes of an image, or of a cache read
+            from a stream
+   Arguments: path of the file, its bytes, byte count
+   Return: Segment
+*/
+static Segment fromBytes(const char * path, const unsigned char * bytes, 
+                         size_t length){
+    if (isCache(bytes, length)){
+        const char * why;
+        Segment zero = readCache(bytes, length, NULL, &why);
+        if (zero == NULL){
+            loadFailed(path, why);
+        }
+        return zero;
+    }
+    uint32_t count = wordCount(path, length);
+    Segment zero = rawSegment(count);
+    swapWords(zero, bytes, count);
+    return zero;
+}
+
+/* Name: mapImage
+   Purpose: loads a regular file through mmap
+   Arguments: path of the image, open descriptor, its size in bytes
+   Return: Segment
+*/
+static Segment mapImage(const char * path, int fd, size_t length){
+    if (length == 0){
+        return rawSegment(0);
+    }
+
+    unsigned char * bytes = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (bytes == MAP_FAILED){
+        loadFailed(path, strerror(errno));
+    }
+    if (isCache(bytes, length)){
+        munmap(bytes, length);
+        const char * why;
+        Segment zero = mapCache(fd, length, NULL, &why);
+        if (zero == NULL){
+            loadFailed(path, why);
+        }
+        return zero;
+    }
+    madvise(bytes, length, MADV_SEQUENTIAL);
+    Segment zero = fromBytes(path, bytes, length);
+    munmap(bytes, length);
+
+    return zero;
+}
+
+/* Name: streamImage
+   Purpose: loads an image that can't be mapped (stdin, a pipe) by reading
+            it in large chunks
+   Arguments: path of the image, open descriptor
+   Return: Segment
+*/
+static Segment streamImage(const char * path, int fd){
+    size_t capacity = READ_CHUNK;
+    size_t length = 0;
+    unsigned char * bytes = malloc(capacity);
+    assert(bytes != NULL);
+
+    for (;;){
+        if (length == capacity){
+            capacity *= 2;
+            bytes = realloc(bytes, capacity);
+            assert(bytes != NULL);
+        }
+        ssize_t got = read(fd, bytes + length, capacity - length);
+        if (got < 0 && errno == EINTR){
+            continue;
+        }
+        if (got < 0){
+            loadFailed(path, strerror(errno));
+        }
+        if (got == 0){
+            break;
+        }
+        length += (size_t)got;
+    }
+
+    Segment zero = fromBytes(path, bytes, length);
+    free(bytes);
+
+    return zero;
+}
+
+/* Name: freshCache
+   Purpose: loads the cache beside an image (see cacheName), if there is 
+            one written from the image as it is now
+   Arguments: path of the image, its stat
+   Return: Segment, or NULL to load the image itself
+*/
+static Segment freshCache(const char * path, const struct stat * image){
+    char * name = cacheName(path);
+    int fd = open(name, O_RDONLY);
+    free(name);
+    if (fd < 0){
+        return NULL;
+    }
+
+    Segment zero = NULL;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)){
+        const char * why;
+        zero = mapCache(fd, (size_t)st.st_size, image, &why);
+    }
+    close(fd);
+    return zero;
+}
+
+/* Name: loadImage
+   Purpose: reads a .um image, or a cache of one, into a new segment (to
+            become segment 0)
+   Arguments: path of the image, "-" for stdin
+   Return: Segment
+*/
+Segment loadImage(const char * path){
+    assert(path != NULL);
+
+    int fd = 0;
+    if (strcmp(path, "-") != 0){
+        fd = open(path, O_RDONLY);
+        if (fd < 0){
+            loadFailed(path, strerror(errno));
+        }
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0){
+        loadFailed(path, strerror(errno));
+    }
+    Segment zero = NULL;
+    if (S_ISREG(st.st_mode) && fd != 0){
+        zero = freshCache(path, &st);
+    }
+    if (zero == NULL){
+        zero = S_ISREG(st.st_mode) ? mapImage(path, fd, (size_t)st.st_size) :
+                                     streamImage(path, fd);
+    }
+
+    if (fd != 0){
+        close(fd);
+    }
+    return zero;
+}
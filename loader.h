@@ -0,0 +1,20 @@
+/* Authors: John Little (jlittl04) & Aryan Pandey (apande04)
+ * Date: November 2019
+ * The Universal Machine
+ * File: loader.h - header file for the program loader package
+ */
+
+#ifndef LOADER_H
+#define LOADER_H
+
+#include <stdlib.h>
+#include <inttypes.h>
+#include "memory.h"
+
+/* reading a .um image (big-endian words) or a cached image (see umx.h)
+ * into a new segment
+ */
+Segment loadImage(const char * path);
+void swapWords(word * trgt, const unsigned char * src, size_t count);
+
+#endif
@@ -0,0 +1,42 @@
+/* Authors: John Little (jlittl04) & Aryan Pandey (apande04)
+ * Date: November 2019
+ * The Universal Machine
+ * File: machine.h - the state of a machine, inside the library
+ */
+
+#ifndef MACHINE_H
+#define MACHINE_H
+
+#include "libum.h"
+#include "memory.h"
+#include "fault.h"
+#include "jit.h"
+#include "profile.h"
+#include "snapshot.h"
+#include "telemetry.h"
+
+/* everything one machine is. hosts only see an opaque umMachine; the 
+ * engines (engine.h), the batch runner and the translated program runtime
+ * (aot/umrt.c) work on it directly. registers, pc and budget are where a
+ * run leaves them.
+ */
+struct umMachine {
+        segTable * memory;
+        word registers[REG_COUNT];
+        uint32_t pc;
+        unsigned flags;
+        int halted;
+        umIO * io;
+        umJit * jit;
+        umSnapshot * snap;
+        umProfile * prof;
+        umTelemetry * tele;
+        uint64_t budget;
+        umFaultInfo fault;
+        uint32_t trapPc;        /* of the last guarded load or store */
+};
+
+/* loading a segment 0 the caller built */
+void umLoadSegment(umMachine * m, Segment program);
+
+#endif
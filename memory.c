@@ -5,139 +5,483 @@
  */
 
 #include "memory.h"
+#include "decode.h"
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <unistd.h>
 
-/* Name: getWord 
-   Purpose: accesses a given segment and word offset. Returns that word 
-            retrieved from memory.
-   Arguments: segment id, offset, memory sequence
-   Return: word
+#define TABLE_HINT 8  /* slots in a new segment table */
+
+/* Name: newTable
+   Purpose: creates an empty segment table
+   Arguments: none
+   Return: segTable pointer (free with completeFree)
+*/
+segTable * newTable(void){
+    segTable * memory = malloc(sizeof(*memory));
+    assert(memory != NULL);
+    memory->slots = malloc(TABLE_HINT * sizeof(*memory->slots));
+    assert(memory->slots != NULL);
+    memory->count = 0;
+    memory->capacity = TABLE_HINT;
+    memory->freeID = SEG_NONE;
+    memory->live = 0;
+    memory->words = 0;
+    memory->guard = guardPage();
+
+    return memory;
+}
+
+/* Name: getSegment
+   Purpose: hands back the raw word block of a mapped segment
+   Arguments: segment table, segment id
+   Return: Segment
 */
-word getWordat(umSegmentID seg, uint32_t offset, Seq_T memory){
+Segment getSegment(segTable * memory, umSegmentID id){
     assert(memory != NULL);
-    /* access specified segment then the word withn that segment */
-    Segment sgmnt = (Segment) Seq_get(memory, (int)seg);
-    word * value = (word *) Seq_get(sgmnt, (int)offset);
+    assert(id < memory->count);
+    Segment sgmnt = memory->slots[id].sgmnt;
+    assert(sgmnt != NULL);
+
+    return sgmnt;
+}
+
+/* Name: putSegment
+   Purpose: puts a segment into a slot that chooseID handed out, replacing
+            whatever it held
+   Arguments: segment table, segment id, Segment
+   Return: void
+*/
+void putSegment(segTable * memory, umSegmentID id, Segment sgmnt){
+    assert(memory != NULL && sgmnt != NULL);
+    assert(id < memory->count);
+    segSlot * slot = &memory->slots[id];
+    if (slot->sgmnt == NULL){
+        memory->live++;
+    }
+    else {
+        memory->words -= slot->length;
+    }
+    slot->sgmnt = sgmnt;
+    slot->length = segLength(sgmnt);
+    memory->words += slot->length;
+}
+
+/* Name: segLength
+   Purpose: returns the number of words in a segment
+   Arguments: a Segment
+   Return: uint32_t
+*/
+uint32_t segLength(Segment sgmnt){
+    assert(sgmnt != NULL);
+    return SEG_HEADER(sgmnt)->length;
+}
+
+/*--------------------------------------------------------------------------*/
+/*                            the segment arena                             */
+/*--------------------------------------------------------------------------*/
+
+/* segment blocks of up to 2^(ARENA_CLASSES - 1) words are rounded up to a 
+ * power of two and, once unmapped, kept on a free list for their size 
+ * class instead of going back to malloc. larger blocks go straight to the
+ * system allocator. a freed block links to the next one through its first
+ * bytes. each thread has its own arena, so machines running on different
+ * threads never share a pool (a block goes back to the pool of the thread
+ * that frees it).
+ * zeroed segments over the lazy threshold skip the allocator altogether: 
+ * they are anonymous mappings, so MAP costs the same whatever the size and
+ * a page only takes memory once the program touches it.
+ */
+#define ARENA_CLASSES 17
+#define ARENA_MAX_HELD ((size_t)64 << 20)
+
+static uint32_t lazyWords = LAZY_WORDS_DEFAULT;
+
+static __thread struct {
+    segHeader * free[ARENA_CLASSES];
+    memStats stats;
+} arena;
+
+/* Name: sizeClass
+   Purpose: finds the size class of a segment (log 2 of its word count,
+            rounded up)
+   Arguments: word count
+   Return: int
+*/
+static inline int sizeClass(uint32_t wordCount){
+    if (wordCount <= 1){
+        return 0;
+    }
+    return 32 - __builtin_clz(wordCount - 1);
+}
 
-    return *value;
+/* Name: classBytes
+   Purpose: size of the block backing every segment of a size class
+   Arguments: size class
+   Return: size_t
+*/
+static inline size_t classBytes(int sizeCls){
+    return sizeof(segHeader) + ((size_t)1 << sizeCls) * sizeof(word);
+}
+
+/* Name: setLazyThreshold
+   Purpose: sets how big a zeroed segment has to be to be mapped lazily
+   Arguments: word count (segments of more words than this are lazy)
+   Return: void
+*/
+void setLazyThreshold(uint32_t wordCount){
+    lazyWords = wordCount;
+}
+
+/* Name: lazyBytes
+   Purpose: size of the mapping backing a lazy segment
+   Arguments: word count
+   Return: size_t
+*/
+static inline size_t lazyBytes(uint32_t wordCount){
+    return sizeof(segHeader) + (size_t)wordCount * sizeof(word);
+}
+
+/* Name: blockAlloc
+   Purpose: hands out a block for a segment, reusing a pooled block of the 
+            right size class when there is one. the words are zeroed in one
+            go when asked to -- or, past the lazy threshold, left to the 
+            kernel's demand-zero pages.
+   Arguments: word count, zero flag
+   Return: Segment
+*/
+static Segment blockAlloc(uint32_t wordCount, int zero){
+    int sizeCls = sizeClass(wordCount);
+    segHeader * block = NULL;
+    uint32_t flags = SEG_DIRTY;
+    arena.stats.allocations++;
+
+    if (zero && wordCount > lazyWords){
+        block = mmap(NULL, lazyBytes(wordCount), PROT_READ | PROT_WRITE, 
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        block = block == MAP_FAILED ? NULL : block;
+        flags |= SEG_LAZY;
+        arena.stats.lazy++;
+    }
+    else if (sizeCls >= ARENA_CLASSES){
+        size_t bytes = sizeof(*block) + (size_t)wordCount * sizeof(word);
+        block = zero ? calloc(1, bytes) : malloc(bytes);
+        arena.stats.large++;
+    }
+    else if (arena.free[sizeCls] != NULL){
+        block = arena.free[sizeCls];
+        arena.free[sizeCls] = *(segHeader **)block;
+        arena.stats.hits++;
+        arena.stats.bytesHeld -= classBytes(sizeCls);
+        if (zero){
+            memset(block + 1, 0, (size_t)wordCount * sizeof(word));
+        }
+    }
+    else {
+        block = zero ? calloc(1, classBytes(sizeCls)) : 
+                       malloc(classBytes(sizeCls));
+        arena.stats.misses++;
+    }
+    assert(block != NULL);
+
+    memset(block, 0, sizeof(*block));
+    block->length = wordCount;
+    block->refs = 1;
+    block->flags = flags;
+    return (Segment)(block + 1);
+}
+
+/* Name: blockFree
+   Purpose: returns a segment's block to the pool for its size class, or to
+            the system if it is large or the pool is full
+   Arguments: segment header
+   Return: void
+*/
+static void blockFree(segHeader * block){
+    /* a block inside a restored snapshot goes away with its mapping */
+    if (block->flags & SEG_MAPPED){
+        return;
+    }
+    if (block->flags & SEG_LAZY){
+        munmap(block, lazyBytes(block->length));
+        return;
+    }
+    int sizeCls = sizeClass(block->length);
+    if (sizeCls >= ARENA_CLASSES || 
+        arena.stats.bytesHeld + classBytes(sizeCls) > ARENA_MAX_HELD){
+        free(block);
+        return;
+    }
+
+    *(segHeader **)block = arena.free[sizeCls];
+    arena.free[sizeCls] = block;
+    arena.stats.bytesHeld += classBytes(sizeCls);
+    if (arena.stats.bytesHeld > arena.stats.peakHeld){
+        arena.stats.peakHeld = arena.stats.bytesHeld;
+    }
+}
+
+/* Name: releaseArena
+   Purpose: gives every block pooled by the calling thread back to the 
+            system. the pool never holds more than ARENA_MAX_HELD bytes, 
+            so machines are freed without it; a thread that is done 
+            running machines calls it before it exits.
+   Arguments: none
+   Return: void
+*/
+void releaseArena(void){
+    for (int i = 0; i < ARENA_CLASSES; i++){
+        while (arena.free[i] != NULL){
+            segHeader * block = arena.free[i];
+            arena.free[i] = *(segHeader **)block;
+            free(block);
+        }
+    }
+    arena.stats.bytesHeld = 0;
+}
+
+/* Name: getMemStats
+   Purpose: reports how the calling thread's segment arena has been doing
+   Arguments: none
+   Return: memStats
+*/
+memStats getMemStats(void){
+    return arena.stats;
+}
+
+/* Name: newSegment
+   Purpose: allocates a new segment with every word zeroed
+   Arguments: word count
+   Return: Segment
+*/
+Segment newSegment(uint32_t wordCount){
+    return blockAlloc(wordCount, 1);
+}
+
+/* Name: rawSegment
+   Purpose: allocates a new segment without zeroing its words, for callers
+            that fill in every word themselves
+   Arguments: word count
+   Return: Segment
+*/
+Segment rawSegment(uint32_t wordCount){
+    return blockAlloc(wordCount, 0);
+}
+
+/* Name: copySegment
+   Purpose: makes a private deep copy of a segment's words
+   Arguments: a Segment
+   Return: Segment
+*/
+Segment copySegment(Segment sgmnt){
+    assert(sgmnt != NULL);
+    uint32_t len = segLength(sgmnt);
+    Segment copy = rawSegment(len);
+    memcpy(copy, sgmnt, (size_t)len * sizeof(word));
+
+    return copy;
+}
+
+/* Name: placeSegment
+   Purpose: makes a segment out of a block that is already in memory (a 
+            restored snapshot), with room for the header just before the
+            words. the block is never given to the arena.
+   Arguments: start of the block (header included), word count
+   Return: Segment
+*/
+Segment placeSegment(void * place, uint32_t wordCount){
+    assert(place != NULL);
+    segHeader * block = place;
+    memset(block, 0, sizeof(*block));
+    block->length = wordCount;
+    block->refs = 1;
+    block->flags = SEG_MAPPED;
+    return (Segment)(block + 1);
+}
+
+/* Name: shareSegment
+   Purpose: puts a segment into the segment 0 slot without copying it. the
+            two slots share one block until either one is written.
+   Arguments: memory sequence, segment id
+   Return: void
+*/
+void shareSegment(segTable * memory, umSegmentID id){
+    assert(memory != NULL);
+    assert(id != 0);
+
+    Segment src = getSegment(memory, id);
+    SEG_HEADER(src)->refs++;
+    SEG_HEADER(src)->twin = id;
+    SEG_HEADER(src)->flags |= SEG_DIRTY;
+    deallocate(getSegment(memory, 0));
+    putSegment(memory, 0, src);
+}
+
+/* Name: unshare
+   Purpose: ends the sharing of a block before it is written. the non-zero
+            slot always takes the copy, so segment 0 (and its decoded 
+            records) never move on a store.
+   Arguments: segment table, a shared Segment
+   Return: void
+*/
+static void unshare(segTable * memory, Segment sgmnt){
+    segHeader * header = SEG_HEADER(sgmnt);
+    assert(header->refs == 2);
+
+    putSegment(memory, header->twin, copySegment(sgmnt));
+    header->refs--;
 }
 
 /* Name: deallocate
-   Purpose: deallocates each word in a given segment and the segment itself
+   Purpose: drops one slot's hold on a segment. once no slot holds it, the
+            segment, its header and its decoded records are freed.
    Arguments: a Segment 
    Return: void 
 */
 void deallocate(Segment sgmnt){
     assert(sgmnt != NULL);
-    int len = Seq_length(sgmnt);
-    /* free each word in segment */
-    for (int i = 0; i < len; i++){
-        free((word *)Seq_get(sgmnt, i));
+    segHeader * header = SEG_HEADER(sgmnt);
+    if (--header->refs == 0){
+        if (!(header->flags & SEG_SHARED_CODE)){
+            freeDecoded(header->code);
+        }
+        blockFree(header);
     }
-    Seq_free(&sgmnt);
 }
 
 /* Name: completeFree
    Purpose: completely frees all memory associated with the 
-            machine (except the FILE * in main). This includes the sequence
-            of available segment IDs and the main memory block itself. 
-   Arguments: memory sequence, segIDs sequence
+            machine. This includes the segment table and every segment in
+            it. the segments' blocks go to the pool for the next machine
+            on this thread (see releaseArena).
+   Arguments: segment table
    Return: void
 */
-void completeFree(Seq_T memory, Seq_T segIDs){
+void completeFree(segTable * memory){
     assert(memory != NULL);
-    assert(segIDs != NULL);
 
     /* free each segment in memory */
-    int len = Seq_length(memory);
-    for (int i = 0; i < len; i++){
-        Seq_T thing = Seq_get(memory, i);
+    for (uint32_t i = 0; i < memory->count; i++){
+        Segment thing = memory->slots[i].sgmnt;
         if (thing != NULL){
             deallocate(thing);
         }
     }
-    Seq_free(&memory);
-
-    /* free each unused segment ID */
-    int length = Seq_length(segIDs);
-    for (int i = 0; i < length; i++) {
-        free((umSegmentID *) Seq_get(segIDs, i));
-    }
-    Seq_free(&segIDs);
+    free(memory->slots);
+    free(memory);
 }
 
 /* Name: allocate
    Purpose: allocate a block of memory with enough word spaces and a given 
             ID. 
-   Arguments: word count, a segment ID, and memory sequence
+   Arguments: word count, a segment ID (from chooseID), and segment table
    Return: void
 */
-void allocate(uint32_t wordCount, umSegmentID id, Seq_T memory){
+void allocate(uint32_t wordCount, umSegmentID id, segTable * memory){
     assert(memory != NULL);
 
-    /* allocated a new block of size word for each word we want */
-    Segment seg = Seq_new(wordCount);
-    for (uint32_t i = 0; i < wordCount; i++){
-        word * thing = malloc(sizeof(word));
-        assert(thing != NULL);
-        Seq_addhi(seg, thing);
-        *thing = 0;
-    }
-
-    /* add new segment to memory -- avoid triggering Hanson assert */
-    if(id == (uint32_t)Seq_length(memory)){
-        Seq_addhi(memory, seg);
-    }
-    else{
-        Seq_put(memory, id, seg);
-    }
+    /* allocate one zeroed block holding every word we want */
+    putSegment(memory, id, newSegment(wordCount));
 }
 
 /* Name: chooseID
-   Purpose: generates an ID for a new segment 
-   Arguments: sequence of available IDs, memory sequence
+   Purpose: generates an ID for a new segment: the first free one, or the
+            next one never used (doubling the table when it is full)
+   Arguments: segment table
    Return: umSegmentID
 */
-umSegmentID chooseID(Seq_T segIDs, Seq_T memory){
+umSegmentID chooseID(segTable * memory){
     assert(memory != NULL);
 
-    /* select an ID for a new segment */
-    umSegmentID id = 0;
-    if (Seq_length(segIDs) != 0){
-        umSegmentID * thing = (umSegmentID *)Seq_remlo(segIDs);
-        id = *thing;
-        free(thing);
+    /* reuse a free ID, unlinking it from the list */
+    umSegmentID id = memory->freeID;
+    if (id != SEG_NONE){
+        memory->freeID = memory->slots[id].length;
+        return id;
     }
-    else {
-        id = Seq_length(memory);
+
+    if (memory->count == memory->capacity){
+        assert(memory->capacity <= UINT32_MAX / 2);
+        memory->capacity *= 2;
+        memory->slots = realloc(memory->slots, 
+                                memory->capacity * sizeof(*memory->slots));
+        assert(memory->slots != NULL);
     }
+    id = memory->count++;
+    memory->slots[id].sgmnt = NULL;
+    memory->slots[id].length = 0;
 
     return id;
 }
 
 /* Name: pushSegID 
-   Purpose: add a segment ID into the availabe IDs sequence
-   Arguments: seguence of available IDs, an old segment ID
+   Purpose: empties a slot and puts its ID on the free list
+   Arguments: segment table, an old segment ID
    Return: void
 */
-void pushSegID(Seq_T trgt, umSegmentID oldID){
-    assert(trgt != NULL);
+void pushSegID(segTable * memory, umSegmentID oldID){
+    assert(memory != NULL);
+    assert(oldID < memory->count);
+
+    /* the list runs through the free slots themselves */
+    if (memory->slots[oldID].sgmnt != NULL){
+        memory->live--;
+        memory->words -= memory->slots[oldID].length;
+    }
+    memory->slots[oldID].sgmnt = NULL;
+    memory->slots[oldID].length = memory->freeID;
+    memory->freeID = oldID;
+}
+
+/* the guard page is one inaccessible page that every table shares: an 
+ * engine that doesn't check its loads and stores points the invalid ones 
+ * at it (see guardedWord), and the trap that follows is the fault.
+ */
+static word * guard = NULL;
+static pthread_once_t guardOnce = PTHREAD_ONCE_INIT;
 
-    /* allocate space for new id and add */
-    uint32_t * new = malloc(sizeof(*new));
-    assert(new != NULL);
-    *new = oldID;
-    Seq_addhi(trgt, new);
+static void reserveGuard(void){
+    void * page = mmap(NULL, (size_t)sysconf(_SC_PAGESIZE), PROT_NONE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    assert(page != MAP_FAILED);
+    guard = page;
+}
+
+/* Name: guardPage
+   Purpose: hands back the guard page, reserving it the first time
+   Arguments: none
+   Return: word pointer to the start of the page
+*/
+word * guardPage(void){
+    pthread_once(&guardOnce, reserveGuard);
+    return guard;
 }
 
 /* Name: editWord
    Purpose: edits a specific word inside of a memory segment
-   Arguments: memory sequence, segment ID, offset of words, new word to add
+   Arguments: segment table, segment ID, offset of words, new word to add
    Return: void 
 */
-void editWord(Seq_T memory, umSegmentID id, uint32_t offset, word insert){
+void editWord(segTable * memory, umSegmentID id, uint32_t offset, 
+              word insert){
     assert(memory != NULL);
-    word * thing = (word *)Seq_get(Seq_get(memory, id), (int)offset);
-    *thing = insert;
-}
\ No newline at end of file
+    assert(id < memory->count);
+    Segment sgmnt = memory->slots[id].sgmnt;
+    assert(sgmnt != NULL && offset < memory->slots[id].length);
+
+    /* copy a shared block first, and keep decoded records up to date */
+    segHeader * header = SEG_HEADER(sgmnt);
+    if (header->refs > 1){
+        unshare(memory, sgmnt);
+        sgmnt = getSegment(memory, id);
+        header = SEG_HEADER(sgmnt);
+    }
+    if (header->code != NULL){
+        invalidateDecoded(sgmnt, offset);
+    }
+    header->flags |= SEG_DIRTY;
+    sgmnt[offset] = insert;
+}
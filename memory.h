@@ -8,7 +8,7 @@
 #define MEMORY_H
 
 #include "uarray.h"
-#include "seq.h"
+#include <assert.h>
 #include <stdlib.h>
 #include <inttypes.h>
 
@@ -18,19 +18,127 @@
 //Important type definitions
 typedef uint32_t word; 
 typedef uint32_t umSegmentID;
-typedef Seq_T Segment;
+
+/* a segment is one contiguous block of words. the block is prefixed by a 
+ * small header, and a Segment points just past that header, so word i of a
+ * segment is simply sgmnt[i]. 
+ * LOADP lets segment 0 share the block of the segment it loads (copy on 
+ * write): refs counts the slots of memory holding the block and twin is 
+ * the non-zero slot sharing it with segment 0. a block that has run as 
+ * segment 0 also keeps its decoded records (see decode.h) in code.
+ * flags marks blocks changed since the last checkpoint (see snapshot.h),
+ * blocks that live inside a restored snapshot rather than the arena, 
+ * blocks whose decoded records belong to another block (see shareDecoded)
+ * and large blocks mapped straight from the system (see blockAlloc).
+ */
+typedef word * Segment;
+typedef struct segHeader {
+        uint32_t length;
+        uint32_t refs;
+        umSegmentID twin;
+        uint32_t flags;
+        struct umDecoded * code;
+} segHeader;
+#define SEG_HEADER(sgmnt) ((segHeader *)(sgmnt) - 1)
+#define SEG_DIRTY 1u
+#define SEG_MAPPED 2u
+#define SEG_SHARED_CODE 4u
+#define SEG_LAZY 8u
+
+/* new zeroed segments of more than this many words are lazy by default */
+#define LAZY_WORDS_DEFAULT (UINT32_C(1) << 16)
+
+/* the segment table: a dense array of slots indexed by segment ID, each 
+ * holding a mapped segment and its length, so finding a word is one 
+ * bounds check and one load. an unmapped slot holds NULL and uses length
+ * to link the free IDs into a list (SEG_NONE ends it). when no ID is free 
+ * the array doubles.
+ */
+typedef struct segSlot {
+        Segment sgmnt;
+        uint32_t length;        /* next free ID when the slot is unmapped */
+} segSlot;
+
+typedef struct segTable {
+        segSlot * slots;
+        uint32_t count;         /* IDs handed out so far */
+        uint32_t capacity;
+        umSegmentID freeID;     /* first free ID */
+        uint32_t live;          /* slots holding a segment */
+        uint64_t words;         /* words in them */
+        word * guard;           /* the guard page (see guardedWord) */
+} segTable;
+#define SEG_NONE UINT32_MAX
+
+/* counters kept by the segment arena (see memory.c) */
+typedef struct memStats {
+        uint64_t allocations;
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t large;
+        uint64_t lazy;
+        size_t bytesHeld;
+        size_t peakHeld;
+} memStats;
 
 
 //function contracts for memory management
-void editWord(Seq_T memory, umSegmentID id, uint32_t offset, word insert);
-word getWordat(umSegmentID seg, uint32_t offset, Seq_T memory); 
-void allocate(uint32_t wordCount, umSegmentID id, Seq_T memory); 
+segTable * newTable(void); 
+void editWord(segTable * memory, umSegmentID id, uint32_t offset, 
+              word insert);
+Segment getSegment(segTable * memory, umSegmentID id); 
+void putSegment(segTable * memory, umSegmentID id, Segment sgmnt); 
+uint32_t segLength(Segment sgmnt); 
+Segment newSegment(uint32_t wordCount); 
+Segment rawSegment(uint32_t wordCount); 
+Segment copySegment(Segment sgmnt); 
+Segment placeSegment(void * place, uint32_t wordCount); 
+void shareSegment(segTable * memory, umSegmentID id); 
+void allocate(uint32_t wordCount, umSegmentID id, segTable * memory); 
 void deallocate(Segment sgmnt); 
-void completeFree(Seq_T memory, Seq_T segIDs); 
-void pushSegID(Seq_T trgt, umSegmentID oldID); 
-umSegmentID chooseID(Seq_T segIDs, Seq_T memory); 
+void completeFree(segTable * memory); 
+void pushSegID(segTable * memory, umSegmentID oldID); 
+umSegmentID chooseID(segTable * memory); 
+memStats getMemStats(void); 
+void releaseArena(void); 
+void setLazyThreshold(uint32_t wordCount); 
+word * guardPage(void); 
+
+
+
+/* Name: getWordat
+   Purpose: accesses a given segment and word offset. Returns that word 
+            retrieved from memory.
+   Arguments: segment id, offset, segment table
+   Return: word
+*/
+static inline word getWordat(umSegmentID seg, uint32_t offset, 
+                             segTable * memory){
+    assert(seg < memory->count);
+    segSlot slot = memory->slots[seg];
+    assert(slot.sgmnt != NULL && offset < slot.length);
 
+    return slot.sgmnt[offset];
+}
 
+/* Name: guardedWord
+   Purpose: finds a word for an engine that leaves invalid accesses to the
+            guard page: the word's address if the segment is mapped and 
+            the offset inside it, else the guard page's, which no access 
+            survives (see fault.h). the choice is made with masks rather 
+            than branches (an unknown ID reads slot 0 harmlessly).
+   Arguments: segment table, segment id, offset
+   Return: word pointer
+*/
+static inline word * guardedWord(segTable * memory, umSegmentID seg,
+                                 uint32_t offset){
+    uint32_t known = seg < memory->count;
+    segSlot slot = memory->slots[seg & -known];
+    uintptr_t valid = -(uintptr_t)(known & (slot.sgmnt != NULL) & 
+                                   (offset < slot.length));
+    uintptr_t at = (uintptr_t)slot.sgmnt + (uintptr_t)offset * sizeof(word);
 
+    return (word *)((at & valid) | ((uintptr_t)memory->guard & ~valid));
+}
 
-#endif
\ No newline at end of file
+#endif
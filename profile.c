@@ -0,0 +1,263 @@
+/* Authors: John Little (jlittl04) & Aryan Pandey (apande04)
+ * Date: November 2019
+ * The Universal Machine
+ * File: profile.c - implementation for the execution profiler
+ */
+
+#include "profile.h"
+#include <assert.h>
+#include <string.h>
+
+#define REPORT_ROWS 20
+
+static const char * const opNames[DECODED_OPS] = {
+    "CMOV", "SLOAD", "SSTORE", "ADD", "MUL", "DIV", "NAND", "HALT",
+    "MAP", "UNMAP", "OUT", "IN", "LOADP", "LV", "invalid", "re-decode"
+};
+
+/* opcodes grouped by where their time goes */
+static const struct {
+        const char * name;
+        uint32_t ops;           /* bit per opcode */
+} opClasses[] = {
+    { "arithmetic", 1u << CMOV | 1u << ADD | 1u << MUL | 1u << DIV |
+                    1u << NAND | 1u << LV },
+    { "memory",     1u << SLOAD | 1u << SSTORE },
+    { "allocation", 1u << MAP | 1u << UNMAP },
+    { "control",    1u << LOADP | 1u << HALT },
+    { "i/o",        1u << IN | 1u << OUT },
+};
+
+/* Name: newProfile
+   Purpose: makes an empty profile
+   Arguments: none
+   Return: umProfile pointer
+*/
+umProfile * newProfile(void){
+    umProfile * prof = calloc(1, sizeof(*prof));
+    assert(prof != NULL);
+    return prof;
+}
+
+/* Name: freeProfile
+   Purpose: frees a profile
+   Arguments: profile
+   Return: void
+*/
+void freeProfile(umProfile * prof){
+    if (prof == NULL){
+        return;
+    }
+    free(prof->pcCounts);
+    free(prof->pcOps);
+    free(prof->edges);
+    free(prof);
+}
+
+/* Name: profileGrow
+   Purpose: makes room in the pc counters for a pc (segment 0 can grow
+            whenever a new program is loaded)
+   Arguments: profile, pc
+   Return: void
+*/
+void profileGrow(umProfile * prof, uint32_t pc){
+    uint64_t capacity = prof->pcCapacity ? prof->pcCapacity : 1024;
+    while (capacity <= pc){
+        capacity *= 2;
+    }
+    prof->pcCounts = realloc(prof->pcCounts, 
+                             capacity * sizeof(*prof->pcCounts));
+    prof->pcOps = realloc(prof->pcOps, capacity * sizeof(*prof->pcOps));
+    assert(prof->pcCounts != NULL && prof->pcOps != NULL);
+    memset(prof->pcCounts + prof->pcCapacity, 0, 
+           (capacity - prof->pcCapacity) * sizeof(*prof->pcCounts));
+    memset(prof->pcOps + prof->pcCapacity, 0, 
+           (capacity - prof->pcCapacity) * sizeof(*prof->pcOps));
+    prof->pcCapacity = (uint32_t)(capacity > UINT32_MAX ? UINT32_MAX 
+                                                        : capacity);
+}
+
+static uint32_t edgeHash(uint32_t from, umSegmentID segment, uint32_t to){
+    uint64_t key = ((uint64_t)from << 32 | to) ^ 
+                   ((uint64_t)segment * 0x9E3779B97F4A7C15u);
+    key ^= key >> 29;
+    key *= 0xBF58476D1CE4E5B9u;
+    return (uint32_t)(key ^ (key >> 32));
+}
+
+/* Name: findEdge
+   Purpose: finds the slot for an edge in the (open addressed) edge table
+   Arguments: edges, capacity (a power of two), the edge
+   Return: profEdge pointer -- the edge, or the empty slot it belongs in
+*/
+static profEdge * findEdge(profEdge * edges, uint32_t capacity, 
+                           uint32_t from, umSegmentID segment, uint32_t to){
+    uint32_t i = edgeHash(from, segment, to) & (capacity - 1);
+    for (;;){
+        profEdge * e = &edges[i];
+        if (e->count == 0 || 
+            (e->from == from && e->segment == segment && e->to == to)){
+            return e;
+        }
+        i = (i + 1) & (capacity - 1);
+    }
+}
+
+/* Name: profileEdge
+   Purpose: counts a LOADP from a segment 0 pc to a pc in a segment
+   Arguments: profile, source pc, target segment, target pc
+   Return: void
+*/
+void profileEdge(umProfile * prof, uint32_t from, umSegmentID segment,
+                 uint32_t to){
+    if (2 * (prof->edgeCount + 1) > prof->edgeCapacity){
+        uint32_t capacity = prof->edgeCapacity ? prof->edgeCapacity * 2 
+                                               : 256;
+        profEdge * edges = calloc(capacity, sizeof(*edges));
+        assert(edges != NULL);
+        for (uint32_t i = 0; i < prof->edgeCapacity; i++){
+            profEdge * e = &prof->edges[i];
+            if (e->count != 0){
+                *findEdge(edges, capacity, e->from, e->segment, e->to) = *e;
+            }
+        }
+        free(prof->edges);
+        prof->edges = edges;
+        prof->edgeCapacity = capacity;
+    }
+    profEdge * e = findEdge(prof->edges, prof->edgeCapacity, from, segment,
+                            to);
+    if (e->count == 0){
+        e->from = from;
+        e->segment = segment;
+        e->to = to;
+        prof->edgeCount++;
+    }
+    e->count++;
+}
+
+/* ranking helpers for qsort: hottest first */
+static const uint64_t * rankCounts;
+
+static int byCount(const void * a, const void * b){
+    uint64_t x = rankCounts[*(const uint32_t *)a];
+    uint64_t y = rankCounts[*(const uint32_t *)b];
+    return (x < y) - (x > y);
+}
+
+static int byEdgeCount(const void * a, const void * b){
+    uint64_t x = ((const profEdge *)a)->count;
+    uint64_t y = ((const profEdge *)b)->count;
+    return (x < y) - (x > y);
+}
+
+static double percent(uint64_t part, uint64_t whole){
+    return whole ? 100.0 * part / whole : 0.0;
+}
+
+/* Name: profileReport
+   Purpose: prints the profile: instructions by class and by opcode, the
+            hottest segment 0 pcs and the most taken LOADP edges
+   Arguments: profile, stream
+   Return: void
+*/
+void profileReport(umProfile * prof, FILE * fp){
+    uint64_t total = 0;
+    for (int op = 0; op < DECODED_OPS; op++){
+        if (op != OP_STALE){
+            total += prof->ops[op];
+        }
+    }
+    fprintf(fp, "um: profile of %" PRIu64 " instructions\n", total);
+
+    fprintf(fp, "\n  by class:\n");
+    for (size_t i = 0; i < sizeof(opClasses) / sizeof(opClasses[0]); i++){
+        uint64_t count = 0;
+        for (int op = 0; op < DECODED_OPS; op++){
+            if (opClasses[i].ops & (1u << op)){
+                count += prof->ops[op];
+            }
+        }
+        fprintf(fp, "    %-12s %16" PRIu64 " %6.2f%%\n", opClasses[i].name,
+                count, percent(count, total));
+    }
+
+    uint32_t order[DECODED_OPS];
+    for (uint32_t op = 0; op < DECODED_OPS; op++){
+        order[op] = op;
+    }
+    rankCounts = prof->ops;
+    qsort(order, DECODED_OPS, sizeof(order[0]), byCount);
+    fprintf(fp, "\n  by opcode:\n");
+    for (int i = 0; i < DECODED_OPS && prof->ops[order[i]] != 0; i++){
+        fprintf(fp, "    %-12s %16" PRIu64 " %6.2f%%\n", opNames[order[i]],
+                prof->ops[order[i]], percent(prof->ops[order[i]], total));
+    }
+
+    /* hottest pcs: rank every pc that ran */
+    uint32_t ran = 0;
+    uint32_t * pcs = malloc((prof->pcCapacity + 1) * sizeof(*pcs));
+    assert(pcs != NULL);
+    for (uint32_t pc = 0; pc < prof->pcCapacity; pc++){
+        if (prof->pcCounts[pc] != 0){
+            pcs[ran++] = pc;
+        }
+    }
+    rankCounts = prof->pcCounts;
+    qsort(pcs, ran, sizeof(pcs[0]), byCount);
+    fprintf(fp, "\n  hottest segment 0 pcs (%" PRIu32 " ran):\n", ran);
+    for (uint32_t i = 0; i < ran && i < REPORT_ROWS; i++){
+        fprintf(fp, "    pc %-10" PRIu32 " %-9s %16" PRIu64 " %6.2f%%\n", 
+                pcs[i], opNames[prof->pcOps[pcs[i]]], 
+                prof->pcCounts[pcs[i]], 
+                percent(prof->pcCounts[pcs[i]], total));
+    }
+    free(pcs);
+
+    /* most taken LOADP edges */
+    profEdge * edges = malloc((prof->edgeCount + 1) * sizeof(*edges));
+    assert(edges != NULL);
+    uint32_t count = 0;
+    uint64_t jumps = 0;
+    for (uint32_t i = 0; i < prof->edgeCapacity; i++){
+        if (prof->edges[i].count != 0){
+            edges[count++] = prof->edges[i];
+            jumps += prof->edges[i].count;
+        }
+    }
+    qsort(edges, count, sizeof(edges[0]), byEdgeCount);
+    fprintf(fp, "\n  LOADP edges (%" PRIu32 " distinct, %" PRIu64 
+            " taken):\n", count, jumps);
+    for (uint32_t i = 0; i < count && i < REPORT_ROWS; i++){
+        fprintf(fp, "    pc %-10" PRIu32 " -> segment %" PRIu32 " pc %-10" 
+                PRIu32 " %16" PRIu64 " %6.2f%%\n", edges[i].from, 
+                edges[i].segment, edges[i].to, edges[i].count, 
+                percent(edges[i].count, jumps));
+    }
+    free(edges);
+}
+
+/* Name: profileDump
+   Purpose: writes the profile's raw counts, one per line, for tools to 
+            read back (see dis/umdis.c):
+                pc <pc> <count>
+                edge <from pc> <segment> <to pc> <count>
+   Arguments: profile, stream
+   Return: void
+*/
+void profileDump(umProfile * prof, FILE * fp){
+    fprintf(fp, "# um profile\n");
+    for (uint32_t pc = 0; pc < prof->pcCapacity; pc++){
+        if (prof->pcCounts[pc] != 0){
+            fprintf(fp, "pc %" PRIu32 " %" PRIu64 "\n", pc, 
+                    prof->pcCounts[pc]);
+        }
+    }
+    for (uint32_t i = 0; i < prof->edgeCapacity; i++){
+        profEdge * e = &prof->edges[i];
+        if (e->count != 0){
+            fprintf(fp, "edge %" PRIu32 " %" PRIu32 " %" PRIu32 " %" PRIu64 
+                    "\n", e->from, e->segment, e->to, e->count);
+        }
+    }
+}
@@ -0,0 +1,63 @@
+/* Authors: John Little (jlittl04) & Aryan Pandey (apande04)
+ * Date: November 2019
+ * The Universal Machine
+ * File: profile.h - header file for the execution profiler
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include "decode.h"
+
+/* counters gathered by the profiling engine (./um --profile): how often
+ * each opcode ran, how often each segment 0 pc ran (and the opcode last
+ * seen there) and how often each LOADP edge -- from a pc to a pc in some
+ * segment -- was taken. the step counters are inline since they run once
+ * per instruction; only the profiling engine calls them.
+ */
+typedef struct profEdge {
+        uint32_t from;
+        umSegmentID segment;
+        uint32_t to;
+        uint64_t count;
+} profEdge;
+
+typedef struct umProfile {
+        uint64_t ops[DECODED_OPS];
+        uint64_t * pcCounts;
+        uint8_t * pcOps;
+        uint32_t pcCapacity;
+        profEdge * edges;
+        uint32_t edgeCapacity;
+        uint32_t edgeCount;
+} umProfile;
+
+/* creating, freeing and reporting */
+umProfile * newProfile(void);
+void freeProfile(umProfile * prof);
+void profileReport(umProfile * prof, FILE * fp);
+void profileDump(umProfile * prof, FILE * fp);
+
+/* counting */
+void profileGrow(umProfile * prof, uint32_t pc);
+void profileEdge(umProfile * prof, uint32_t from, umSegmentID segment,
+                 uint32_t to);
+
+/* Name: profileStep
+   Purpose: counts one instruction run at a segment 0 pc
+   Arguments: profile, decoded opcode, pc
+   Return: void
+*/
+static inline void profileStep(umProfile * prof, uint8_t op, uint32_t pc){
+    if (pc >= prof->pcCapacity){
+        profileGrow(prof, pc);
+    }
+    prof->ops[op]++;
+    prof->pcCounts[pc]++;
+    prof->pcOps[pc] = op;
+}
+
+#endif
@@ -0,0 +1,482 @@
+/* Authors: John Little (jlittl04) & Aryan Pandey (apande04)
+ * Date: November 2019
+ * The Universal Machine
+ * File: replay.c - implementation for recording and replaying runs
+ *
+ * a log is a header naming the image (by a hash of segment 0) followed by
+ * fixed size events in host byte order, in the order they happened:
+ *     IN    instructions run before the IN, the byte read (or ~0 for EOF)
+ *     HASH  instructions run, hash of the registers and program pointer
+ *     END   instructions run (the HALT included), umStatus
+ * (the last HASH comes right before the END, with the same count)
+ * the machine's IN goes through a callback that has nothing to give until
+ * a byte is armed, so every IN that reads stops the machine (UM_BLOCKED)
+ * with the count exact. a recording reads the byte from its input then;
+ * a replay runs the machine up to the count of the next event and arms
+ * the byte there, so the IN reads it without stopping. the machine's 
+ * umIO writes its output before every read, so output is batched again 
+ * here and only written when the batch fills, when a recording waits for
+ * input and at the end.
+ */
+
+#include "replay.h"
+#include "machine.h"
+#include "instructions.h"
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define REPLAY_MAGIC 0x50524D55u        /* "UMRP" on little-endian hosts */
+#define REPLAY_VERSION 1
+#define REPLAY_CHUNK (64u << 10)        /* bytes of input read at a time */
+#define NOTHING_ARMED (-2)
+
+typedef enum eventKind {
+        EVENT_IN = 1,
+        EVENT_HASH,
+        EVENT_END
+} eventKind;
+
+typedef struct replayHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t image;         /* hash of segment 0 as loaded */
+} replayHeader;
+
+typedef struct replayEvent {
+        uint64_t count;         /* instructions run before it */
+        uint32_t kind;
+        uint32_t value;
+} replayEvent;
+
+struct umReplay {
+        const char * path;
+        int recording;
+        int inFd;
+        int outFd;
+        umIO * io;
+        int armed;              /* byte for the next IN, UMIO_EOF or
+                                   NOTHING_ARMED */
+        uint64_t count;         /* instructions run so far */
+        int diverged;
+        unsigned char * out;
+        size_t outLen;
+        /* recording */
+        FILE * fp;
+        unsigned char * in;
+        size_t inPos, inLen;
+        /* replaying */
+        replayHeader header;
+        replayEvent * events;
+        size_t eventCount;
+};
+
+/* Name: replayFailed
+   Purpose: reports a log that couldn't be read or written and exits
+   Arguments: path of the log, reason
+   Return: does not return
+*/
+static void replayFailed(const char * path, const char * why){
+    fprintf(stderr, "um: replay log %s: %s\n", path, why);
+    exit(EXIT_FAILURE);
+}
+
+/* Name: hashWords
+   Purpose: folds words into a running FNV-1a hash
+   Arguments: hash so far, words, word count
+   Return: uint64_t -- the new hash
+*/
+static uint64_t hashWords(uint64_t hash, const word * words, uint32_t count){
+    for (uint32_t i = 0; i < count; i++){
+        hash = (hash ^ words[i]) * UINT64_C(0x100000001B3);
+    }
+    return hash;
+}
+
+#define HASH_START UINT64_C(0xCBF29CE484222325)
+
+/* Name: stateHash
+   Purpose: hashes a machine's registers and program pointer
+   Arguments: machine
+   Return: uint32_t
+*/
+static uint32_t stateHash(umMachine * m){
+    uint64_t hash = hashWords(HASH_START, m->registers, REG_COUNT);
+    word pc = m->pc;
+    hash = hashWords(hash, &pc, 1);
+    return (uint32_t)(hash ^ (hash >> 32));
+}
+
+/* Name: imageHash
+   Purpose: hashes a machine's segment 0
+   Arguments: machine
+   Return: uint64_t
+*/
+static uint64_t imageHash(umMachine * m){
+    Segment zero = getSegment(m->memory, 0);
+    return hashWords(HASH_START, zero, segLength(zero));
+}
+
+/* Name: readArmed
+   Purpose: the read callback of the machine's umIO: hands over the armed
+            byte, if there is one
+   Arguments: the replay, buffer, most bytes wanted
+   Return: long -- 1, 0 for the end of input, or UMIO_AGAIN
+*/
+static long readArmed(void * cl, unsigned char * buf, size_t count){
+    umReplay * r = cl;
+    (void)count;
+    int c = r->armed;
+    if (c == NOTHING_ARMED){
+        return UMIO_AGAIN;
+    }
+    r->armed = NOTHING_ARMED;
+    if (c == UMIO_EOF){
+        return 0;
+    }
+    buf[0] = (unsigned char)c;
+    return 1;
+}
+
+/* Name: flushOutput
+   Purpose: writes the batched output
+   Arguments: the replay
+   Return: void
+*/
+static void flushOutput(umReplay * r){
+    const unsigned char * buf = r->out;
+    size_t count = r->outLen;
+    r->outLen = 0;
+    while (count > 0){
+        ssize_t done = write(r->outFd, buf, count);
+        if (done < 0 && errno == EINTR){
+            continue;
+        }
+        if (done <= 0){
+            return;
+        }
+        buf += done;
+        count -= (size_t)done;
+    }
+}
+
+/* Name: writeOutput
+   Purpose: the write callback of the machine's umIO: batches its output
+   Arguments: the replay, bytes, byte count
+   Return: void
+*/
+static void writeOutput(void * cl, const unsigned char * buf, size_t count){
+    umReplay * r = cl;
+    while (count > 0){
+        if (r->outLen == REPLAY_CHUNK){
+            flushOutput(r);
+        }
+        size_t n = REPLAY_CHUNK - r->outLen;
+        n = n < count ? n : count;
+        memcpy(r->out + r->outLen, buf, n);
+        r->outLen += n;
+        buf += n;
+        count -= n;
+    }
+}
+
+/* Name: newReplay
+   Purpose: makes the state shared by recordings and replays
+   Arguments: log path, output descriptor
+   Return: umReplay pointer
+*/
+static umReplay * newReplay(const char * path, int outFd){
+    umReplay * r = calloc(1, sizeof(*r));
+    assert(r != NULL);
+    r->path = path;
+    r->outFd = outFd;
+    r->inFd = -1;
+    r->armed = NOTHING_ARMED;
+    r->out = malloc(REPLAY_CHUNK);
+    assert(r->out != NULL);
+    umIOCallbacks callbacks = { readArmed, writeOutput, r };
+    r->io = newCallbackIO(callbacks);
+    return r;
+}
+
+/* Name: newRecording
+   Purpose: starts a log (replacing the file), to be written by replayRun
+   Arguments: log path, input descriptor, output descriptor
+   Return: umReplay pointer (free with freeReplay)
+*/
+umReplay * newRecording(const char * path, int inFd, int outFd){
+    assert(path != NULL);
+    umReplay * r = newReplay(path, outFd);
+    r->recording = 1;
+    r->inFd = inFd;
+    r->in = malloc(REPLAY_CHUNK);
+    assert(r->in != NULL);
+    r->fp = fopen(path, "wb");
+    if (r->fp == NULL){
+        replayFailed(path, strerror(errno));
+    }
+    return r;
+}
+
+/* Name: openReplay
+   Purpose: reads a log to replay
+   Arguments: log path, output descriptor
+   Return: umReplay pointer (free with freeReplay)
+*/
+umReplay * openReplay(const char * path, int outFd){
+    assert(path != NULL);
+    umReplay * r = newReplay(path, outFd);
+    FILE * fp = fopen(path, "rb");
+    struct stat st;
+    if (fp == NULL || fstat(fileno(fp), &st) != 0){
+        replayFailed(path, strerror(errno));
+    }
+    if (fread(&r->header, sizeof(r->header), 1, fp) != 1 ||
+        r->header.magic != REPLAY_MAGIC){
+        replayFailed(path, "not a replay log");
+    }
+    if (r->header.version != REPLAY_VERSION){
+        replayFailed(path, "written by another version of um");
+    }
+    size_t bytes = (size_t)st.st_size - sizeof(r->header);
+    r->eventCount = bytes / sizeof(replayEvent);
+    r->events = malloc(r->eventCount * sizeof(replayEvent) + 1);
+    assert(r->events != NULL);
+    if (fread(r->events, sizeof(replayEvent), r->eventCount, fp) !=
+        r->eventCount){
+        replayFailed(path, "cut short while reading");
+    }
+    fclose(fp);
+    return r;
+}
+
+/* Name: freeReplay
+   Purpose: finishes a log (flushing the machine's output) and frees it
+   Arguments: replay (its machine already freed)
+   Return: void
+*/
+void freeReplay(umReplay * r){
+    if (r == NULL){
+        return;
+    }
+    freeIO(r->io);
+    flushOutput(r);
+    if (r->fp != NULL && fclose(r->fp) != 0){
+        replayFailed(r->path, strerror(errno));
+    }
+    free(r->in);
+    free(r->out);
+    free(r->events);
+    free(r);
+}
+
+/* Name: replayDiverged
+   Purpose: tells whether the last replayRun stopped at a difference
+   Arguments: replay
+   Return: int -- 1 if so, else 0
+*/
+int replayDiverged(umReplay * r){
+    assert(r != NULL);
+    return r->diverged;
+}
+
+/* Name: runFor
+   Purpose: runs the machine for up to count instructions, keeping the
+            replay's count of instructions run
+   Arguments: replay, machine, instructions (not 0)
+   Return: umStatus -- why it stopped
+*/
+static umStatus runFor(umReplay * r, umMachine * m, uint64_t count){
+    assert(count > 0);
+    umStatus status = umRun(m, count);
+    r->count += count - m->budget;
+    return status;
+}
+
+/* Name: logEvent
+   Purpose: appends an event to a recording
+   Arguments: replay, kind, value
+   Return: void
+*/
+static void logEvent(umReplay * r, eventKind kind, uint32_t value){
+    replayEvent event = { r->count, kind, value };
+    if (fwrite(&event, sizeof(event), 1, r->fp) != 1){
+        replayFailed(r->path, strerror(errno));
+    }
+}
+
+/* Name: readInput
+   Purpose: reads the next input byte of a recording, writing out the 
+            output and the log first if it has to wait for it
+   Arguments: replay
+   Return: int -- the byte, or UMIO_EOF
+*/
+static int readInput(umReplay * r){
+    if (r->inPos == r->inLen){
+        flushOutput(r);
+        if (fflush(r->fp) != 0){
+            replayFailed(r->path, strerror(errno));
+        }
+        ssize_t got;
+        do {
+            got = read(r->inFd, r->in, REPLAY_CHUNK);
+        } while (got < 0 && errno == EINTR);
+        if (got <= 0){
+            return UMIO_EOF;
+        }
+        r->inPos = 0;
+        r->inLen = (size_t)got;
+    }
+    return r->in[r->inPos++];
+}
+
+/* Name: record
+   Purpose: runs a machine to its end, logging its input, a state hash
+            every REPLAY_INTERVAL instructions and at the end, and how it 
+            ended
+   Arguments: replay, machine
+   Return: umStatus -- UM_HALTED or UM_FAULT
+*/
+static umStatus record(umReplay * r, umMachine * m){
+    uint64_t nextHash = (r->count / REPLAY_INTERVAL + 1) * REPLAY_INTERVAL;
+    for (;;){
+        umStatus status = runFor(r, m, nextHash - r->count);
+        if (status == UM_BUDGET){
+            logEvent(r, EVENT_HASH, stateHash(m));
+            nextHash += REPLAY_INTERVAL;
+        }
+        else if (status == UM_BLOCKED){
+            r->armed = readInput(r);
+            logEvent(r, EVENT_IN, (uint32_t)r->armed);
+        }
+        else {
+            logEvent(r, EVENT_HASH, stateHash(m));
+            logEvent(r, EVENT_END, status);
+            return status;
+        }
+    }
+}
+
+/* Name: statusName
+   Purpose: describes how a run stopped, for a divergence report
+   Arguments: status
+   Return: const char *
+*/
+static const char * statusName(umStatus status){
+    switch (status){
+        case UM_HALTED: return "halted";
+        case UM_BLOCKED: return "ran IN";
+        case UM_FAULT: return "faulted";
+        default: return "ran on";
+    }
+}
+
+/* Name: eventName
+   Purpose: describes a logged event, for a divergence report
+   Arguments: event, buffer of at least 64 bytes
+   Return: const char * -- the buffer
+*/
+static const char * eventName(const replayEvent * event, char * buf){
+    if (event->kind == EVENT_IN){
+        snprintf(buf, 64, "an IN at instruction %" PRIu64, event->count);
+    }
+    else if (event->kind == EVENT_HASH){
+        snprintf(buf, 64, "state hash %08" PRIx32 " at instruction %"
+                 PRIu64, event->value, event->count);
+    }
+    else {
+        snprintf(buf, 64, "the run %s at instruction %" PRIu64,
+                 statusName(event->value), event->count);
+    }
+    return buf;
+}
+
+/* Name: diverge
+   Purpose: reports the first difference between a replay and its log
+   Arguments: replay, machine, the event expected next, what happened
+   Return: void
+*/
+static void diverge(umReplay * r, umMachine * m, const replayEvent * event,
+                    const char * what){
+    char buf[64];
+    fprintf(stderr, "um: replay of %s diverged at instruction %" PRIu64
+            " (pc %" PRIu32 "): the log has %s, but %s\n", r->path,
+            r->count, m->pc, eventName(event, buf), what);
+    r->diverged = 1;
+}
+
+/* Name: replay
+   Purpose: runs a machine through the events of a log, stopping at the
+            first difference
+   Arguments: replay, machine
+   Return: umStatus -- how the machine ended, or UM_BUDGET if it stopped
+           at a difference or the end of a log that was cut short
+*/
+static umStatus replay(umReplay * r, umMachine * m){
+    char what[96];
+    umStatus status = UM_BUDGET;        /* how the last run stopped */
+    for (size_t i = 0; i < r->eventCount; i++){
+        const replayEvent * event = &r->events[i];
+        if (event->count > r->count && status == UM_BUDGET){
+            status = runFor(r, m, event->count - r->count);
+        }
+        if (r->count != event->count || 
+            (event->kind == EVENT_END && status != event->value) ||
+            (event->kind == EVENT_IN && status != UM_BUDGET)){
+            snprintf(what, sizeof(what), "the machine %s",
+                     statusName(status));
+            diverge(r, m, event, what);
+            return UM_BUDGET;
+        }
+        if (event->kind == EVENT_END){
+            return status;
+        }
+        if (event->kind == EVENT_HASH && stateHash(m) != event->value){
+            snprintf(what, sizeof(what), "the state hashes to %08" PRIx32,
+                     stateHash(m));
+            diverge(r, m, event, what);
+            return UM_BUDGET;
+        }
+        if (event->kind == EVENT_IN){
+            Segment zero = getSegment(m->memory, 0);
+            if (m->pc >= segLength(zero) || UM_OPCODE(zero[m->pc]) != IN){
+                diverge(r, m, event, "the next instruction is not IN");
+                return UM_BUDGET;
+            }
+            r->armed = event->value == (uint32_t)UMIO_EOF ? UMIO_EOF
+                                                         : (int)event->value;
+        }
+    }
+    fprintf(stderr, "um: replay of %s stopped at instruction %" PRIu64
+            ", where the log ends\n", r->path, r->count);
+    return UM_BUDGET;
+}
+
+/* Name: replayRun
+   Purpose: records or replays a loaded machine, giving it the replay's
+            umIO. a replay of a different image diverges at once.
+   Arguments: replay, machine (not yet run)
+   Return: umStatus -- how the machine ended, or UM_BUDGET if a replay
+           stopped short of the end (see replayDiverged)
+*/
+umStatus replayRun(umReplay * r, umMachine * m){
+    assert(r != NULL && m != NULL);
+    umSetIO(m, r->io);
+    if (r->recording){
+        replayHeader header = { REPLAY_MAGIC, REPLAY_VERSION, imageHash(m) };
+        if (fwrite(&header, sizeof(header), 1, r->fp) != 1){
+            replayFailed(r->path, strerror(errno));
+        }
+        return record(r, m);
+    }
+    if (r->header.image != imageHash(m)){
+        fprintf(stderr, "um: replay of %s diverged at instruction 0: it "
+                        "was recorded from another image\n", r->path);
+        r->diverged = 1;
+        return UM_BUDGET;
+    }
+    return replay(r, m);
+}
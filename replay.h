@@ -0,0 +1,41 @@
+/* Authors: John Little (jlittl04) & Aryan Pandey (apande04)
+ * Date: November 2019
+ * The Universal Machine
+ * File: replay.h - header file for recording and replaying runs
+ */
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdlib.h>
+#include <inttypes.h>
+#include "libum.h"
+
+/* the machine's input is all that can make two runs of an image differ.
+ * a recording runs the machine in exact instruction counts (see umRun)
+ * and logs every byte IN reads along with the number of instructions run
+ * before it, a hash of the registers and program pointer every
+ * REPLAY_INTERVAL instructions, and how the run ended. a replay feeds the
+ * logged input back at the same instruction counts, checks every hash
+ * and the ending, and stops at the first point where the run differs.
+ * either may run on any engine but the JIT: a recording replays the same
+ * under the profiler or the checked engine.
+ */
+typedef struct umReplay umReplay;
+
+#define REPLAY_INTERVAL (UINT64_C(1) << 20)
+#define DIVERGE_EXIT 4          /* um's exit status when a replay differs */
+
+/* recording (reading input from inFd) and replaying; both write the
+ * machine's output to outFd, and own the umIO they give the machine, so
+ * free the machine first
+ */
+umReplay * newRecording(const char * path, int inFd, int outFd);
+umReplay * openReplay(const char * path, int outFd);
+void freeReplay(umReplay * r);
+
+/* running a loaded machine to its end, or to the first difference */
+umStatus replayRun(umReplay * r, umMachine * m);
+int replayDiverged(umReplay * r);
+
+#endif
@@ -0,0 +1,554 @@
+/* Authors: John Little (jlittl04) & Aryan Pandey (apande04)
+ * Date: November 2019
+ * The Universal Machine
+ * File: sched.c - implementation for the session scheduler
+ *
+ * each worker owns a ring of queued sessions. only the owner pushes, at
+ * the tail; the owner and thieves alike take from the head by moving it
+ * with a compare and swap, so the ring is first in first out and every
+ * session queued on a worker gets its quantum before any gets a second
+ * one. a thief takes half of a ring at once (never its last session,
+ * which its owner is about to run). sessions woken by input, new sessions
+ * and sessions that overflow a ring go on a shared queue under the
+ * scheduler's lock, which workers check first now and then so it can't
+ * starve.
+ *
+ * a worker with nothing to run sleeps on a condition variable. it counts
+ * itself idle before looking at the queues one last time, and a worker
+ * that queues a session anyone else could take looks at the idle count
+ * after queueing it, so one of the two always sees the other.
+ */
+
+#include "sched.h"
+#include "memory.h"
+#include <assert.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#define RUNQ_SIZE 256u          /* sessions in a worker's ring */
+#define SHARED_TICK 61u         /* picks between looks at the shared queue */
+#define INPUT_HINT 256u         /* first input buffer, in bytes */
+
+typedef enum sessionState {
+        SESSION_QUEUED = 0,     /* in a queue or running */
+        SESSION_PARKED,         /* waiting for input */
+        SESSION_DONE
+} sessionState;
+
+struct umSession {
+        umSched * sched;
+        umMachine * machine;
+        umIO * io;
+        umSessionHooks hooks;
+        pthread_mutex_t lock;   /* guards the input and the state */
+        unsigned char * input;
+        size_t head, tail, capacity;
+        int closed;
+        sessionState state;
+        umStatus status;
+        umSession * next;       /* in the shared queue */
+};
+
+typedef struct worker {
+        umSched * sched;
+        pthread_t thread;
+        uint32_t head;          /* moved by anyone taking a session */
+        char padHead[60];
+        uint32_t tail;          /* moved by the owner only */
+        char padTail[60];
+        umSession * ring[RUNQ_SIZE];
+        uint32_t ticks;
+} worker;
+
+struct umSched {
+        worker * workers;
+        int threads;
+        uint64_t quantum;
+        pthread_mutex_t lock;   /* guards the shared queue, live, stopping */
+        pthread_cond_t wake;    /* idle workers sleep here */
+        pthread_cond_t ended;   /* freeSched waits here */
+        umSession * first;
+        umSession * last;
+        int idle;
+        uint32_t live;
+        int stopping;
+};
+
+/* Name: readInput
+   Purpose: the read callback of a session's umIO: hands over fed input
+   Arguments: session, buffer, most bytes wanted
+   Return: long -- bytes copied, 0 once the input is closed and used up,
+           or UMIO_AGAIN
+*/
+static long readInput(void * cl, unsigned char * buf, size_t count){
+    umSession * s = cl;
+    pthread_mutex_lock(&s->lock);
+    size_t n = s->tail - s->head;
+    if (n > count){
+        n = count;
+    }
+    memcpy(buf, s->input + s->head, n);
+    s->head += n;
+    long got = n > 0 ? (long)n : s->closed ? 0 : UMIO_AGAIN;
+    pthread_mutex_unlock(&s->lock);
+    return got;
+}
+
+/* Name: writeOutput
+   Purpose: the write callback of a session's umIO: passes output on to
+            the session's write hook
+   Arguments: session, bytes, byte count
+   Return: void
+*/
+static void writeOutput(void * cl, const unsigned char * buf, size_t count){
+    umSession * s = cl;
+    if (s->hooks.write != NULL){
+        s->hooks.write(s->hooks.cl, buf, count);
+    }
+}
+
+/* Name: wakeOne
+   Purpose: wakes one idle worker
+   Arguments: scheduler
+   Return: void
+*/
+static void wakeOne(umSched * sched){
+    pthread_mutex_lock(&sched->lock);
+    pthread_cond_signal(&sched->wake);
+    pthread_mutex_unlock(&sched->lock);
+}
+
+/* Name: pushShared
+   Purpose: queues a session on the shared queue, waking a worker if any
+            are idle
+   Arguments: scheduler, session
+   Return: void
+*/
+static void pushShared(umSched * sched, umSession * s){
+    pthread_mutex_lock(&sched->lock);
+    s->next = NULL;
+    if (sched->last == NULL){
+        __atomic_store_n(&sched->first, s, __ATOMIC_SEQ_CST);
+    }
+    else {
+        sched->last->next = s;
+    }
+    sched->last = s;
+    if (sched->idle > 0){
+        pthread_cond_signal(&sched->wake);
+    }
+    pthread_mutex_unlock(&sched->lock);
+}
+
+/* Name: popShared
+   Purpose: takes the first session on the shared queue
+   Arguments: scheduler
+   Return: umSession -- or NULL if the queue is empty
+*/
+static umSession * popShared(umSched * sched){
+    if (__atomic_load_n(&sched->first, __ATOMIC_SEQ_CST) == NULL){
+        return NULL;
+    }
+    pthread_mutex_lock(&sched->lock);
+    umSession * s = sched->first;
+    if (s != NULL){
+        __atomic_store_n(&sched->first, s->next, __ATOMIC_SEQ_CST);
+        if (s->next == NULL){
+            sched->last = NULL;
+        }
+    }
+    pthread_mutex_unlock(&sched->lock);
+    return s;
+}
+
+/* Name: queued
+   Purpose: counts the sessions in a worker's ring
+   Arguments: worker
+   Return: uint32_t -- how many
+*/
+static inline uint32_t queued(worker * w){
+    uint32_t head = __atomic_load_n(&w->head, __ATOMIC_SEQ_CST);
+    return __atomic_load_n(&w->tail, __ATOMIC_SEQ_CST) - head;
+}
+
+/* Name: pushLocal
+   Purpose: queues a session at the tail of the worker's own ring (or the
+            shared queue if the ring is full). wakes an idle worker when
+            the ring holds more than the worker will run next.
+   Arguments: worker, session
+   Return: void
+*/
+static void pushLocal(worker * w, umSession * s){
+    uint32_t tail = w->tail;
+    uint32_t head = __atomic_load_n(&w->head, __ATOMIC_SEQ_CST);
+    if (tail - head >= RUNQ_SIZE){
+        pushShared(w->sched, s);
+        return;
+    }
+    __atomic_store_n(&w->ring[tail % RUNQ_SIZE], s, __ATOMIC_RELAXED);
+    __atomic_store_n(&w->tail, tail + 1, __ATOMIC_SEQ_CST);
+    if (tail + 1 - head > 1 &&
+        __atomic_load_n(&w->sched->idle, __ATOMIC_SEQ_CST) > 0){
+        wakeOne(w->sched);
+    }
+}
+
+/* Name: popLocal
+   Purpose: takes the session at the head of the worker's own ring
+   Arguments: worker
+   Return: umSession -- or NULL if the ring is empty
+*/
+static umSession * popLocal(worker * w){
+    for (;;){
+        uint32_t head = __atomic_load_n(&w->head, __ATOMIC_SEQ_CST);
+        if (head == w->tail){
+            return NULL;
+        }
+        umSession * s = __atomic_load_n(&w->ring[head % RUNQ_SIZE],
+                                        __ATOMIC_RELAXED);
+        if (__atomic_compare_exchange_n(&w->head, &head, head + 1, 0,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)){
+            return s;
+        }
+    }
+}
+
+/* Name: steal
+   Purpose: moves half of another worker's ring (rounded down) into the
+            worker's own, which is empty
+   Arguments: worker, worker to steal from
+   Return: umSession -- the last one taken, for the worker to run, or
+           NULL if there was nothing to take
+*/
+static umSession * steal(worker * w, worker * victim){
+    uint32_t tail = w->tail;
+    uint32_t n;
+    for (;;){
+        uint32_t head = __atomic_load_n(&victim->head, __ATOMIC_SEQ_CST);
+        uint32_t vtail = __atomic_load_n(&victim->tail, __ATOMIC_SEQ_CST);
+        if (vtail - head > RUNQ_SIZE){
+            continue;   /* head moved between the two loads */
+        }
+        n = (vtail - head) / 2;
+        if (n == 0){
+            return NULL;
+        }
+        for (uint32_t i = 0; i < n; i++){
+            umSession * s = __atomic_load_n(
+                &victim->ring[(head + i) % RUNQ_SIZE], __ATOMIC_RELAXED);
+            __atomic_store_n(&w->ring[(tail + i) % RUNQ_SIZE], s,
+                             __ATOMIC_RELAXED);
+        }
+        if (__atomic_compare_exchange_n(&victim->head, &head, head + n, 0,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)){
+            break;
+        }
+    }
+    umSession * s = w->ring[(tail + n - 1) % RUNQ_SIZE];
+    if (n > 1){
+        __atomic_store_n(&w->tail, tail + n - 1, __ATOMIC_SEQ_CST);
+    }
+    return s;
+}
+
+/* Name: stealable
+   Purpose: tells whether any worker has a session another could take
+   Arguments: scheduler
+   Return: int -- 1 if so, else 0
+*/
+static int stealable(umSched * sched){
+    for (int i = 0; i < sched->threads; i++){
+        if (queued(&sched->workers[i]) > 1){
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Name: findWork
+   Purpose: finds the next session for a worker to run: from its own ring,
+            the shared queue or another worker's ring, sleeping until
+            there is one
+   Arguments: worker
+   Return: umSession -- or NULL once the scheduler is stopping
+*/
+static umSession * findWork(worker * w){
+    umSched * sched = w->sched;
+    for (;;){
+        umSession * s = NULL;
+        if (++w->ticks % SHARED_TICK == 0){
+            s = popShared(sched);
+        }
+        if (s == NULL){
+            s = popLocal(w);
+        }
+        if (s == NULL){
+            s = popShared(sched);
+        }
+        for (int i = 0; s == NULL && i < sched->threads; i++){
+            worker * victim = &sched->workers[(w->ticks + i) %
+                                              (uint32_t)sched->threads];
+            if (victim != w){
+                s = steal(w, victim);
+            }
+        }
+        if (s != NULL){
+            return s;
+        }
+
+        pthread_mutex_lock(&sched->lock);
+        if (sched->stopping){
+            pthread_mutex_unlock(&sched->lock);
+            return NULL;
+        }
+        __atomic_add_fetch(&sched->idle, 1, __ATOMIC_SEQ_CST);
+        if (sched->first == NULL && !stealable(sched)){
+            pthread_cond_wait(&sched->wake, &sched->lock);
+        }
+        __atomic_sub_fetch(&sched->idle, 1, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&sched->lock);
+    }
+}
+
+/* Name: finish
+   Purpose: ends a session whose machine halted or faulted
+   Arguments: session, how the machine stopped
+   Return: void
+*/
+static void finish(umSession * s, umStatus status){
+    umSched * sched = s->sched;
+    umSessionHooks hooks = s->hooks;
+    ioFlush(s->io);
+    pthread_mutex_lock(&s->lock);
+    s->state = SESSION_DONE;
+    s->status = status;
+    pthread_mutex_unlock(&s->lock);
+    if (hooks.finished != NULL){
+        hooks.finished(hooks.cl, status);
+    }
+
+    pthread_mutex_lock(&sched->lock);
+    if (--sched->live == 0){
+        pthread_cond_broadcast(&sched->ended);
+    }
+    pthread_mutex_unlock(&sched->lock);
+}
+
+/* Name: workerMain
+   Purpose: runs sessions a quantum at a time until the scheduler stops
+   Arguments: the worker
+   Return: NULL
+*/
+static void * workerMain(void * arg){
+    worker * w = arg;
+    umSession * s;
+    while ((s = findWork(w)) != NULL){
+        umStatus status = umRun(s->machine, w->sched->quantum);
+        if (status == UM_BUDGET){
+            pushLocal(w, s);
+        }
+        else if (status == UM_BLOCKED){
+            umSessionHooks hooks = s->hooks;
+            pthread_mutex_lock(&s->lock);
+            int parked = s->head == s->tail && !s->closed;
+            if (parked){
+                s->state = SESSION_PARKED;
+            }
+            pthread_mutex_unlock(&s->lock);
+            if (!parked){
+                pushLocal(w, s);    /* input came in while it ran */
+            }
+            else if (hooks.parked != NULL){
+                hooks.parked(hooks.cl);
+            }
+        }
+        else {
+            finish(s, status);
+        }
+    }
+    releaseArena();     /* its sessions are freed on other threads */
+    return NULL;
+}
+
+/* Name: newSched
+   Purpose: starts a scheduler and its workers
+   Arguments: worker count (0 for one per core), instructions a session
+              runs before going back in the queue (0 for SCHED_QUANTUM)
+   Return: umSched (free with freeSched)
+*/
+umSched * newSched(int threads, uint64_t quantum){
+    if (threads <= 0){
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cores > 0 ? (int)cores : 1;
+    }
+    umSched * sched = calloc(1, sizeof(*sched));
+    assert(sched != NULL);
+    sched->workers = calloc(threads, sizeof(*sched->workers));
+    assert(sched->workers != NULL);
+    sched->threads = threads;
+    sched->quantum = quantum ? quantum : SCHED_QUANTUM;
+    pthread_mutex_init(&sched->lock, NULL);
+    pthread_cond_init(&sched->wake, NULL);
+    pthread_cond_init(&sched->ended, NULL);
+
+    for (int i = 0; i < threads; i++){
+        worker * w = &sched->workers[i];
+        w->sched = sched;
+        w->ticks = (uint32_t)i;     /* spreads out where workers steal */
+        int failed = pthread_create(&w->thread, NULL, workerMain, w);
+        assert(!failed);
+        (void)failed;
+    }
+    return sched;
+}
+
+/* Name: freeSched
+   Purpose: waits for every session to end, then stops the workers and
+            frees the scheduler (the sessions are left to their owners)
+   Arguments: scheduler
+   Return: void
+*/
+void freeSched(umSched * sched){
+    if (sched == NULL){
+        return;
+    }
+    pthread_mutex_lock(&sched->lock);
+    while (sched->live > 0){
+        pthread_cond_wait(&sched->ended, &sched->lock);
+    }
+    sched->stopping = 1;
+    pthread_cond_broadcast(&sched->wake);
+    pthread_mutex_unlock(&sched->lock);
+    for (int i = 0; i < sched->threads; i++){
+        pthread_join(sched->workers[i].thread, NULL);
+    }
+    pthread_mutex_destroy(&sched->lock);
+    pthread_cond_destroy(&sched->wake);
+    pthread_cond_destroy(&sched->ended);
+    free(sched->workers);
+    free(sched);
+}
+
+/* Name: schedSpawn
+   Purpose: makes a loaded machine a session and queues it to run. its IN
+            and OUT go through the session's input and the write hook.
+   Arguments: scheduler, machine (the session owns it from now on), hooks
+   Return: umSession (free with freeSession once it has ended)
+*/
+umSession * schedSpawn(umSched * sched, umMachine * machine,
+                       umSessionHooks hooks){
+    assert(sched != NULL && machine != NULL);
+    umSession * s = calloc(1, sizeof(*s));
+    assert(s != NULL);
+    s->sched = sched;
+    s->machine = machine;
+    s->hooks = hooks;
+    s->input = malloc(INPUT_HINT);
+    assert(s->input != NULL);
+    s->capacity = INPUT_HINT;
+    s->state = SESSION_QUEUED;
+    pthread_mutex_init(&s->lock, NULL);
+    umIOCallbacks callbacks = { readInput, writeOutput, s };
+    s->io = newCallbackIO(callbacks);
+    umSetIO(machine, s->io);
+
+    pthread_mutex_lock(&sched->lock);
+    sched->live++;
+    pthread_mutex_unlock(&sched->lock);
+    pushShared(sched, s);
+    return s;
+}
+
+/* Name: wakeLocked
+   Purpose: queues a parked session again (its lock is held)
+   Arguments: session
+   Return: int -- 1 if the caller must push it on the shared queue once
+           the lock is released, else 0
+*/
+static int wakeLocked(umSession * s){
+    if (s->state != SESSION_PARKED){
+        return 0;
+    }
+    s->state = SESSION_QUEUED;
+    return 1;
+}
+
+/* Name: sessionFeed
+   Purpose: adds input for a session, waking it if it is parked
+   Arguments: session, bytes, byte count
+   Return: void
+*/
+void sessionFeed(umSession * s, const unsigned char * bytes, size_t count){
+    assert(s != NULL && (bytes != NULL || count == 0));
+    if (count == 0){
+        return;
+    }
+    pthread_mutex_lock(&s->lock);
+    assert(!s->closed);
+    if (s->tail + count > s->capacity){
+        memmove(s->input, s->input + s->head, s->tail - s->head);
+        s->tail -= s->head;
+        s->head = 0;
+        if (s->tail + count > s->capacity){
+            while (s->tail + count > s->capacity){
+                s->capacity *= 2;
+            }
+            s->input = realloc(s->input, s->capacity);
+            assert(s->input != NULL);
+        }
+    }
+    memcpy(s->input + s->tail, bytes, count);
+    s->tail += count;
+    int wake = wakeLocked(s);
+    pthread_mutex_unlock(&s->lock);
+    if (wake){
+        pushShared(s->sched, s);
+    }
+}
+
+/* Name: sessionClose
+   Purpose: ends a session's input (IN reads the end of input once what
+            was fed is used up), waking it if it is parked
+   Arguments: session
+   Return: void
+*/
+void sessionClose(umSession * s){
+    assert(s != NULL);
+    pthread_mutex_lock(&s->lock);
+    s->closed = 1;
+    int wake = wakeLocked(s);
+    pthread_mutex_unlock(&s->lock);
+    if (wake){
+        pushShared(s->sched, s);
+    }
+}
+
+/* Name: sessionMachine
+   Purpose: gets a session's machine, e.g. for umFaultReport once it ends
+   Arguments: session
+   Return: umMachine
+*/
+umMachine * sessionMachine(umSession * s){
+    assert(s != NULL);
+    return s->machine;
+}
+
+/* Name: freeSession
+   Purpose: frees a session that has ended, along with its machine
+   Arguments: session
+   Return: void
+*/
+void freeSession(umSession * s){
+    if (s == NULL){
+        return;
+    }
+    pthread_mutex_lock(&s->lock);
+    assert(s->state == SESSION_DONE);
+    pthread_mutex_unlock(&s->lock);
+    umFree(s->machine);
+    freeIO(s->io);
+    pthread_mutex_destroy(&s->lock);
+    free(s->input);
+    free(s);
+}
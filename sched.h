@@ -0,0 +1,56 @@
+/* Authors: John Little (jlittl04) & Aryan Pandey (apande04)
+ * Date: November 2019
+ * The Universal Machine
+ * File: sched.h - header file for the session scheduler
+ */
+
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdlib.h>
+#include <inttypes.h>
+#include "libum.h"
+
+/* the scheduler runs any number of machines (sessions) on a fixed pool of
+ * worker threads. a worker runs a session for one quantum of instructions
+ * (see umRun) and puts it back in its run queue; idle workers steal
+ * queued sessions from busy ones. a session whose IN finds no input is
+ * parked -- it holds no thread -- until its host feeds it input or closes
+ * its input, which queues it again. a session ends when its machine halts
+ * or faults.
+ *
+ * the hooks are called on a worker thread, never with a scheduler lock
+ * held, so they may feed or close any session. they must not free one.
+ */
+typedef struct umSched umSched;
+typedef struct umSession umSession;
+
+#define SCHED_QUANTUM (UINT64_C(1) << 20)      /* default instructions */
+
+typedef struct umSessionHooks {
+        /* takes count bytes of output */
+        void (*write)(void * cl, const unsigned char * buf, size_t count);
+        /* the session has used all of its input and parked: feed it */
+        void (*parked)(void * cl);
+        /* the session has ended (its output is all written) */
+        void (*finished)(void * cl, umStatus status);
+        void * cl;
+} umSessionHooks;
+
+/* creating and freeing (threads 0 for one per core, quantum 0 for
+ * SCHED_QUANTUM). freeSched waits for every session to end.
+ */
+umSched * newSched(int threads, uint64_t quantum);
+void freeSched(umSched * sched);
+
+/* sessions: spawning one takes over a loaded machine, which runs at once.
+ * freeSession frees it and its machine, once it has ended.
+ */
+umSession * schedSpawn(umSched * sched, umMachine * machine,
+                       umSessionHooks hooks);
+void sessionFeed(umSession * s, const unsigned char * bytes, size_t count);
+void sessionClose(umSession * s);
+umMachine * sessionMachine(umSession * s);
+void freeSession(umSession * s);
+
+#endif
@@ -0,0 +1,370 @@
+/* Authors: John Little (jlittl04) & Aryan Pandey (apande04)
+ * Date: November 2019
+ * The Universal Machine
+ * File: snapshot.c - implementation for machine snapshots
+ *
+ * a checkpoint is laid out as
+ *     header | live slot bitmap | free IDs | records | blocks
+ * with every part 8 byte aligned. a record names a segment ID, its length
+ * and the file offset of its block; a block is room for a segHeader 
+ * followed by the words in host order, exactly as the memory module lays
+ * out a segment. so restoring maps the whole file (privately, copy on 
+ * write) and hands the blocks to the memory module where they lie.
+ *
+ * only blocks flagged SEG_DIRTY are written, and writing a checkpoint 
+ * clears the flag; a live segment without a record in the newest 
+ * checkpoint is found in an earlier one. segment 0 and the segment it 
+ * shares a block with (see shareSegment) get records for the same block,
+ * and a restore shares it again.
+ */
+
+#include "snapshot.h"
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SNAP_MAGIC 0x4B434D55u  /* "UMCK" on little-endian hosts */
+#define SNAP_VERSION 1
+
+typedef struct ckptHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t size;          /* bytes in the checkpoint, header included */
+        uint32_t pc;
+        uint32_t registers[REG_COUNT];
+        uint32_t slotCount;
+        uint32_t freeCount;
+        uint32_t recordCount;
+} ckptHeader;
+
+typedef struct ckptRecord {
+        umSegmentID id;
+        uint32_t length;
+        uint64_t offset;
+} ckptRecord;
+
+struct umSnapshot {
+        const char * path;
+        FILE * fp;
+        uint64_t end;
+        int taken;              /* checkpoints written by this run */
+        ckptRecord * records;
+        uint32_t capacity;
+};
+
+static inline uint64_t align8(uint64_t n){
+    return (n + 7) & ~(uint64_t)7;
+}
+
+static inline uint64_t blockBytes(uint32_t length){
+    return align8(sizeof(segHeader) + (uint64_t)length * sizeof(word));
+}
+
+static inline uint64_t bitmapBytes(uint32_t slots){
+    return ((uint64_t)slots + 63) / 64 * 8;
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                checkpoints                               */
+/*--------------------------------------------------------------------------*/
+
+/* Name: snapFailed
+   Purpose: reports a snapshot that couldn't be read or written and exits
+   Arguments: path of the snapshot, reason
+   Return: does not return
+*/
+static void snapFailed(const char * path, const char * why){
+    fprintf(stderr, "um: snapshot %s: %s\n", path, why);
+    exit(EXIT_FAILURE);
+}
+
+/* Name: newSnapshot
+   Purpose: opens a file for checkpoints, keeping only its first end bytes
+            (the checkpoints a restore from the same file used)
+   Arguments: path, bytes to keep
+   Return: umSnapshot pointer
+*/
+umSnapshot * newSnapshot(const char * path, uint64_t end){
+    assert(path != NULL);
+    int fd = open(path, O_RDWR | O_CREAT, 0666);
+    if (fd < 0 || ftruncate(fd, (off_t)end) != 0){
+        snapFailed(path, strerror(errno));
+    }
+    umSnapshot * snap = calloc(1, sizeof(*snap));
+    assert(snap != NULL);
+    snap->path = path;
+    snap->fp = fdopen(fd, "r+");
+    snap->end = end;
+    if (snap->fp == NULL || fseeko(snap->fp, (off_t)end, SEEK_SET) != 0){
+        snapFailed(path, strerror(errno));
+    }
+    return snap;
+}
+
+/* Name: freeSnapshot
+   Purpose: closes a checkpoint file
+   Arguments: umSnapshot pointer
+   Return: void
+*/
+void freeSnapshot(umSnapshot * snap){
+    if (snap == NULL){
+        return;
+    }
+    fclose(snap->fp);
+    free(snap->records);
+    free(snap);
+}
+
+/* Name: checkpointDue
+   Purpose: decides whether to checkpoint at an IN: always the first time,
+            and after that whenever the machine is about to wait for input
+   Arguments: snapshot, whether the IN will wait
+   Return: int -- 1 to checkpoint, else 0
+*/
+int checkpointDue(umSnapshot * snap, int waiting){
+    return waiting || snap->taken == 0;
+}
+
+static void put(umSnapshot * snap, const void * src, uint64_t bytes){
+    static const unsigned char pad[8];
+    if (fwrite(src, 1, bytes, snap->fp) != bytes ||
+        fwrite(pad, 1, align8(bytes) - bytes, snap->fp) != 
+        align8(bytes) - bytes){
+        snapFailed(snap->path, strerror(errno));
+    }
+}
+
+/* Name: takeCheckpoint
+   Purpose: appends a checkpoint of the machine: registers, program 
+            pointer, live segment IDs, free IDs and every segment changed
+            since the last checkpoint
+   Arguments: snapshot, segment table, registers array, program pointer to
+              resume at
+   Return: void
+*/
+void takeCheckpoint(umSnapshot * snap, segTable * memory, word registers[],
+                    uint32_t pc){
+    assert(snap != NULL && memory != NULL);
+    uint32_t slots = memory->count;
+    uint32_t freeCount = 0;
+    for (umSegmentID id = memory->freeID; id != SEG_NONE; 
+         id = memory->slots[id].length){
+        freeCount++;
+    }
+    uint64_t * bitmap = calloc(bitmapBytes(slots) / 8 + 1, sizeof(*bitmap));
+    assert(bitmap != NULL);
+
+    /* find the dirty blocks and where they will go */
+    if (snap->capacity < slots){
+        snap->capacity = slots;
+        snap->records = realloc(snap->records, 
+                                slots * sizeof(*snap->records));
+        assert(snap->records != NULL);
+    }
+    uint32_t count = 0;
+    uint64_t zeroOffset = 0;
+    Segment zero = slots > 0 ? memory->slots[0].sgmnt : NULL;
+    for (uint32_t id = 0; id < slots; id++){
+        Segment sgmnt = memory->slots[id].sgmnt;
+        if (sgmnt == NULL){
+            continue;
+        }
+        bitmap[id / 64] |= (uint64_t)1 << (id % 64);
+        if (SEG_HEADER(sgmnt)->flags & SEG_DIRTY){
+            snap->records[count].id = id;
+            snap->records[count].length = segLength(sgmnt);
+            snap->records[count++].offset = 0;
+        }
+    }
+    uint64_t offset = snap->end + sizeof(ckptHeader) + bitmapBytes(slots) +
+                      align8((uint64_t)freeCount * sizeof(word)) + 
+                      (uint64_t)count * sizeof(ckptRecord);
+    for (uint32_t i = 0; i < count; i++){
+        Segment sgmnt = memory->slots[snap->records[i].id].sgmnt;
+        if (sgmnt == zero && snap->records[i].id != 0){
+            snap->records[i].offset = zeroOffset;
+            continue;
+        }
+        if (snap->records[i].id == 0){
+            zeroOffset = offset;
+        }
+        snap->records[i].offset = offset;
+        offset += blockBytes(snap->records[i].length);
+    }
+
+    ckptHeader header = { SNAP_MAGIC, SNAP_VERSION, offset - snap->end, pc,
+                          { 0 }, slots, freeCount, count };
+    memcpy(header.registers, registers, sizeof(header.registers));
+    put(snap, &header, sizeof(header));
+    put(snap, bitmap, bitmapBytes(slots));
+    free(bitmap);
+    word * freeIDs = malloc(((size_t)freeCount + 1) * sizeof(word));
+    assert(freeIDs != NULL);
+    umSegmentID id = memory->freeID;
+    for (uint32_t i = 0; i < freeCount; i++){
+        freeIDs[i] = id;
+        id = memory->slots[id].length;
+    }
+    put(snap, freeIDs, (uint64_t)freeCount * sizeof(word));
+    free(freeIDs);
+    put(snap, snap->records, (uint64_t)count * sizeof(ckptRecord));
+
+    /* the blocks: room for the header, then the words */
+    static const segHeader room;
+    for (uint32_t i = 0; i < count; i++){
+        Segment sgmnt = memory->slots[snap->records[i].id].sgmnt;
+        if (sgmnt == zero && snap->records[i].id != 0){
+            continue;
+        }
+        if (fwrite(&room, sizeof(room), 1, snap->fp) != 1){
+            snapFailed(snap->path, strerror(errno));
+        }
+        put(snap, sgmnt, (uint64_t)segLength(sgmnt) * sizeof(word));
+    }
+    if (fflush(snap->fp) != 0){
+        snapFailed(snap->path, strerror(errno));
+    }
+    snap->end = offset;
+    snap->taken++;
+
+    /* everything written is clean until it changes again */
+    for (uint32_t i = 0; i < count; i++){
+        Segment sgmnt = memory->slots[snap->records[i].id].sgmnt;
+        SEG_HEADER(sgmnt)->flags &= ~SEG_DIRTY;
+    }
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                 restoring                                */
+/*--------------------------------------------------------------------------*/
+
+/* Name: restoreSnapshot
+   Purpose: rebuilds the machine from the newest complete checkpoint in a 
+            snapshot file. the segment table must be empty. the segments 
+            are used where they lie in a private mapping of the file, so 
+            untouched ones are never read. an incomplete checkpoint at the
+            end of the file (a run that died while writing) is ignored.
+   Arguments: path, segment table, registers array, 
+              whether restored segments count as already checkpointed (the
+              next checkpoints go to the same file), where to put the size
+              of the complete checkpoints
+   Return: uint32_t -- the program pointer to resume at
+*/
+uint32_t restoreSnapshot(const char * path, segTable * memory, 
+                         word registers[], int keepClean, uint64_t * end){
+    assert(path != NULL && memory != NULL);
+    assert(memory->count == 0);
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0){
+        snapFailed(path, strerror(errno));
+    }
+    uint64_t size = (uint64_t)st.st_size;
+    if (size < sizeof(ckptHeader)){
+        snapFailed(path, "no checkpoint in file");
+    }
+    unsigned char * base = mmap(NULL, size, PROT_READ | PROT_WRITE, 
+                                MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED){
+        snapFailed(path, strerror(errno));
+    }
+
+    /* the newest record of each slot, over every complete checkpoint */
+    ckptRecord ** newest = NULL;
+    uint32_t newestCount = 0;
+    ckptHeader * last = NULL;
+    uint64_t at = 0;
+    while (at + sizeof(ckptHeader) <= size){
+        ckptHeader * header = (ckptHeader *)(base + at);
+        if (header->magic != SNAP_MAGIC || header->version != SNAP_VERSION){
+            snapFailed(path, "not a snapshot from this machine");
+        }
+        if (header->size > size - at){
+            break;
+        }
+        uint64_t recordsAt = sizeof(ckptHeader) + 
+                             bitmapBytes(header->slotCount) +
+                             align8((uint64_t)header->freeCount * 
+                                    sizeof(word));
+        uint64_t meta = recordsAt + 
+                        (uint64_t)header->recordCount * sizeof(ckptRecord);
+        if (meta > header->size){
+            snapFailed(path, "corrupt checkpoint");
+        }
+        if (header->slotCount > newestCount){
+            newest = realloc(newest, header->slotCount * sizeof(*newest));
+            assert(newest != NULL);
+            memset(newest + newestCount, 0, (header->slotCount - 
+                   newestCount) * sizeof(*newest));
+            newestCount = header->slotCount;
+        }
+        ckptRecord * records = (ckptRecord *)(base + at + recordsAt);
+        for (uint32_t i = 0; i < header->recordCount; i++){
+            ckptRecord * r = &records[i];
+            if (r->id >= header->slotCount || r->offset % 8 != 0 ||
+                r->offset < at + meta || 
+                r->offset + blockBytes(r->length) > at + header->size){
+                snapFailed(path, "corrupt checkpoint");
+            }
+            newest[r->id] = r;
+        }
+        last = header;
+        at += header->size;
+    }
+    if (last == NULL || last->slotCount == 0){
+        snapFailed(path, "no complete checkpoint in file");
+    }
+    *end = at;
+
+    /* the live segments, where they lie. segment 0 comes first, so a slot
+     * whose newest block is segment 0's shares it again.
+     */
+    uint64_t * bitmap = (uint64_t *)(last + 1);
+    Segment zero = NULL;
+    for (uint32_t id = 0; id < last->slotCount; id++){
+        chooseID(memory);
+        if (!(bitmap[id / 64] >> (id % 64) & 1)){
+            continue;
+        }
+        ckptRecord * r = newest[id];
+        if (r == NULL || (id == 0) != (zero == NULL)){
+            snapFailed(path, "corrupt checkpoint");
+        }
+        if (id != 0 && r->offset == newest[0]->offset){
+            SEG_HEADER(zero)->refs++;
+            SEG_HEADER(zero)->twin = id;
+            putSegment(memory, id, zero);
+            continue;
+        }
+        Segment sgmnt = placeSegment(base + r->offset, r->length);
+        if (!keepClean){
+            SEG_HEADER(sgmnt)->flags |= SEG_DIRTY;
+        }
+        if (id == 0){
+            zero = sgmnt;
+        }
+        putSegment(memory, id, sgmnt);
+    }
+    free(newest);
+    if (last->pc >= segLength(zero)){
+        snapFailed(path, "corrupt checkpoint");
+    }
+
+    /* pushed last first, so the list comes out in the order written */
+    word * freeIDs = (word *)(bitmap + bitmapBytes(last->slotCount) / 8);
+    for (uint32_t i = last->freeCount; i > 0; i--){
+        if (freeIDs[i - 1] >= last->slotCount || 
+            memory->slots[freeIDs[i - 1]].sgmnt != NULL){
+            snapFailed(path, "corrupt checkpoint");
+        }
+        pushSegID(memory, freeIDs[i - 1]);
+    }
+    memcpy(registers, last->registers, sizeof(last->registers));
+    return last->pc;
+}
@@ -0,0 +1,33 @@
+/* Authors: John Little (jlittl04) & Aryan Pandey (apande04)
+ * Date: November 2019
+ * The Universal Machine
+ * File: snapshot.h - header file for machine snapshots
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdlib.h>
+#include <inttypes.h>
+#include "memory.h"
+
+/* a snapshot file is a run of checkpoints, each holding the registers, the
+ * program pointer, which segment IDs are live, the free ID list and every 
+ * segment that changed since the checkpoint before it. restoring maps the
+ * file and uses the newest copy of each live segment in place, so a 
+ * restore costs the number of segments, not their size.
+ */
+typedef struct umSnapshot umSnapshot;
+
+/* writing checkpoints (newSnapshot keeps the first end bytes of the file) */
+umSnapshot * newSnapshot(const char * path, uint64_t end);
+int checkpointDue(umSnapshot * snap, int waiting);
+void takeCheckpoint(umSnapshot * snap, segTable * memory, word registers[],
+                    uint32_t pc);
+void freeSnapshot(umSnapshot * snap);
+
+/* restoring the newest complete checkpoint */
+uint32_t restoreSnapshot(const char * path, segTable * memory, 
+                         word registers[], int keepClean, uint64_t * end);
+
+#endif
@@ -0,0 +1,149 @@
+/* Authors: John Little (jlittl04) & Aryan Pandey (apande04)
+ * Date: November 2019
+ * The Universal Machine
+ * File: telemetry.c - implementation for live telemetry
+ *
+ * an update writes the page between two increments of its sequence
+ * number, as a seqlock: a reader that sees the same even number before
+ * and after its copy has a consistent one. everything on the page comes
+ * from counters the machine keeps anyway -- the counting engine's, the
+ * segment table's and the umIO's batch totals -- so an update costs a
+ * clock read and a few dozen stores.
+ */
+
+#include "telemetry.h"
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include "machine.h"
+
+#define RATE_WINDOW UINT64_C(500000000)  /* ns the rate is taken over */
+
+static uint64_t nanoseconds(clockid_t clock){
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+/* Name: newTelemetry
+   Purpose: creates a machine's telemetry page. a page an earlier run left
+            under the name is unlinked first, so a monitor still watching
+            it keeps the old one rather than seeing it change under it.
+   Arguments: name (without slashes)
+   Return: umTelemetry pointer, or NULL with errno set
+*/
+umTelemetry * newTelemetry(const char * name){
+    assert(name != NULL);
+    if (*name == '\0' || strchr(name, '/') != NULL){
+        errno = EINVAL;
+        return NULL;
+    }
+    umTelemetry * t = calloc(1, sizeof(*t));
+    assert(t != NULL);
+    size_t length = strlen(name) + 5;
+    t->name = malloc(length);
+    assert(t->name != NULL);
+    snprintf(t->name, length, "/um.%s", name);
+
+    shm_unlink(t->name);
+    int fd = shm_open(t->name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0 || ftruncate(fd, sizeof(umTelemetryPage)) != 0){
+        int saved = errno;
+        if (fd >= 0){
+            close(fd);
+            shm_unlink(t->name);
+        }
+        free(t->name);
+        free(t);
+        errno = saved;
+        return NULL;
+    }
+    t->page = mmap(NULL, sizeof(umTelemetryPage), PROT_READ | PROT_WRITE,
+                   MAP_SHARED, fd, 0);
+    close(fd);
+    assert(t->page != MAP_FAILED);
+
+    umTelemetryPage * page = t->page;
+    page->version = TELEMETRY_VERSION;
+    page->pid = (int64_t)getpid();
+    page->state = TELE_RUNNING;
+    page->started = page->updated = nanoseconds(CLOCK_REALTIME);
+    t->rateTime = nanoseconds(CLOCK_MONOTONIC);
+    /* a monitor takes the page as valid once it has its magic */
+    __atomic_store_n(&page->magic, TELEMETRY_MAGIC, __ATOMIC_RELEASE);
+    return t;
+}
+
+/* Name: telemetryPublish
+   Purpose: updates the page from the machine's counters
+   Arguments: telemetry, the machine, how its last run ended
+   Return: void
+*/
+void telemetryPublish(umTelemetry * t, umMachine * m, umStatus status){
+    assert(t != NULL && m != NULL);
+    umTelemetryPage * page = t->page;
+
+    /* fused records count as their first instruction (see engine.h) */
+    uint64_t ops[TELEMETRY_OPS] = { 0 };
+    uint64_t instructions = 0;
+    for (int op = 0; op < DECODED_OPS; op++){
+        uint8_t base = baseOp((uint8_t)op);
+        if (base < TELEMETRY_OPS){
+            ops[base] += t->ops[op];
+            instructions += t->ops[op];
+        }
+    }
+    uint64_t in = 0, out = 0;
+    if (m->io != NULL){
+        ioCounts(m->io, &in, &out);
+    }
+    uint64_t now = nanoseconds(CLOCK_MONOTONIC);
+    int newRate = now - t->rateTime >= RATE_WINDOW;
+    uint64_t rate = page->rate;
+    if (newRate){
+        rate = (uint64_t)((double)(instructions - t->rateCount) * 1e9 /
+                          (double)(now - t->rateTime));
+        t->rateCount = instructions;
+        t->rateTime = now;
+    }
+
+    uint64_t sequence = page->sequence;
+    __atomic_store_n(&page->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    page->state = status == UM_HALTED ? TELE_HALTED :
+                  status == UM_FAULT ? TELE_FAULT :
+                  status == UM_BLOCKED ? TELE_BLOCKED : TELE_RUNNING;
+    page->updated = nanoseconds(CLOCK_REALTIME);
+    page->updates++;
+    page->instructions = instructions;
+    page->rate = page->state == TELE_RUNNING ? rate : 0;
+    memcpy(page->ops, ops, sizeof(ops));
+    page->segments = m->memory->live;
+    page->words = m->memory->words;
+    if (page->words > page->peakWords){
+        page->peakWords = page->words;
+    }
+    page->bytesIn = in;
+    page->bytesOut = out;
+    __atomic_store_n(&page->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+/* Name: freeTelemetry
+   Purpose: unmaps and unlinks the page (a monitor that has it mapped
+            keeps its last update)
+   Arguments: telemetry
+   Return: void
+*/
+void freeTelemetry(umTelemetry * t){
+    if (t == NULL){
+        return;
+    }
+    munmap(t->page, sizeof(umTelemetryPage));
+    shm_unlink(t->name);
+    free(t->name);
+    free(t);
+}
@@ -0,0 +1,95 @@
+/* Authors: John Little (jlittl04) & Aryan Pandey (apande04)
+ * Date: November 2019
+ * The Universal Machine
+ * File: telemetry.h - header file for live telemetry
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include "libum.h"
+#include "decode.h"
+
+/* a machine with telemetry runs on the counting engine (see engine.h) and
+ * publishes its counters to a named POSIX shared memory page (/um.name, so
+ * /dev/shm/um.name on Linux) each time umRun returns: ./um runs it in
+ * quanta of TELEMETRY_QUANTUM instructions. a monitor (umtop) maps the
+ * page read only and copies it out under its sequence number, so it
+ * never stops, signals or slows the machine. the page is unlinked when
+ * the telemetry is freed.
+ */
+typedef struct umTelemetry umTelemetry;
+
+#define TELEMETRY_MAGIC 0x4C544D55u     /* "UMTL" on little-endian hosts */
+#define TELEMETRY_VERSION 1
+#define TELEMETRY_QUANTUM (UINT64_C(1) << 22)   /* instructions */
+#define TELEMETRY_OPS 14                /* opcodes counted */
+
+/* what the machine was doing at the last update */
+#define TELE_RUNNING 0
+#define TELE_BLOCKED 1          /* waiting for input (see umRun) */
+#define TELE_HALTED 2
+#define TELE_FAULT 3
+
+typedef struct umTelemetryPage {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t sequence;      /* odd while an update is being written */
+        int64_t pid;
+        uint32_t state;         /* TELE_* */
+        uint32_t reserved;
+        uint64_t started;       /* wall clock, ns since the epoch */
+        uint64_t updated;
+        uint64_t updates;
+        uint64_t instructions;
+        uint64_t rate;          /* instructions a second, lately */
+        uint64_t ops[TELEMETRY_OPS];
+        uint64_t segments;      /* mapped, segment 0 included */
+        uint64_t words;         /* in them */
+        uint64_t peakWords;
+        uint64_t bytesIn;
+        uint64_t bytesOut;
+} umTelemetryPage;
+
+/* the counting engine's counters come first, by decoded opcode */
+struct umTelemetry {
+        uint64_t ops[DECODED_OPS];
+        umTelemetryPage * page;
+        char * name;            /* of the shared memory object */
+        uint64_t rateCount;     /* instructions and time the rate is */
+        uint64_t rateTime;      /* taken from */
+};
+
+/* publishing (newTelemetry gives NULL with errno set if it can't create
+ * the page, replacing any left by an earlier run under the name)
+ */
+umTelemetry * newTelemetry(const char * name);
+void telemetryPublish(umTelemetry * t, umMachine * m, umStatus status);
+void freeTelemetry(umTelemetry * t);
+
+/* Name: telemetryRead
+   Purpose: copies a published page, trying again while an update is
+            being written over it
+   Arguments: the mapped page, where to copy it
+   Return: int -- 0, or -1 if it never held still
+*/
+static inline int telemetryRead(const umTelemetryPage * page,
+                                umTelemetryPage * copy){
+    for (int tries = 0; tries < 1000; tries++){
+        uint64_t before = __atomic_load_n(&page->sequence, __ATOMIC_ACQUIRE);
+        if (before & 1){
+            continue;
+        }
+        memcpy(copy, (const void *)page, sizeof(*copy));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&page->sequence, __ATOMIC_RELAXED) == before){
+            return 0;
+        }
+    }
+    return -1;
+}
+
+#endif
@@ -0,0 +1,275 @@
+/* Authors: John Little (jlittl04) & Aryan Pandey (apande04)
+ * Date: November 2019
+ * The Universal Machine
+ * File: umtop.c - monitor for machines publishing telemetry
+ *
+ * umtop watches a machine run with ./um --telemetry name: it maps the
+ * machine's page (see telemetry.h) read only and prints a line from it
+ * every interval, in the manner of vmstat, until the machine is done. it
+ * never signals or stops the machine, so watching costs the machine
+ * nothing. a page that hasn't been updated for a while is marked 
+ * stalled: the machine is running but has stopped coming back between 
+ * quanta, or is gone. given no name, it lists the pages there are.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "instructions.h"
+#include "telemetry.h"
+
+#define DEFAULT_INTERVAL 1000   /* ms */
+#define STALL_TIME 5.0          /* s without an update, while running */
+#define HEADER_EVERY 20         /* lines */
+#define SHM_DIR "/dev/shm"
+
+static const char * const opNames[TELEMETRY_OPS] = {
+    "CMOV", "SLOAD", "SSTORE", "ADD", "MUL", "DIV", "NAND", "HALT",
+    "MAP", "UNMAP", "OUT", "IN", "LOADP", "LV"
+};
+
+static const char * const stateNames[] = {
+    "run", "input", "halted", "fault"
+};
+
+static void usage(void){
+    fprintf(stderr, "USAGE ERROR | Proper Usage: ./umtop [--interval ms] "
+                    "[--once] [name]\n");
+    exit(EXIT_FAILURE);
+}
+
+static double wallSeconds(void){
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+/* Name: scaled
+   Purpose: writes a count in at most five characters, with a k/M/G/T
+            suffix as it needs one
+   Arguments: count, buffer of at least 8 characters
+   Return: the buffer
+*/
+static char * scaled(uint64_t count, char * buffer){
+    static const char suffix[] = " kMGTPE";
+    double value = (double)count;
+    int power = 0;
+    while (value >= 9999.5 && power < 6){
+        value /= 1000;
+        power++;
+    }
+    if (power == 0){
+        snprintf(buffer, 8, "%u", (unsigned)count);
+    }
+    else {
+        snprintf(buffer, 8, value < 9.95 ? "%.1f%c" : "%.0f%c", value,
+                 suffix[power]);
+    }
+    return buffer;
+}
+
+static const char * stateName(const umTelemetryPage * page){
+    return page->state < sizeof(stateNames) / sizeof(stateNames[0]) ?
+           stateNames[page->state] : "?";
+}
+
+/* Name: openPage
+   Purpose: maps a machine's page read only
+   Arguments: name the machine publishes under
+   Return: the page, or NULL (having said why)
+*/
+static const umTelemetryPage * openPage(const char * name){
+    char path[256];
+    snprintf(path, sizeof(path), "/um.%s", name);
+    int fd = shm_open(path, O_RDONLY, 0);
+    if (fd < 0){
+        fprintf(stderr, "umtop: no machine publishes as %s: %s\n", name,
+                strerror(errno));
+        return NULL;
+    }
+    void * page = mmap(NULL, sizeof(umTelemetryPage), PROT_READ,
+                       MAP_SHARED, fd, 0);
+    close(fd);
+    if (page == MAP_FAILED){
+        fprintf(stderr, "umtop: cannot map %s: %s\n", name, strerror(errno));
+        return NULL;
+    }
+    const umTelemetryPage * p = page;
+    if (__atomic_load_n(&p->magic, __ATOMIC_ACQUIRE) != TELEMETRY_MAGIC ||
+        p->version != TELEMETRY_VERSION){
+        fprintf(stderr, "umtop: %s is not a telemetry page this umtop "
+                        "reads\n", name);
+        munmap(page, sizeof(umTelemetryPage));
+        return NULL;
+    }
+    return p;
+}
+
+/* Name: listPages
+   Purpose: prints the machines publishing telemetry, and whether each is
+            still alive
+   Arguments: none
+   Return: int -- exit code
+*/
+static int listPages(void){
+    DIR * dir = opendir(SHM_DIR);
+    if (dir == NULL){
+        fprintf(stderr, "umtop: cannot list %s: %s\n", SHM_DIR,
+                strerror(errno));
+        return EXIT_FAILURE;
+    }
+    int found = 0;
+    struct dirent * entry;
+    while ((entry = readdir(dir)) != NULL){
+        if (strncmp(entry->d_name, "um.", 3) != 0){
+            continue;
+        }
+        const char * name = entry->d_name + 3;
+        const umTelemetryPage * page = openPage(name);
+        umTelemetryPage copy;
+        if (page == NULL){
+            continue;
+        }
+        if (telemetryRead(page, &copy) == 0){
+            if (!found++){
+                printf("%-20s %8s %-6s %7s %6s\n", "name", "pid", "state",
+                       "instrs", "alive");
+            }
+            char instrs[8];
+            int alive = kill((pid_t)copy.pid, 0) == 0 || errno == EPERM;
+            printf("%-20s %8" PRId64 " %-6s %7s %6s\n", name, copy.pid,
+                   stateName(&copy), scaled(copy.instructions, instrs),
+                   alive ? "yes" : "no");
+        }
+        munmap((void *)page, sizeof(umTelemetryPage));
+    }
+    closedir(dir);
+    if (!found){
+        printf("no machines are publishing telemetry\n");
+    }
+    return EXIT_SUCCESS;
+}
+
+/* Name: printDetail
+   Purpose: prints everything on a page, opcode totals included
+   Arguments: the page's name, a copy of it
+   Return: void
+*/
+static void printDetail(const char * name, const umTelemetryPage * page){
+    double now = wallSeconds();
+    printf("machine     %s (pid %" PRId64 ")\n", name, page->pid);
+    printf("state       %s, updated %.1fs ago (%" PRIu64 " updates)\n",
+           stateName(page), now - (double)page->updated / 1e9, page->updates);
+    printf("running     %.1fs\n",
+           ((double)page->updated - (double)page->started) / 1e9);
+    printf("instructions %" PRIu64 " (%" PRIu64 "/s)\n", page->instructions,
+           page->rate);
+    printf("segments    %" PRIu64 " mapped, %" PRIu64 " words (peak %"
+           PRIu64 ")\n", page->segments, page->words, page->peakWords);
+    printf("io          %" PRIu64 " bytes in, %" PRIu64 " bytes out\n",
+           page->bytesIn, page->bytesOut);
+    printf("opcodes\n");
+    for (int op = 0; op < TELEMETRY_OPS; op++){
+        double share = page->instructions == 0 ? 0.0 :
+                       100.0 * (double)page->ops[op] /
+                       (double)page->instructions;
+        printf("  %-6s %16" PRIu64 " %6.2f%%\n", opNames[op], page->ops[op],
+               share);
+    }
+}
+
+static void printHeader(void){
+    printf("%-6s %7s %7s %7s %7s %7s %7s %7s %7s %6s\n", "state", "instrs",
+           "rate/s", "segs", "words", "peak", "in", "out", "loadp", "age");
+}
+
+/* Name: printLine
+   Purpose: prints the line for one look at the page
+   Arguments: a copy of the page
+   Return: void
+*/
+static void printLine(const umTelemetryPage * page){
+    char b[8][8];
+    double age = wallSeconds() - (double)page->updated / 1e9;
+    printf("%-6s %7s %7s %7s %7s %7s %7s %7s %7s %5.1fs%s\n",
+           stateName(page), scaled(page->instructions, b[0]),
+           scaled(page->rate, b[1]), scaled(page->segments, b[2]),
+           scaled(page->words, b[3]), scaled(page->peakWords, b[4]),
+           scaled(page->bytesIn, b[5]), scaled(page->bytesOut, b[6]),
+           scaled(page->ops[LOADP], b[7]), age < 0 ? 0.0 : age,
+           page->state == TELE_RUNNING && age > STALL_TIME ? " stalled" : "");
+    fflush(stdout);
+}
+
+int main(int argc, char * argv[]){
+    long interval = DEFAULT_INTERVAL;
+    int once = 0;
+    const char * name = NULL;
+    for (int i = 1; i < argc; i++){
+        if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc){
+            char * end;
+            interval = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || interval <= 0){
+                usage();
+            }
+        }
+        else if (strcmp(argv[i], "--once") == 0){
+            once = 1;
+        }
+        else if (argv[i][0] != '-' && name == NULL){
+            name = argv[i];
+        }
+        else {
+            usage();
+        }
+    }
+    if (name == NULL){
+        return listPages();
+    }
+
+    const umTelemetryPage * page = openPage(name);
+    if (page == NULL){
+        return EXIT_FAILURE;
+    }
+    umTelemetryPage copy;
+    if (once){
+        if (telemetryRead(page, &copy) != 0){
+            fprintf(stderr, "umtop: %s is being updated too fast to read\n",
+                    name);
+            return EXIT_FAILURE;
+        }
+        printDetail(name, &copy);
+        return EXIT_SUCCESS;
+    }
+
+    /* the page stays mapped after the machine unlinks it, so its last
+     * update is still there to print
+     */
+    struct timespec pause = { interval / 1000, (interval % 1000) * 1000000 };
+    for (int lines = 0; ; lines++){
+        if (telemetryRead(page, &copy) != 0){
+            nanosleep(&pause, NULL);
+            continue;
+        }
+        if (lines % HEADER_EVERY == 0){
+            printHeader();
+        }
+        printLine(&copy);
+        if (copy.state == TELE_HALTED || copy.state == TELE_FAULT){
+            break;
+        }
+        if (kill((pid_t)copy.pid, 0) != 0 && errno == ESRCH){
+            printf("umtop: %s (pid %" PRId64 ") is gone\n", name, copy.pid);
+            break;
+        }
+        nanosleep(&pause, NULL);
+    }
+    return EXIT_SUCCESS;
+}
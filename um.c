@@ -2,208 +2,356 @@
  * Date: November 2019
  * The Universal Machine
  * File: um.c - implementation for the UM
+ *
+ * ./um is a host of the UM library (see libum.h): it runs one machine on
+ * stdin and stdout, a batch of them, or copies of one warmed up machine
+ * for a fork server's jobs, without an instruction budget.
  */
 
 #include <stdlib.h>
+#include <errno.h>
+#include <limits.h>
 #include <assert.h>
-#include <sys/stat.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
-#include "instructions.h"
+#include "libum.h"
+#include "jit.h"
 #include "memory.h"
-#include "bitpack.h"
+#include "batch.h"
+#include "fault.h"
+#include "profile.h"
+#include "snapshot.h"
+#include "replay.h"
+#include "loader.h"
+#include "umx.h"
+#include "telemetry.h"
+#include "forksrv.h"
 
-/* Name: readFile
-   Purpose: load the contents of a .um file into segment 0.
-   Arguments: FILE pointer, length of file, segment 0
-   Return: void 
+/* Name: sameFile
+   Purpose: tells whether two paths name the same existing file
+   Arguments: two paths
+   Return: int -- 1 if so, else 0
 */
-static inline void readFile(FILE * ptr, int length, Seq_T zero){
-    assert(length % 4 == 0);
-    assert(ptr != NULL);
-    assert(zero != NULL);
-    word * thing;
-    uint32_t count = 0;
-    /* extract and pack the bytes into instruction then put into segment 0*/
-    while(count < (uint32_t)length){
-        thing = malloc (sizeof(word));
-        *thing = 0u;
-        *thing |= getc(ptr) << 24;
-        *thing |= (getc(ptr) << 16);
-        *thing |= (getc(ptr) << 8);
-        *thing |= (getc(ptr));
-        Seq_addhi(zero, thing);
-        count += 4;
-    }
+static int sameFile(const char * a, const char * b){
+    struct stat x, y;
+    return stat(a, &x) == 0 && stat(b, &y) == 0 && 
+           x.st_dev == y.st_dev && x.st_ino == y.st_ino;
 }
 
-/* Name: orderOp
-   Purpose: gets an instruction from the Segment 0, unpacks the instruction 
-            to get the OP code and each register ID in use. Goes through
-            a switch case to determine which operation needs to be called 
-            and calls that operation. If operation is invalid, halts.
-            Iterates program pointer.
-   Arguments: memory sequence, segment IDs sequence, registers array, 
-              program ptr.
-   Return: void 
+/* Name: usage
+   Purpose: prints the proper usage of the program and exits
+   Arguments: none
+   Return: does not return
 */
-static inline void orderOp(Seq_T memory, Seq_T segIDs, word registers[], 
-                           uint32_t * prgmPtr){
-    assert(memory != NULL);
-    assert(segIDs != NULL);
-    assert(registers != NULL);
-    assert(prgmPtr != NULL);
-
-    /* declare basic variables */
-    regID regA = 0;
-    regID regB = 0;
-    regID regC = 0;
-    opCode code = 0;
-    int loop = 1;
-    while(loop == 1){
-        /* get next instruction and unpack opcode */
-        umInstruction next = getNextInstruct(Seq_get(memory, 0), prgmPtr);
-        code = getOpCode(next);
-        /* switch case to execute whichever instruction is necessary */
-        switch(code){
-            case CMOV:
-                regA = getRegA(next);
-                regB = getRegB(next);
-                regC = getRegC(next);
-                exConMove(registers, regA, regB, regC); 
-                break;
-
-            case SLOAD:
-                regA = getRegA(next);
-                regB = getRegB(next);
-                regC = getRegC(next);
-                exSegLoad(registers, regA, regB, regC, memory); 
-                break;
-
-            case SSTORE:
-                regA = getRegA(next);
-                regB = getRegB(next);
-                regC = getRegC(next);
-                exSegStore(registers, regC, regA, regB, memory);
-                break;
-
-            case ADD:
-                regA = getRegA(next);
-                regB = getRegB(next);
-                regC = getRegC(next);
-                exAddition(registers, regA, regB, regC); 
-                break;
-
-            case MUL:
-                regA = getRegA(next);
-                regB = getRegB(next);
-                regC = getRegC(next);
-                exMultiply(registers, regA, regB, regC);
-                break;
-
-            case DIV:
-                regA = getRegA(next);
-                regB = getRegB(next);
-                regC = getRegC(next);
-                exDivide(registers, regA, regB, regC);
-                break;
-
-            case NAND:
-                regA = getRegA(next);
-                regB = getRegB(next);
-                regC = getRegC(next);
-                exBitNAND(registers, regA, regB, regC);
-                break;
-
-            case HALT:
-                halt(memory, segIDs, prgmPtr);
-                loop = 0;
-                break;
-
-            case MAP:
-                regC = getRegC(next);
-                regB = getRegB(next);
-                mapSeg(registers, regC, regB, segIDs, memory);
-                break;
-
-            case UNMAP:
-                regC = getRegC(next);
-                unmapSeg(registers, regC, segIDs, memory); 
-                break;
-
-            case OUT:
-                regC = getRegC(next);
-                out(registers, regC);
-                break;
-
-            case IN:
-                regC = getRegC(next);
-                in(registers, regC); 
-                break;
-
-            case LOADP:
-                regB = getRegB(next);
-                regC = getRegC(next);
-                loadProgram(registers, regB, regC, memory, prgmPtr);
-                break;
-
-            case LV:
-                regA = getRegAprime(next);
-                exLoadVal(registers, regA, next);
-                break;
+static void usage(void){
+    fprintf(stderr, "USAGE ERROR | Proper Usage:"); 
+    fprintf(stderr, " ./um [--jit] [--threaded-io] [--mem-stats] [--profile]"
+                    "\n       [--profile-out file] [--checked] [--lazy-words n]"
+                    "\n       [--checkpoint file] [--telemetry name] "
+                    "[UMBinaryFile].um (- for stdin)\n       | --restore file"
+                    "\n");
+    fprintf(stderr, "       ./um [--profile] [--profile-out file] [--checked] "
+                    "[--lazy-words n]\n       --record log | --replay log "
+                    "[UMBinaryFile].um\n");
+    fprintf(stderr, "       ./um [--checked] [--lazy-words n] --batch manifest"
+                    " [--jobs n]\n");
+    fprintf(stderr, "       ./um --write-umx file [--umx-words] [--umx-pack] "
+                    "[UMBinaryFile].um\n");
+    fprintf(stderr, "       ./um [--jit] [--checked] [--lazy-words n] "
+                    "--fork-server socket\n       [--warm n] "
+                    "[UMBinaryFile].um | --fork-job socket\n");
+    exit(EXIT_FAILURE);
+}
 
-            default:
-                /* if OP code is invalid, halt the machine */
-                halt(memory, segIDs, prgmPtr);
-        }
-    }
+/* Name: printMemStats
+   Purpose: reports the segment arena's counters on stderr
+   Arguments: none
+   Return: void
+*/
+static void printMemStats(void){
+    memStats stats = getMemStats();
+    uint64_t pooled = stats.hits + stats.misses;
+    fprintf(stderr, "um: %" PRIu64 " segments allocated, %" PRIu64 
+            " from the pool (%.1f%% hit rate), %" PRIu64 " new, %" PRIu64 
+            " large, %" PRIu64 " lazy; pool held at most %zu bytes\n", 
+            stats.allocations, stats.hits, 
+            pooled ? 100.0 * stats.hits / pooled : 0.0, stats.misses, 
+            stats.large, stats.lazy, stats.peakHeld);
 }
 
 int main(int argc, char* argv[]){
     /* Check command line usage */
-    if (argc != 2){
-        fprintf(stderr, "USAGE ERROR | Proper Usage:"); 
-        fprintf(stderr, " ./um [UMBinaryFile].um\n");
-        exit(EXIT_FAILURE);
+    int useJit = 0;
+    int memStats = 0;
+    int threadedIO = 0;
+    int profiling = 0;
+    const char * profileOut = NULL;
+    int checked = 0;
+    const char * image = NULL;
+    const char * checkpoint = NULL;
+    const char * restore = NULL;
+    const char * manifest = NULL;
+    const char * recordLog = NULL;
+    const char * replayLog = NULL;
+    const char * cacheOut = NULL;
+    const char * telemetry = NULL;
+    const char * forkServer = NULL;
+    const char * forkJob = NULL;
+    uint64_t warm = 0;
+    unsigned cacheFlags = UMX_RECORDS;
+    int jobs = 0;
+    for (int i = 1; i < argc; i++){
+        if (strcmp(argv[i], "--jit") == 0){
+            useJit = 1;
+        }
+        else if (strcmp(argv[i], "--threaded-io") == 0){
+            threadedIO = 1;
+        }
+        else if (strcmp(argv[i], "--mem-stats") == 0){
+            memStats = 1;
+        }
+        else if (strcmp(argv[i], "--profile") == 0){
+            profiling = 1;
+        }
+        else if (strcmp(argv[i], "--profile-out") == 0 && i + 1 < argc){
+            profileOut = argv[++i];
+        }
+        else if (strcmp(argv[i], "--checked") == 0){
+            checked = 1;
+        }
+        else if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc){
+            checkpoint = argv[++i];
+        }
+        else if (strcmp(argv[i], "--restore") == 0 && i + 1 < argc){
+            restore = argv[++i];
+        }
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc){
+            recordLog = argv[++i];
+        }
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc){
+            replayLog = argv[++i];
+        }
+        else if (strcmp(argv[i], "--telemetry") == 0 && i + 1 < argc){
+            telemetry = argv[++i];
+        }
+        else if (strcmp(argv[i], "--fork-server") == 0 && i + 1 < argc){
+            forkServer = argv[++i];
+        }
+        else if (strcmp(argv[i], "--warm") == 0 && i + 1 < argc){
+            char * end;
+            const char * arg = argv[++i];
+            errno = 0;
+            warm = strtoull(arg, &end, 10);
+            if (end == arg || *end != '\0' || arg[0] == '-' ||
+                errno == ERANGE || warm == 0){
+                usage();
+            }
+        }
+        else if (strcmp(argv[i], "--fork-job") == 0 && i + 1 < argc){
+            forkJob = argv[++i];
+        }
+        else if (strcmp(argv[i], "--write-umx") == 0 && i + 1 < argc){
+            cacheOut = argv[++i];
+        }
+        else if (strcmp(argv[i], "--umx-words") == 0){
+            cacheFlags &= ~UMX_RECORDS;
+        }
+        else if (strcmp(argv[i], "--umx-pack") == 0){
+            cacheFlags |= UMX_PACKED;
+        }
+        else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc){
+            manifest = argv[++i];
+        }
+        else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc){
+            char * end;
+            long count = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || count <= 0 || count > INT_MAX){
+                usage();
+            }
+            jobs = (int)count;
+        }
+        else if (strcmp(argv[i], "--lazy-words") == 0 && i + 1 < argc){
+            char * end;
+            const char * arg = argv[++i];
+            errno = 0;
+            unsigned long words = strtoul(arg, &end, 10);
+            if (end == arg || *end != '\0' || arg[0] == '-' ||
+                errno == ERANGE || words > UINT32_MAX){
+                usage();
+            }
+            setLazyThreshold((uint32_t)words);
+        }
+        else if (image == NULL && (argv[i][0] != '-' || argv[i][1] == '\0')){
+            image = argv[i];
+        }
+        else {
+            usage();
+        }
     }
-
-    /* declare and initialize an array of words to represent the registers */
-    word registers[REG_COUNT];
-    for (int i = 0; i < REG_COUNT; i++){
-        registers[i] = 0;
+    int profiled = profiling || profileOut != NULL;
+    if (forkJob != NULL){
+        /* a job brings nothing but its descriptors */
+        if (argc != 3){
+            usage();
+        }
+        return runForkJob(forkJob);
+    }
+    if (cacheOut != NULL || cacheFlags != UMX_RECORDS){
+        /* writing a cache of the image runs nothing */
+        if (cacheOut == NULL || image == NULL || restore != NULL || 
+            manifest != NULL || checkpoint != NULL || recordLog != NULL ||
+            replayLog != NULL){
+            usage();
+        }
+        Segment program = loadImage(image);
+        int failed = writeCache(cacheOut, image, program, cacheFlags);
+        if (failed){
+            fprintf(stderr, "um: cannot write %s: %s\n", cacheOut, 
+                    strerror(errno));
+        }
+        deallocate(program);
+        return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+    if (useJit && !UM_JIT){
+        fprintf(stderr, "um: JIT not built for this host, interpreting\n");
+    }
+    unsigned flags = (useJit ? UM_USE_JIT : 0) | (checked ? UM_CHECKED : 0);
+    if (manifest != NULL){
+        /* a batch runs many machines: no single image, no snapshots. its
+         * machines run in quanta, interpreted, with no I/O threads.
+         */
+        if (image != NULL || restore != NULL || checkpoint != NULL || 
+            profiled || memStats || threadedIO || recordLog != NULL ||
+            replayLog != NULL || telemetry != NULL){
+            usage();
+        }
+        if (useJit){
+            fprintf(stderr, "um: --batch runs machines a quantum at a time, "
+                            "running without the JIT\n");
+        }
+        return runBatch(manifest, jobs, flags) ? EXIT_FAILURE 
+                                               : EXIT_SUCCESS;
+    }
+    if (forkServer != NULL || warm != 0){
+        /* the server's children run on their jobs' descriptors, so there
+         * is nothing to record, checkpoint or publish for a single run
+         */
+        if (forkServer == NULL || image == NULL || restore != NULL || 
+            checkpoint != NULL || profiled || memStats || threadedIO || 
+            recordLog != NULL || replayLog != NULL || telemetry != NULL){
+            usage();
+        }
+        return runForkServer(forkServer, image, warm, flags) ? EXIT_FAILURE
+                                                             : EXIT_SUCCESS;
+    }
+    if ((image == NULL) == (restore == NULL) || (profiled && checked) ||
+        (telemetry != NULL && (profiled || checked || recordLog != NULL ||
+                               replayLog != NULL))){
+        usage();
+    }
+    if (recordLog != NULL || replayLog != NULL){
+        /* a log starts from the image: no snapshots, no I/O threads */
+        if ((recordLog != NULL && replayLog != NULL) || restore != NULL || 
+            checkpoint != NULL || threadedIO){
+            usage();
+        }
+        if (useJit){
+            fprintf(stderr, "um: --%s counts every instruction, running "
+                            "without the JIT\n", 
+                    recordLog != NULL ? "record" : "replay");
+        }
+    }
+    if (useJit && profiled){
+        fprintf(stderr, "um: --profile counts interpreted code only, "
+                        "running without the JIT\n");
+    }
+    if (useJit && checked){
+        fprintf(stderr, "um: --checked interprets every instruction, "
+                        "running without the JIT\n");
+    }
+    if (useJit && telemetry != NULL){
+        fprintf(stderr, "um: --telemetry counts every instruction, "
+                        "running without the JIT\n");
+    }
+    umTelemetry * tele = NULL;
+    if (telemetry != NULL && (tele = newTelemetry(telemetry)) == NULL){
+        fprintf(stderr, "um: cannot publish telemetry as %s: %s\n", 
+                telemetry, strerror(errno));
+        return EXIT_FAILURE;
     }
 
-    /* declare and initialize our memory sequence and segment 0 
-     * put segment 0 into memory 
-     */                                 
-    Seq_T memory = Seq_new(5);
-    Seq_T zero = Seq_new(5);
-    Seq_addlo(memory, zero);
-    Seq_T segIDs = Seq_new(5);
-
-    /* allocate space for program pointer */
-    uint32_t * prgmPtr = malloc(sizeof(*prgmPtr));
-    *prgmPtr = 0;
-
-    /* read in the size of the UM binary file passed */
-    struct stat st;
-    stat(argv[1], &st);
-    int length = st.st_size;
-
-    /* open the UM binary file */
-    FILE * binary = fopen(argv[1], "r");
-    assert(binary != NULL);
-
-    /* read the contents of the binary file in to segment 0 */
-    readFile(binary, length, Seq_get(memory, 0));
-
-    /* order operations for each instruction in segment 0 until all 
-     * instructions have been executed properly
-     */                     
-    orderOp(memory, segIDs, registers, prgmPtr);
+    /* read the UM binary file in to segment 0 of a new machine, or pick 
+     * the machine up where a snapshot left it. checkpoints into the file
+     * restored from carry on after its last complete checkpoint.
+     */
+    umMachine * machine = umNew(flags);
+    uint64_t snapEnd = 0;
+    int continuing = restore != NULL && checkpoint != NULL && 
+                     sameFile(restore, checkpoint);
+    if (restore != NULL){
+        umRestore(machine, restore, continuing, &snapEnd);
+    }
+    else {
+        umLoadImage(machine, image);
+    }
+    umSnapshot * snap = checkpoint == NULL ? NULL : 
+                        newSnapshot(checkpoint, continuing ? snapEnd : 0);
+    umSetSnapshot(machine, snap);
 
-    /* close the binary file */
-    fclose(binary);
+    /* run it until it halts (it can't block on descriptors), or until a
+     * replay differs from its log
+     */
+    umProfile * prof = profiled ? newProfile() : NULL;
+    umSetProfile(machine, prof);
+    umSetTelemetry(machine, tele);
+    umIO * io = NULL;
+    umReplay * recorder = NULL;
+    umStatus status;
+    if (recordLog != NULL || replayLog != NULL){
+        recorder = recordLog != NULL ? 
+              newRecording(recordLog, STDIN_FILENO, STDOUT_FILENO) :
+              openReplay(replayLog, STDOUT_FILENO);
+        status = replayRun(recorder, machine);
+    }
+    else {
+        io = newIO(STDIN_FILENO, STDOUT_FILENO, threadedIO);
+        umSetIO(machine, io);
+        /* with telemetry, the counters are published between quanta */
+        do {
+            status = umRun(machine, tele != NULL ? TELEMETRY_QUANTUM : 0);
+        } while (status == UM_BUDGET);
+    }
+    assert(status == UM_HALTED || status == UM_FAULT || recorder != NULL);
+    if (status == UM_FAULT){
+        umFaultReport(machine, stderr);
+    }
+    int diverged = recorder != NULL && replayDiverged(recorder);
+    umFree(machine);
+    releaseArena();
+    freeIO(io);
+    freeReplay(recorder);
+    freeSnapshot(snap);
+    freeTelemetry(tele);
+    if (profiling){
+        profileReport(prof, stderr);
+    }
+    if (profileOut != NULL){
+        FILE * fp = fopen(profileOut, "w");
+        if (fp == NULL){
+            fprintf(stderr, "um: cannot write %s\n", profileOut);
+            return EXIT_FAILURE;
+        }
+        profileDump(prof, fp);
+        fclose(fp);
+    }
+    freeProfile(prof);
+    if (memStats){
+        printMemStats();
+    }
 
-    return 0;
-}
\ No newline at end of file
+    return diverged ? DIVERGE_EXIT : 
+           status == UM_FAULT ? FAULT_EXIT : EXIT_SUCCESS;
+}
@@ -0,0 +1,473 @@
+/* Authors: John Little (jlittl04) & Aryan Pandey (apande04)
+ * Date: November 2019
+ * The Universal Machine
+ * File: umio.c - implementation for the UM I/O package
+ *
+ * in both modes the machine writes output into a local batch. unthreaded,
+ * a full batch is written with write() and input is read with read() a
+ * batch at a time, writing pending output first. threaded, a full batch is
+ * pushed into the output ring and a writer thread drains it; a reader
+ * thread keeps the input ring topped up. when the machine wants input
+ * that hasn't arrived yet, it waits for every byte of output to be written
+ * first, so a prompt is always visible before the machine blocks on input.
+ *
+ * the rings are lock free: head only moves in the consumer and tail only
+ * in the producer. the mutex and condition variable are only touched by a
+ * side that has to sleep, and by the other side when it sees a sleeper.
+ *
+ * with callbacks, batches are handed to them in place of write() and 
+ * read(); a read callback with nothing to give yet makes ioGet answer
+ * UMIO_AGAIN, and the next ioGet asks it again.
+ */
+
+#include "umio.h"
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#define IO_BATCH (64u << 10)      /* bytes batched by the machine */
+#define IO_RING (1u << 20)        /* bytes in each ring, a power of two */
+
+typedef struct ring {
+        unsigned char * buf;
+        size_t head;
+        char padHead[64];
+        size_t tail;
+        char padTail[64];
+        int closed;
+        int waiting;
+        pthread_mutex_t lock;
+        pthread_cond_t cond;
+} ring;
+
+struct umIO {
+        int inFd;
+        int outFd;
+        int threaded;
+        umIOCallbacks callbacks;
+        unsigned char out[IO_BATCH];
+        size_t outLen;
+        unsigned char in[IO_BATCH];
+        size_t inPos;
+        size_t inLen;
+        int inEOF;
+        uint64_t bytesIn;       /* read in batches so far */
+        uint64_t bytesOut;      /* passed on in batches so far */
+        ring * inRing;
+        ring * outRing;
+        pthread_t reader;
+        pthread_t writer;
+};
+
+/*--------------------------------------------------------------------------*/
+/*                                the rings                                 */
+/*--------------------------------------------------------------------------*/
+
+static ring * newRing(void){
+    ring * r = calloc(1, sizeof(*r));
+    assert(r != NULL);
+    r->buf = malloc(IO_RING);
+    assert(r->buf != NULL);
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->cond, NULL);
+    return r;
+}
+
+static void freeRing(ring * r){
+    pthread_mutex_destroy(&r->lock);
+    pthread_cond_destroy(&r->cond);
+    free(r->buf);
+    free(r);
+}
+
+static inline size_t ringUsed(ring * r){
+    return __atomic_load_n(&r->tail, __ATOMIC_SEQ_CST) -
+           __atomic_load_n(&r->head, __ATOMIC_SEQ_CST);
+}
+
+static inline int ringClosed(ring * r){
+    return __atomic_load_n(&r->closed, __ATOMIC_SEQ_CST);
+}
+
+static int hasData(ring * r){
+    return ringUsed(r) > 0 || ringClosed(r);
+}
+
+static int hasSpace(ring * r){
+    return ringUsed(r) < IO_RING || ringClosed(r);
+}
+
+static int drained(ring * r){
+    return ringUsed(r) == 0;
+}
+
+/* Name: ringWait
+   Purpose: sleeps until a condition on a ring holds
+   Arguments: ring, condition
+   Return: void
+*/
+static void ringWait(ring * r, int (*ready)(ring *)){
+    if (ready(r)){
+        return;
+    }
+    pthread_mutex_lock(&r->lock);
+    __atomic_add_fetch(&r->waiting, 1, __ATOMIC_SEQ_CST);
+    while (!ready(r)){
+        pthread_cond_wait(&r->cond, &r->lock);
+    }
+    __atomic_sub_fetch(&r->waiting, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&r->lock);
+}
+
+/* Name: ringNotify
+   Purpose: wakes anyone sleeping on a ring after head, tail or closed move
+   Arguments: ring
+   Return: void
+*/
+static void ringNotify(ring * r){
+    if (__atomic_load_n(&r->waiting, __ATOMIC_SEQ_CST) > 0){
+        pthread_mutex_lock(&r->lock);
+        pthread_cond_broadcast(&r->cond);
+        pthread_mutex_unlock(&r->lock);
+    }
+}
+
+static void ringClose(ring * r){
+    __atomic_store_n(&r->closed, 1, __ATOMIC_SEQ_CST);
+    ringNotify(r);
+}
+
+/* Name: ringPush
+   Purpose: copies bytes into a ring, waiting for space as needed
+            (producer side)
+   Arguments: ring, bytes, count
+   Return: void
+*/
+static void ringPush(ring * r, const unsigned char * src, size_t count){
+    while (count > 0){
+        ringWait(r, hasSpace);
+        size_t tail = r->tail;
+        size_t space = IO_RING - ringUsed(r);
+        size_t at = tail & (IO_RING - 1);
+        size_t n = count < space ? count : space;
+        if (n > IO_RING - at){
+            n = IO_RING - at;
+        }
+        memcpy(r->buf + at, src, n);
+        __atomic_store_n(&r->tail, tail + n, __ATOMIC_SEQ_CST);
+        ringNotify(r);
+        src += n;
+        count -= n;
+    }
+}
+
+/* Name: ringPeek
+   Purpose: finds the bytes that can be read from a ring in one piece
+            (consumer side)
+   Arguments: ring, where to put a pointer to them
+   Return: size_t -- how many there are
+*/
+static size_t ringPeek(ring * r, unsigned char ** at){
+    size_t used = ringUsed(r);
+    size_t offset = r->head & (IO_RING - 1);
+    *at = r->buf + offset;
+    return used < IO_RING - offset ? used : IO_RING - offset;
+}
+
+static void ringAdvance(ring * r, size_t count){
+    __atomic_store_n(&r->head, r->head + count, __ATOMIC_SEQ_CST);
+    ringNotify(r);
+}
+
+/*--------------------------------------------------------------------------*/
+/*                       the reader and writer threads                      */
+/*--------------------------------------------------------------------------*/
+
+/* Name: writeAll
+   Purpose: writes every byte, retrying short writes. output that can't be
+            written at all is dropped.
+   Arguments: file descriptor, bytes, count
+   Return: void
+*/
+static void writeAll(int fd, const unsigned char * src, size_t count){
+    while (count > 0){
+        ssize_t done = write(fd, src, count);
+        if (done < 0 && errno == EINTR){
+            continue;
+        }
+        if (done <= 0){
+            return;
+        }
+        src += done;
+        count -= (size_t)done;
+    }
+}
+
+/* Name: writer
+   Purpose: drains the output ring into the output descriptor. bytes leave
+            the ring only once written, so an empty ring means all output
+            is out.
+   Arguments: the umIO
+   Return: NULL
+*/
+static void * writer(void * arg){
+    umIO * io = arg;
+    for (;;){
+        ringWait(io->outRing, hasData);
+        unsigned char * at;
+        size_t n = ringPeek(io->outRing, &at);
+        if (n == 0){
+            return NULL;
+        }
+        writeAll(io->outFd, at, n);
+        ringAdvance(io->outRing, n);
+    }
+}
+
+/* Name: reader
+   Purpose: fills the input ring from the input descriptor until end of
+            file. it can only be cancelled while blocked in read().
+   Arguments: the umIO
+   Return: NULL
+*/
+static void * reader(void * arg){
+    umIO * io = arg;
+    ring * r = io->inRing;
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+    for (;;){
+        ringWait(r, hasSpace);
+        if (ringClosed(r)){
+            return NULL;
+        }
+        size_t tail = r->tail;
+        size_t at = tail & (IO_RING - 1);
+        size_t space = IO_RING - ringUsed(r);
+        size_t n = space < IO_RING - at ? space : IO_RING - at;
+
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+        ssize_t got = read(io->inFd, r->buf + at, n);
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+        if (got < 0 && errno == EINTR){
+            continue;
+        }
+        if (got <= 0){
+            ringClose(r);
+            return NULL;
+        }
+        __atomic_store_n(&r->tail, tail + (size_t)got, __ATOMIC_SEQ_CST);
+        ringNotify(r);
+    }
+}
+
+/*--------------------------------------------------------------------------*/
+/*                              the interface                               */
+/*--------------------------------------------------------------------------*/
+
+/* Name: newIO
+   Purpose: sets up the machine's I/O, starting the reader and writer
+            threads in threaded mode
+   Arguments: input and output descriptors, threaded flag
+   Return: umIO pointer
+*/
+umIO * newIO(int inFd, int outFd, int threaded){
+    umIO * io = calloc(1, sizeof(*io));
+    assert(io != NULL);
+    io->inFd = inFd;
+    io->outFd = outFd;
+    io->threaded = threaded;
+
+    if (threaded){
+        io->inRing = newRing();
+        io->outRing = newRing();
+        int failed = pthread_create(&io->reader, NULL, reader, io) ||
+                     pthread_create(&io->writer, NULL, writer, io);
+        assert(!failed);
+        (void)failed;
+    }
+    return io;
+}
+
+/* Name: newCallbackIO
+   Purpose: sets up the machine's I/O to go through callbacks
+   Arguments: the callbacks (both must be given)
+   Return: umIO pointer
+*/
+umIO * newCallbackIO(umIOCallbacks callbacks){
+    assert(callbacks.read != NULL && callbacks.write != NULL);
+    umIO * io = newIO(-1, -1, 0);
+    io->callbacks = callbacks;
+    return io;
+}
+
+/* Name: pushOutput
+   Purpose: hands the current output batch on -- to the output descriptor,
+            the write callback or the writer thread
+   Arguments: the umIO
+   Return: void
+*/
+static void pushOutput(umIO * io){
+    if (io->outLen == 0){
+        return;
+    }
+    if (io->threaded){
+        ringPush(io->outRing, io->out, io->outLen);
+    }
+    else if (io->callbacks.write != NULL){
+        io->callbacks.write(io->callbacks.cl, io->out, io->outLen);
+    }
+    else {
+        writeAll(io->outFd, io->out, io->outLen);
+    }
+    io->bytesOut += io->outLen;
+    io->outLen = 0;
+}
+
+/* Name: ioFlush
+   Purpose: returns once every byte the machine has output is written
+   Arguments: the umIO
+   Return: void
+*/
+void ioFlush(umIO * io){
+    assert(io != NULL);
+    pushOutput(io);
+    if (io->threaded){
+        ringWait(io->outRing, drained);
+    }
+}
+
+/* Name: ioPut
+   Purpose: outputs one byte
+   Arguments: the umIO, the byte
+   Return: void
+*/
+void ioPut(umIO * io, unsigned char c){
+    io->out[io->outLen++] = c;
+    if (io->outLen == IO_BATCH){
+        pushOutput(io);
+    }
+}
+
+/* Name: refill
+   Purpose: gets the next batch of input, making sure all output is
+            visible before blocking for it
+   Arguments: the umIO
+   Return: int -- 0 if the read callback had none yet, else 1
+*/
+static int refill(umIO * io){
+    io->inPos = 0;
+    io->inLen = 0;
+    if (io->threaded){
+        pushOutput(io);
+        if (!hasData(io->inRing)){
+            ioFlush(io);
+            ringWait(io->inRing, hasData);
+        }
+        unsigned char * at;
+        size_t n = ringPeek(io->inRing, &at);
+        n = n < IO_BATCH ? n : IO_BATCH;
+        memcpy(io->in, at, n);
+        ringAdvance(io->inRing, n);
+        io->inLen = n;
+        io->bytesIn += n;
+        io->inEOF = (n == 0);
+        return 1;
+    }
+
+    ioFlush(io);
+    if (io->callbacks.read != NULL){
+        long got = io->callbacks.read(io->callbacks.cl, io->in, IO_BATCH);
+        if (got == UMIO_AGAIN){
+            return 0;
+        }
+        io->inEOF = (got <= 0);
+        io->inLen = got > 0 ? (size_t)got : 0;
+        io->bytesIn += io->inLen;
+        return 1;
+    }
+    for (;;){
+        ssize_t got = read(io->inFd, io->in, IO_BATCH);
+        if (got < 0 && errno == EINTR){
+            continue;
+        }
+        if (got <= 0){
+            io->inEOF = 1;
+            return 1;
+        }
+        io->inLen = (size_t)got;
+        io->bytesIn += io->inLen;
+        return 1;
+    }
+}
+
+/* Name: ioGet
+   Purpose: inputs one byte
+   Arguments: the umIO
+   Return: int -- the byte, UMIO_EOF once input has ended, or UMIO_AGAIN
+           if the read callback has none yet
+*/
+int ioGet(umIO * io){
+    assert(io != NULL);
+    if (io->inPos == io->inLen){
+        if (io->inEOF){
+            return UMIO_EOF;
+        }
+        if (!refill(io)){
+            return UMIO_AGAIN;
+        }
+        if (io->inEOF){
+            return UMIO_EOF;
+        }
+    }
+    return io->in[io->inPos++];
+}
+
+/* Name: ioReady
+   Purpose: tells whether ioGet can answer without waiting for input 
+            (a byte is already buffered, or input has ended)
+   Arguments: the umIO
+   Return: int -- 1 if so, else 0
+*/
+int ioReady(umIO * io){
+    assert(io != NULL);
+    if (io->inPos < io->inLen || io->inEOF){
+        return 1;
+    }
+    return io->threaded && hasData(io->inRing);
+}
+
+/* Name: freeIO
+   Purpose: writes any pending output, stops the threads and frees the I/O
+   Arguments: the umIO
+   Return: void
+*/
+void freeIO(umIO * io){
+    if (io == NULL){
+        return;
+    }
+    pushOutput(io);
+    if (io->threaded){
+        ringClose(io->outRing);
+        pthread_join(io->writer, NULL);
+        ringClose(io->inRing);
+        pthread_cancel(io->reader);
+        pthread_join(io->reader, NULL);
+        freeRing(io->inRing);
+        freeRing(io->outRing);
+    }
+    free(io);
+}
+
+/* Name: ioCounts
+   Purpose: counts the bytes the machine has taken in and put out, from
+            the totals kept a batch at a time (so IN and OUT pay nothing
+            for them)
+   Arguments: the umIO, where to put each count
+   Return: void
+*/
+void ioCounts(umIO * io, uint64_t * in, uint64_t * out){
+    assert(io != NULL && in != NULL && out != NULL);
+    *in = io->bytesIn - (io->inLen - io->inPos);
+    *out = io->bytesOut + io->outLen;
+}
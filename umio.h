@@ -0,0 +1,50 @@
+/* Authors: John Little (jlittl04) & Aryan Pandey (apande04)
+ * Date: November 2019
+ * The Universal Machine
+ * File: umio.h - header file for the UM I/O package
+ */
+
+#ifndef UMIO_H
+#define UMIO_H
+
+#include <stdlib.h>
+#include <inttypes.h>
+
+/* all of the machine's input and output goes through a umIO. output is
+ * batched and written when the batch fills, when the machine asks for
+ * input and when it halts. in threaded mode a reader thread and a writer
+ * thread move the bytes through lock-free single producer / single
+ * consumer rings, so blocking reads and writes overlap with execution.
+ * a umIO can also move its bytes through callbacks instead of file 
+ * descriptors (never threaded), which lets a host embedding the machine
+ * (see libum.h) feed it input as it arrives.
+ */
+typedef struct umIO umIO;
+
+#define UMIO_EOF (-1)
+#define UMIO_AGAIN (-2)
+
+typedef struct umIOCallbacks {
+        /* reads up to count bytes into buf: returns how many, 0 at the end
+         * of input or UMIO_AGAIN when none have arrived yet */
+        long (*read)(void * cl, unsigned char * buf, size_t count);
+        /* takes count bytes of output */
+        void (*write)(void * cl, const unsigned char * buf, size_t count);
+        void * cl;
+} umIOCallbacks;
+
+/* creating and freeing (freeIO flushes any pending output) */
+umIO * newIO(int inFd, int outFd, int threaded);
+umIO * newCallbackIO(umIOCallbacks callbacks);
+void freeIO(umIO * io);
+
+/* moving bytes */
+void ioPut(umIO * io, unsigned char c);
+int ioGet(umIO * io);
+int ioReady(umIO * io);
+void ioFlush(umIO * io);
+
+/* bytes the machine has read and written so far */
+void ioCounts(umIO * io, uint64_t * in, uint64_t * out);
+
+#endif
@@ -0,0 +1,684 @@
+/* Authors: John Little (jlittl04) & Aryan Pandey (apande04)
+ * Date: November 2019
+ * The Universal Machine
+ * File: umx.c - implementation for cached program images
+ *
+ * a cache is laid out as
+ *     header | block table | word blocks | record blocks
+ * the words of segment 0 and its decoded records are two streams, each
+ * cut into UMX_BLOCK byte blocks and checksummed whole. a block is packed
+ * LZ4 style -- runs of literal bytes, each followed by a copy of earlier
+ * bytes in the block -- unless that doesn't make it a quarter smaller,
+ * when it is stored as it is. the table gives each block's size both
+ * ways. a stream stored whole can be used in place in a mapping of the
+ * file: it is 8 byte aligned, the words after room for a segHeader. numbers
+ * are in host order: a cache written by another host (or version) fails
+ * the order and version checks in its header.
+ */
+
+#include "umx.h"
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "decode.h"
+
+#define UMX_BLOCK (UINT32_C(1) << 20)   /* stream bytes per block */
+#define UMX_ORDER 0x01020304u
+
+#define LZ_MIN 4                /* shortest copy */
+#define LZ_WINDOW 0xFFFFu       /* furthest a copy reaches back */
+#define LZ_HASH_BITS 14
+
+/* opcode 15 as the first word of a .um image */
+static const unsigned char umxMagic[4] = { 0xF5, 'U', 'M', 'X' };
+
+typedef struct umxHeader {
+        unsigned char magic[4];
+        uint32_t version;
+        uint32_t order;         /* UMX_ORDER as the writing host stored it */
+        uint32_t words;         /* in segment 0 */
+        uint32_t recordSize;    /* sizeof(umDecoded), 0 without records */
+        uint32_t decodeVersion; /* DECODE_VERSION the records were made by */
+        uint32_t wordBlocks;
+        uint32_t recordBlocks;
+        uint64_t wordSum;       /* checksums of the unpacked streams */
+        uint64_t recordSum;
+        uint64_t sourceSize;    /* the image it was written from */
+        int64_t sourceSec;      /* and its modification time */
+        int64_t sourceNsec;
+} umxHeader;
+
+typedef struct umxBlock {
+        uint32_t raw;           /* bytes it unpacks to */
+        uint32_t stored;        /* bytes in the file (raw if not packed) */
+} umxBlock;
+
+static inline uint32_t blocksFor(size_t length){
+    return (uint32_t)((length + UMX_BLOCK - 1) / UMX_BLOCK);
+}
+
+static inline uint64_t align8(uint64_t n){
+    return (n + 7) & ~(uint64_t)7;
+}
+
+static inline uint32_t load32(const unsigned char * p){
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/* Name: checksum
+   Purpose: hashes a stream 8 bytes at a time (FNV-1a over 64 bit words)
+   Arguments: bytes, byte count
+   Return: uint64_t
+*/
+static uint64_t checksum(const unsigned char * bytes, size_t length){
+    uint64_t hash = UINT64_C(0xCBF29CE484222325);
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8){
+        uint64_t chunk;
+        memcpy(&chunk, bytes + i, sizeof(chunk));
+        hash = (hash ^ chunk) * UINT64_C(0x100000001B3);
+    }
+    for (; i < length; i++){
+        hash = (hash ^ bytes[i]) * UINT64_C(0x100000001B3);
+    }
+    return hash;
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                 the codec                                */
+/*--------------------------------------------------------------------------*/
+
+/* Name: putLength
+   Purpose: writes the part of a length a token's nibble couldn't hold
+   Arguments: where to write, end of the room, length less 15
+   Return: unsigned char * -- just past it, or NULL if it didn't fit
+*/
+static unsigned char * putLength(unsigned char * op, unsigned char * end,
+                                 size_t length){
+    for (; length >= 255; length -= 255){
+        if (op == end){
+            return NULL;
+        }
+        *op++ = 255;
+    }
+    if (op == end){
+        return NULL;
+    }
+    *op++ = (unsigned char)length;
+    return op;
+}
+
+/* Name: putSequence
+   Purpose: writes a run of literals and the copy after it (none for the
+            last run): a token holding both lengths, up to 15 each, the
+            rest of the literal length, the literals, the copy's 16 bit
+            distance back and the rest of its length
+   Arguments: where to write, end of the room, literals, literal count,
+              copy distance, copy length (0 for none)
+   Return: unsigned char * -- just past it, or NULL if it didn't fit
+*/
+static unsigned char * putSequence(unsigned char * op, unsigned char * end,
+                                   const unsigned char * literals,
+                                   size_t count, uint32_t distance,
+                                   size_t length){
+    size_t extra = length ? length - LZ_MIN : 0;
+    if (op == end){
+        return NULL;
+    }
+    *op++ = (unsigned char)((count < 15 ? count : 15) << 4 |
+                            (extra < 15 ? extra : 15));
+    if (count >= 15 && (op = putLength(op, end, count - 15)) == NULL){
+        return NULL;
+    }
+    if ((size_t)(end - op) < count){
+        return NULL;
+    }
+    memcpy(op, literals, count);
+    op += count;
+    if (length == 0){
+        return op;
+    }
+    if (end - op < 2){
+        return NULL;
+    }
+    *op++ = (unsigned char)distance;
+    *op++ = (unsigned char)(distance >> 8);
+    if (extra >= 15){
+        op = putLength(op, end, extra - 15);
+    }
+    return op;
+}
+
+/* Name: packBlock
+   Purpose: packs a block, finding copies through a table of where each
+            4 byte sequence (by hash) was last seen
+   Arguments: block, its size, where to write, room there, the table
+              (1 << LZ_HASH_BITS entries)
+   Return: size_t -- bytes written, or 0 if they didn't fit
+*/
+static size_t packBlock(const unsigned char * src, size_t length,
+                        unsigned char * trgt, size_t room, uint32_t * seen){
+    memset(seen, 0xFF, sizeof(*seen) << LZ_HASH_BITS);
+    unsigned char * op = trgt;
+    unsigned char * end = trgt + room;
+    size_t anchor = 0;
+    size_t ip = 0;
+    while (ip + LZ_MIN <= length){
+        uint32_t sequence = load32(src + ip);
+        uint32_t slot = (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+        uint32_t from = seen[slot];
+        seen[slot] = (uint32_t)ip;
+        if (from == UINT32_MAX || ip - from > LZ_WINDOW ||
+            load32(src + from) != sequence){
+            ip++;
+            continue;
+        }
+        size_t copy = LZ_MIN;
+        while (ip + copy < length && src[from + copy] == src[ip + copy]){
+            copy++;
+        }
+        op = putSequence(op, end, src + anchor, ip - anchor,
+                         (uint32_t)(ip - from), copy);
+        if (op == NULL){
+            return 0;
+        }
+        ip += copy;
+        anchor = ip;
+    }
+    op = putSequence(op, end, src + anchor, length - anchor, 0, 0);
+    return op == NULL ? 0 : (size_t)(op - trgt);
+}
+
+/* Name: getLength
+   Purpose: reads the rest of a length whose nibble was 15
+   Arguments: where to read (advanced), end of the input, length so far
+   Return: int -- 0, or -1 if the input ends first
+*/
+static int getLength(const unsigned char ** ip, const unsigned char * end,
+                     size_t * length){
+    unsigned char more;
+    do {
+        if (*ip == end){
+            return -1;
+        }
+        more = *(*ip)++;
+        *length += more;
+    } while (more == 255);
+    return 0;
+}
+
+/* Name: unpackBlock
+   Purpose: unpacks a block, checking every length and distance against
+            the input and output, so a damaged block can't write outside
+            its room. short runs are copied 16 or 8 bytes at a time where
+            there is room to spare, writing past their end.
+   Arguments: packed block, its size, where to unpack, the block's size
+   Return: int -- 0, or -1 if the block is damaged
+*/
+static int unpackBlock(const unsigned char * src, size_t length,
+                       unsigned char * trgt, size_t raw){
+    const unsigned char * ip = src;
+    const unsigned char * end = src + length;
+    unsigned char * op = trgt;
+    unsigned char * stop = trgt + raw;
+    for (;;){
+        if (ip == end){
+            return -1;
+        }
+        unsigned char token = *ip++;
+        size_t count = token >> 4;
+        if (count == 15 && getLength(&ip, end, &count) != 0){
+            return -1;
+        }
+        if ((size_t)(end - ip) < count || (size_t)(stop - op) < count){
+            return -1;
+        }
+        if (count <= 16 && end - ip >= 16 && stop - op >= 16){
+            memcpy(op, ip, 16);         /* the spare bytes are written over */
+        }
+        else {
+            memcpy(op, ip, count);
+        }
+        ip += count;
+        op += count;
+        if (ip == end){
+            return op == stop ? 0 : -1;
+        }
+
+        if (end - ip < 2){
+            return -1;
+        }
+        size_t distance = ip[0] | (size_t)ip[1] << 8;
+        ip += 2;
+        size_t copy = token & 15;
+        if (copy == 15 && getLength(&ip, end, &copy) != 0){
+            return -1;
+        }
+        copy += LZ_MIN;
+        if (distance == 0 || distance > (size_t)(op - trgt) ||
+            (size_t)(stop - op) < copy){
+            return -1;
+        }
+        if (distance >= 8 && (size_t)(stop - op) >= copy + 8){
+            unsigned char * from = op - distance;
+            for (size_t done = 0; done < copy; done += 8){
+                memcpy(op + done, from + done, 8);
+            }
+            op += copy;
+        }
+        else {
+            /* a copy that overlaps itself repeats its first distance
+             * bytes: copy what is there, which doubles each time round
+             */
+            unsigned char * from = op - distance;
+            while (copy > 0){
+                size_t step = (size_t)(op - from) < copy ? 
+                              (size_t)(op - from) : copy;
+                memcpy(op, from, step);
+                op += step;
+                copy -= step;
+            }
+        }
+    }
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                  caches                                  */
+/*--------------------------------------------------------------------------*/
+
+/* Name: streamsAt
+   Purpose: finds where a cache's streams start. each is 8 byte aligned,
+            with room for a segHeader before the words, so a stream stored
+            unpacked can be used where it lies in a mapping of the file.
+   Arguments: header, where to put the records' offset (given the words'
+              stored size)
+   Return: uint64_t -- offset of the words
+*/
+static uint64_t streamsAt(const umxHeader * header, uint64_t wordStored,
+                          uint64_t * recordsAt){
+    uint64_t tableEnd = sizeof(*header) + ((uint64_t)header->wordBlocks +
+                        header->recordBlocks) * sizeof(umxBlock);
+    uint64_t wordsAt = align8(tableEnd) + sizeof(segHeader);
+    *recordsAt = align8(wordsAt + wordStored);
+    return wordsAt;
+}
+
+/* Name: padTo
+   Purpose: writes zeros up to an offset in a file
+   Arguments: open file, offset
+   Return: int -- 0, or -1 if a write failed
+*/
+static int padTo(FILE * fp, uint64_t offset){
+    long at = ftell(fp);
+    for (; at >= 0 && (uint64_t)at < offset; at++){
+        if (putc(0, fp) == EOF){
+            return -1;
+        }
+    }
+    return at < 0 ? -1 : 0;
+}
+
+/* Name: packStream
+   Purpose: writes a stream block by block, filling in its table entries.
+            if asked to, a block is packed where that saves a quarter of
+            it: a block that barely packs costs more to unpack than to read.
+   Arguments: open file, stream, its size, its table entries, 1 to pack
+   Return: uint64_t -- bytes written, or UINT64_MAX if a write failed
+*/
+static uint64_t packStream(FILE * fp, const unsigned char * bytes,
+                           size_t length, umxBlock * table, int pack){
+    unsigned char * packed = malloc(UMX_BLOCK);
+    uint32_t * seen = malloc(sizeof(*seen) << LZ_HASH_BITS);
+    assert(packed != NULL && seen != NULL);
+    uint64_t written = 0;
+    for (size_t at = 0; at < length; at += UMX_BLOCK, table++){
+        size_t raw = length - at < UMX_BLOCK ? length - at : UMX_BLOCK;
+        size_t stored = pack ? packBlock(bytes + at, raw, packed,
+                                         raw - raw / 4 - 1, seen) : 0;
+        table->raw = (uint32_t)raw;
+        table->stored = stored ? (uint32_t)stored : (uint32_t)raw;
+        if (fwrite(stored ? packed : bytes + at, table->stored, 1, fp) != 1){
+            written = UINT64_MAX;
+            break;
+        }
+        written += table->stored;
+    }
+    free(packed);
+    free(seen);
+    return written;
+}
+
+/* Name: writeCache
+   Purpose: writes a program as a cache of the image it was loaded from.
+            the file is written under a temporary name and renamed into
+            place, so a um starting meanwhile sees the old cache or the
+            new one, never part of one.
+   Arguments: path of the cache, path of the source image ("-" or NULL
+              if none), the loaded program, UMX_* flags
+   Return: int -- 0, or -1 with errno set
+*/
+int writeCache(const char * path, const char * source, Segment program,
+               unsigned flags){
+    assert(path != NULL && program != NULL);
+    umxHeader header;
+    memset(&header, 0, sizeof(header));
+    if (source != NULL && strcmp(source, "-") != 0){
+        struct stat st;
+        if (stat(source, &st) != 0){
+            return -1;
+        }
+        header.sourceSize = (uint64_t)st.st_size;
+        header.sourceSec = (int64_t)st.st_mtim.tv_sec;
+        header.sourceNsec = (int64_t)st.st_mtim.tv_nsec;
+    }
+
+    umDecoded * code = flags & UMX_RECORDS ? decodeProgram(program) : NULL;
+    int pack = (flags & UMX_PACKED) != 0;
+    size_t wordBytes = (size_t)segLength(program) * sizeof(word);
+    size_t recordBytes = code ? ((size_t)segLength(program) + 1) *
+                                sizeof(umDecoded) : 0;
+    memcpy(header.magic, umxMagic, sizeof(umxMagic));
+    header.version = UMX_VERSION;
+    header.order = UMX_ORDER;
+    header.words = segLength(program);
+    header.recordSize = code ? sizeof(umDecoded) : 0;
+    header.decodeVersion = DECODE_VERSION;
+    header.wordBlocks = blocksFor(wordBytes);
+    header.recordBlocks = blocksFor(recordBytes);
+    header.wordSum = checksum((const unsigned char *)program, wordBytes);
+    header.recordSum = checksum((const unsigned char *)code, recordBytes);
+
+    uint32_t blocks = header.wordBlocks + header.recordBlocks;
+    umxBlock * table = calloc(blocks + 1, sizeof(*table));
+    assert(table != NULL);
+    size_t nameLength = strlen(path) + 5;
+    char * temp = malloc(nameLength);
+    assert(temp != NULL);
+    snprintf(temp, nameLength, "%s.tmp", path);
+
+    /* the table goes in once the blocks are written and their sizes known */
+    FILE * fp = fopen(temp, "wb");
+    int failed = fp == NULL;
+    if (!failed){
+        uint64_t recordsAt;
+        uint64_t wordsAt = streamsAt(&header, 0, &recordsAt);
+        uint64_t wordStored;
+        failed = fwrite(&header, sizeof(header), 1, fp) != 1 ||
+                 fwrite(table, sizeof(*table), blocks, fp) != blocks ||
+                 padTo(fp, wordsAt) != 0 ||
+                 (wordStored = packStream(fp, (const unsigned char *)program,
+                                          wordBytes, table, pack)) == 
+                 UINT64_MAX;
+        if (!failed){
+            streamsAt(&header, wordStored, &recordsAt);
+            failed = padTo(fp, recordsAt) != 0 ||
+                     packStream(fp, (const unsigned char *)code, recordBytes,
+                                table + header.wordBlocks, pack) == 
+                     UINT64_MAX ||
+                     fseek(fp, sizeof(header), SEEK_SET) != 0 ||
+                     fwrite(table, sizeof(*table), blocks, fp) != blocks;
+        }
+        failed |= fclose(fp) != 0;
+        failed = failed || rename(temp, path) != 0;
+        if (failed){
+            int saved = errno;
+            unlink(temp);
+            errno = saved;
+        }
+    }
+    free(temp);
+    free(table);
+    freeDecoded(code);
+    return failed ? -1 : 0;
+}
+
+/* Name: isCache
+   Purpose: tells a cache from a .um image by its first bytes
+   Arguments: file bytes, byte count
+   Return: int -- 1 if it is a cache
+*/
+int isCache(const unsigned char * bytes, size_t length){
+    return length >= sizeof(umxHeader) &&
+           memcmp(bytes, umxMagic, sizeof(umxMagic)) == 0;
+}
+
+/* a cache's streams, as found by openCache */
+typedef struct umxStreams {
+        umxHeader header;
+        umxBlock * table;
+        uint64_t wordsAt, recordsAt;
+        size_t wordBytes, recordBytes;
+        int wordsPacked, recordsPacked;
+        int useRecords;         /* of the kind this build decodes */
+} umxStreams;
+
+/* Name: openCache
+   Purpose: checks a cache's header and block table against the file and
+            finds its streams
+   Arguments: bytes of the cache, byte count, stat of the image it must
+              have been written from (or NULL), streams to fill in, where
+              to put why it can't be used
+   Return: int -- 0, or -1
+*/
+static int openCache(const unsigned char * bytes, size_t length,
+                     const struct stat * source, umxStreams * s,
+                     const char ** why){
+    umxHeader * header = &s->header;
+    if (!isCache(bytes, length)){
+        *why = "not a cached image";
+        return -1;
+    }
+    memcpy(header, bytes, sizeof(*header));
+    if (header->version != UMX_VERSION || header->order != UMX_ORDER){
+        *why = "cached by another version or host";
+        return -1;
+    }
+    if (source != NULL &&
+        (header->sourceSize != (uint64_t)source->st_size ||
+         header->sourceSec != (int64_t)source->st_mtim.tv_sec ||
+         header->sourceNsec != (int64_t)source->st_mtim.tv_nsec)){
+        *why = "older than its image";
+        return -1;
+    }
+
+    *why = "damaged cache";
+    s->wordBytes = (size_t)header->words * sizeof(word);
+    s->recordBytes = header->recordSize ?
+                     ((size_t)header->words + 1) * header->recordSize : 0;
+    uint32_t blocks = header->wordBlocks + header->recordBlocks;
+    uint64_t tableBytes = (uint64_t)blocks * sizeof(umxBlock);
+    if (header->wordBlocks != blocksFor(s->wordBytes) ||
+        header->recordBlocks != blocksFor(s->recordBytes) ||
+        tableBytes > length - sizeof(*header)){
+        return -1;
+    }
+    s->table = malloc(tableBytes + sizeof(umxBlock));
+    assert(s->table != NULL);
+    memcpy(s->table, bytes + sizeof(*header), tableBytes);
+
+    /* the blocks must add up before the room for them is taken */
+    uint64_t raw[2] = { 0, 0 }, stored[2] = { 0, 0 };
+    s->wordsPacked = s->recordsPacked = 0;
+    for (uint32_t i = 0; i < blocks; i++){
+        int records = i >= header->wordBlocks;
+        umxBlock block = s->table[i];
+        if (block.stored > block.raw || block.raw > UMX_BLOCK){
+            free(s->table);
+            return -1;
+        }
+        raw[records] += block.raw;
+        stored[records] += block.stored;
+        *(records ? &s->recordsPacked : &s->wordsPacked) |= 
+            block.stored != block.raw;
+    }
+    s->wordsAt = streamsAt(header, stored[0], &s->recordsAt);
+    if (raw[0] != s->wordBytes || raw[1] != s->recordBytes ||
+        s->wordsAt + stored[0] > length ||
+        s->recordsAt + stored[1] > length){
+        free(s->table);
+        return -1;
+    }
+    s->useRecords = header->recordSize == sizeof(umDecoded) &&
+                    header->decodeVersion == DECODE_VERSION;
+    return 0;
+}
+
+/* Name: unpackStream
+   Purpose: unpacks a stream's blocks and checks its checksum
+   Arguments: its first block, its table entries, block count, where to
+              unpack, the stream's size, its checksum
+   Return: int -- 0, or -1 if it is damaged
+*/
+static int unpackStream(const unsigned char * at, const umxBlock * table,
+                        uint32_t blocks, unsigned char * trgt, size_t length,
+                        uint64_t sum){
+    size_t done = 0;
+    for (uint32_t i = 0; i < blocks; i++){
+        umxBlock block = table[i];
+        if (block.stored == block.raw){
+            memcpy(trgt + done, at, block.raw);
+        }
+        else if (unpackBlock(at, block.stored, trgt + done, block.raw)){
+            return -1;
+        }
+        at += block.stored;
+        done += block.raw;
+    }
+    return checksum(trgt, length) == sum ? 0 : -1;
+}
+
+/* Name: loadStreams
+   Purpose: makes segment 0, and its decoded records if the cache has
+            them, from an opened cache. given a private writable mapping
+            of the file, a stream stored unpacked is used where it lies
+            (the memory module never frees a mapped block, nor a segment
+            its shared records) instead of being copied.
+   Arguments: the cache's bytes, its streams, 1 if the bytes may be kept,
+              where to put why it can't be used
+   Return: Segment, or NULL
+*/
+static Segment loadStreams(unsigned char * bytes, umxStreams * s, int keep,
+                           const char ** why){
+    umxHeader * header = &s->header;
+    Segment zero;
+    int damaged;
+    if (keep && !s->wordsPacked){
+        zero = placeSegment(bytes + s->wordsAt - sizeof(segHeader),
+                            header->words);
+        damaged = checksum((unsigned char *)zero, s->wordBytes) !=
+                  header->wordSum;
+    }
+    else {
+        zero = rawSegment(header->words);
+        damaged = unpackStream(bytes + s->wordsAt, s->table, 
+                               header->wordBlocks, (unsigned char *)zero,
+                               s->wordBytes, header->wordSum);
+    }
+
+    umDecoded * code = NULL;
+    int shared = keep && !s->recordsPacked;
+    if (!damaged && s->useRecords && shared){
+        code = (umDecoded *)(bytes + s->recordsAt);
+        damaged = checksum((unsigned char *)code, s->recordBytes) !=
+                  header->recordSum;
+    }
+    else if (!damaged && s->useRecords){
+        code = malloc(s->recordBytes);
+        assert(code != NULL);
+        damaged = unpackStream(bytes + s->recordsAt,
+                               s->table + header->wordBlocks,
+                               header->recordBlocks, (unsigned char *)code,
+                               s->recordBytes, header->recordSum);
+    }
+    free(s->table);
+    if (damaged){
+        if (!shared){
+            freeDecoded(code);
+        }
+        deallocate(zero);
+        *why = "damaged cache";
+        return NULL;
+    }
+    if (code != NULL){
+        SEG_HEADER(zero)->code = code;
+        SEG_HEADER(zero)->flags |= shared ? SEG_SHARED_CODE : 0;
+    }
+    return zero;
+}
+
+/* Name: readCache
+   Purpose: loads the program in a cache (read from a stream) into a new
+            segment (to become segment 0), with its decoded records if the
+            cache has them and they are of the kind this build decodes
+   Arguments: bytes of the cache, byte count, stat of the image it must
+              have been written from (or NULL to take it as it is), where
+              to put why it can't be used
+   Return: Segment, or NULL
+*/
+Segment readCache(const unsigned char * bytes, size_t length,
+                  const struct stat * source, const char ** why){
+    assert(bytes != NULL && why != NULL);
+    umxStreams s;
+    if (openCache(bytes, length, source, &s, why) != 0){
+        return NULL;
+    }
+    return loadStreams((unsigned char *)bytes, &s, 0, why);
+}
+
+/* Name: mapCache
+   Purpose: loads the program in a cache file as readCache does, mapping
+            the file privately. if a stream is stored unpacked the mapping
+            is kept for as long as the process runs, as a restored
+            snapshot's is; otherwise it is unmapped once unpacked.
+   Arguments: open descriptor of the cache, its size, stat of the image
+              it must have been written from (or NULL), where to put why
+              it can't be used
+   Return: Segment, or NULL
+*/
+Segment mapCache(int fd, size_t length, const struct stat * source,
+                 const char ** why){
+    assert(why != NULL);
+    *why = "not a cached image";
+    if (length < sizeof(umxHeader)){
+        return NULL;
+    }
+    unsigned char * bytes = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE, fd, 0);
+    if (bytes == MAP_FAILED){
+        *why = strerror(errno);
+        return NULL;
+    }
+    madvise(bytes, length, MADV_WILLNEED);
+    umxStreams s;
+    if (openCache(bytes, length, source, &s, why) != 0){
+        munmap(bytes, length);
+        return NULL;
+    }
+    int keep = !s.wordsPacked || (s.useRecords && !s.recordsPacked);
+    Segment zero = loadStreams(bytes, &s, 1, why);
+    if (zero == NULL || !keep){
+        munmap(bytes, length);
+    }
+    return zero;
+}
+
+/* Name: cacheName
+   Purpose: names the cache loading an image looks for: image.umx for
+            image.um, else the image's name with .umx added
+   Arguments: path of the image
+   Return: char * -- the path (free it)
+*/
+char * cacheName(const char * source){
+    assert(source != NULL);
+    size_t length = strlen(source);
+    char * name = malloc(length + 5);
+    assert(name != NULL);
+    int dotUm = length >= 3 && strcmp(source + length - 3, ".um") == 0;
+    snprintf(name, length + 5, dotUm ? "%sx" : "%s.umx", source);
+    return name;
+}
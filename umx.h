@@ -0,0 +1,51 @@
+/* Authors: John Little (jlittl04) & Aryan Pandey (apande04)
+ * Date: November 2019
+ * The Universal Machine
+ * File: umx.h - header file for cached program images
+ */
+
+#ifndef UMX_H
+#define UMX_H
+
+#include <stdlib.h>
+#include <inttypes.h>
+#include <sys/stat.h>
+#include "memory.h"
+
+/* a .umx file is a .um image made ready to run on this host: segment 0 in
+ * host byte order and, optionally, its decoded records (see decode.h),
+ * checksummed and, optionally, compressed in blocks. the loader takes one
+ * wherever it takes a .um image -- it starts with opcode 15, which no .um
+ * image can run -- and loading image.um uses image.umx instead if that was
+ * written from the image as it is now (same size and modification time).
+ * an uncompressed cache is mapped and used where it lies, so it loads in
+ * the time it takes to checksum it. the file only suits the host and 
+ * build that wrote it; any other is told apart by its header and never
+ * loaded.
+ */
+#define UMX_VERSION 1
+
+#define UMX_RECORDS 1u          /* include the decoded records */
+#define UMX_PACKED 2u           /* compress the blocks it pays to */
+
+/* writing a cache of a loaded program, named after its source image; 0 or
+ * -1 with errno set
+ */
+int writeCache(const char * path, const char * source, Segment program,
+               unsigned flags);
+
+/* reading one from its bytes, or mapping one from a file (where what it
+ * stores unpacked is used in place). given the source image's stat, a
+ * cache written from any other version of it is turned down. NULL with
+ * the reason in *why if it can't be used.
+ */
+int isCache(const unsigned char * bytes, size_t length);
+Segment readCache(const unsigned char * bytes, size_t length,
+                  const struct stat * source, const char ** why);
+Segment mapCache(int fd, size_t length, const struct stat * source,
+                 const char ** why);
+
+/* the cache that loading an image looks for (free it) */
+char * cacheName(const char * source);
+
+#endif